@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Alias table
+
+    Weighted random choice in constant time. Building it is linear in
+    the number of choices (Vose's method), after that every pick is one
+    uniform number, one multiply and one comparison, with no allocation.
+    Only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    template <class T>
+    class AliasTable {
+    public:
+        AliasTable() = default;
+
+        // Choices with a weight of zero or less are never picked
+        explicit AliasTable(const std::vector<std::pair<T, double>>& weighted) {
+            double total = 0.0;
+            for (auto& i : weighted) {
+                if (i.second > 0.0) {
+                    values.push_back(i.first);
+                    total += i.second;
+                }
+            }
+            if (values.empty()) return;
+
+            auto n = values.size();
+            prob.resize(n);
+            alias.resize(n);
+
+            std::vector<double> scaled;
+            scaled.reserve(n);
+            for (auto& i : weighted) {
+                if (i.second > 0.0) scaled.push_back(i.second * n / total);
+            }
+
+            std::vector<std::uint32_t> small, large;
+            for (std::uint32_t i = 0; i < n; i++) (scaled[i] < 1.0 ? small : large).push_back(i);
+
+            while (!small.empty() && !large.empty()) {
+                auto s = small.back();
+                auto l = large.back();
+                small.pop_back();
+
+                prob[s] = scaled[s];
+                alias[s] = l;
+
+                scaled[l] -= 1.0 - scaled[s];
+                if (scaled[l] < 1.0) {
+                    large.pop_back();
+                    small.push_back(l);
+                }
+            }
+
+            // Whatever is left is within rounding of exactly one slot
+            for (auto i : large) prob[i] = 1.0, alias[i] = i;
+            for (auto i : small) prob[i] = 1.0, alias[i] = i;
+        }
+
+        bool Empty() const { return values.empty(); }
+        std::size_t Size() const { return values.size(); }
+
+        // u is uniform in [0, 1), the table must not be empty
+        const T& Pick(double u) const {
+            auto x = u * values.size();
+            auto i = (std::size_t)x;
+            if (i >= values.size()) i = values.size() - 1;
+            return x - i < prob[i] ? values[i] : values[alias[i]];
+        }
+
+    private:
+        std::vector<T> values;
+        std::vector<double> prob;  // Chance of keeping the slot's own value rather than its alias
+        std::vector<std::uint32_t> alias;
+    };
+}
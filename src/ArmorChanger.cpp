@@ -4,6 +4,7 @@
 #include "Data.h"
 #include "LootLists.h"
 #include "ModIntegrations.h"
+#include "ModelArmorSlotFix.h"
 #include "rapidjson/document.h"
 #include "rapidjson/error/en.h"
 #include "rapidjson/error/error.h"
@@ -159,6 +160,39 @@ namespace {
     int AddDynamicVariants(const RE::TESFile* file, const ArmorChangeParams& params, rapidjson::Value& ls, MemoryPoolAllocator<>& al);
     bool AddPreferenceVariants(const RE::TESFile* file, const ArmorChangeParams& params, rapidjson::Value& ls, MemoryPoolAllocator<>& al, int& r);
 
+    // Works out the items' loot again from every change file that has them, shared then local the same as at startup, so taking loot out
+    // of one file falls back to what another still distributes instead of dropping the item
+    void ReloadLootChanges(const RE::TESFile* file, const std::vector<RE::TESBoundObject*>& items) {
+        if (!g_Data.loot) return;
+
+        for (auto item : items) g_Data.loot->mapItemDist.erase(item);
+
+        auto Load = [&](const char* sub, const Permissions& perm) {
+            if (!perm.bDistributeLoot) return;
+
+            JSONFile changes;
+            changes.path = std::filesystem::current_path() / PATH_ROOT PATH_CHANGES;
+            changes.path /= sub;
+            changes.path /= file->fileName;
+            changes.path += ".json";
+
+            if (!ReadJSONFileInSitu(changes) || !changes.doc.IsObject()) return;
+
+            for (auto item : items) {
+                auto it = changes.doc.FindMember(std::to_string(GetFileId(item)).c_str());
+                if (it == changes.doc.MemberEnd() || !it->value.IsObject()) continue;
+
+                auto loot = it->value.FindMember("loot");
+                if (loot == it->value.MemberEnd() || !loot->value.IsObject()) continue;
+
+                unsigned int changed = 0;
+                LoadLootChanges(item, loot->value, changed);
+            }
+        };
+
+        Load("shared/", g_Config.permShared);
+        Load("local/", g_Config.permLocal);
+    }
 }
 
 ArmorSlots QuickArmorRebalance::GetConvertableArmorSlots(const ArmorChangeParams& params) {
@@ -405,11 +439,13 @@ int QuickArmorRebalance::MakeArmorChanges(const ArmorChangeParams& params) {
     }
 
     std::map<RE::TESFile*, Value> mapFileChanges;
+    std::map<RE::TESFile*, std::vector<RE::TESBoundObject*>> mapFileItems;
     for (auto& i : mapChanges) {
         Value* ls = &mapFileChanges[i.first->GetFile(0)];
         if (!ls->IsObject()) ls->SetObject();
 
         ls->AddMember(Value(std::to_string(GetFileId(i.first)).c_str(), al), i.second, al);
+        mapFileItems[i.first->GetFile(0)].push_back(i.first);
     }
     mapChanges.clear();
 
@@ -472,8 +508,14 @@ int QuickArmorRebalance::MakeArmorChanges(const ArmorChangeParams& params) {
         nChanges += ApplyChanges(i.first, doc.GetObj(), g_Config.permLocal);
     }
 
+    // The merged local changes won't have any loot if it was taken off, in which case a shared change may still distribute the item
+    for (auto& i : mapFileItems) ReloadLootChanges(i.first, i.second);
+
     if (!params.mapKeywordChanges.empty()) MakeKeywordChanges(params);
 
+    UpdateModelArmorSlotTable();
+    RebuildLootLists();
+
     return nChanges;
 }
 
@@ -898,26 +940,9 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
 
                     for (int i = 0; i < RE::SEXES::kTotal; i++) {
                         if (!addon->bipedModels[i].model.empty()) {
-                            std::string modelPath(addon->bipedModels[i].model);
-                            ToLower(modelPath);
-
-                            auto hash = std::hash<std::string>{}(modelPath);
-                            if (!g_Data.noModifyModels.contains(hash)) g_Data.remapFileArmorSlots[hash] = slots;
-
-                            if (modelPath.length() > 6) {
-                                char* pChar = modelPath.data() + modelPath.length() - 6;  //'_X.nif'
-                                if (*pChar++ == '_') {
-                                    if (*pChar == '0') {
-                                        *pChar = '1';
-                                        hash = std::hash<std::string>{}(modelPath);
-                                        if (!g_Data.noModifyModels.contains(hash)) g_Data.remapFileArmorSlots[hash] = slots;
-                                    } else if (*pChar == '1') {
-                                        *pChar = '0';
-                                        hash = std::hash<std::string>{}(modelPath);
-                                        if (!g_Data.noModifyModels.contains(hash)) g_Data.remapFileArmorSlots[hash] = slots;
-                                    }
-                                }
-                            }
+                            g_Data.modelPaths.InternVariants(addon->bipedModels[i].model.c_str(), [=](std::uint64_t hash) {
+                                if (!g_Data.noModifyModels.contains(hash)) g_Data.remapFileArmorSlots[hash] = slots;
+                            });
                         }
                     }
                 }
@@ -1183,13 +1208,8 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
             ArmorChangeParams::RecipeOptions recipeOpts;
             RecipeSettings::Read(opts, recipeOpts);
 
-            RE::BGSConstructibleObject *recipeItem = nullptr, *recipeSrc = nullptr;
-
-            auto it = g_Data.temperRecipe.find(bo);
-            if (it != g_Data.temperRecipe.end()) recipeItem = it->second;
-
-            it = g_Data.temperRecipe.find(boSrc);
-            if (it != g_Data.temperRecipe.end()) recipeSrc = it->second;
+            auto recipeItem = g_Data.recipes.Find(eRecipe_Temper, bo);
+            auto recipeSrc = g_Data.recipes.Find(eRecipe_Temper, boSrc);
 
             bFree = (bFree && perm.crafting.bFree) || recipeSrc;  // If recipe source, free doesn't matter
 
@@ -1204,7 +1224,7 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
                     newForm->data.numConstructed = 1;
 
                     dataHandler->GetFormArray<RE::BGSConstructibleObject>().push_back(newForm);  // For whatever reason, it's not added automatically and thus won't show up in game
-                    g_Data.temperRecipe.insert({bo, recipeItem});
+                    g_Data.recipes.Add(eRecipe_Temper, bo, newForm);
                     recipeItem = newForm;
                 }
             }
@@ -1212,7 +1232,7 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
             if (recipeItem && bFree) ::ReplaceRecipe(recipeOpts, recipeItem, recipeSrc, weight, g_Config.fTemperGoldCostRatio);
         } else {
             if (perm.temper.bRemove) {
-                if (auto recipeItem = MapFindOrNull(g_Data.temperRecipe, bo)) {
+                if (auto recipeItem = g_Data.recipes.Find(eRecipe_Temper, bo)) {
                     recipeItem->benchKeyword = nullptr;
                 }
             }
@@ -1240,13 +1260,8 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
             ArmorChangeParams::RecipeOptions recipeOpts;
             RecipeSettings::Read(opts, recipeOpts);
 
-            RE::BGSConstructibleObject *recipeItem = nullptr, *recipeSrc = nullptr;
-
-            auto it = g_Data.craftRecipe.find(bo);
-            if (it != g_Data.craftRecipe.end()) recipeItem = it->second;
-
-            it = g_Data.craftRecipe.find(boSrc);
-            if (it != g_Data.craftRecipe.end()) recipeSrc = it->second;
+            auto recipeItem = g_Data.recipes.Find(eRecipe_Craft, bo);
+            auto recipeSrc = g_Data.recipes.Find(eRecipe_Craft, boSrc);
 
             bFree = (bFree && perm.crafting.bFree) || recipeSrc;  // If recipe source, free doesn't matter
 
@@ -1261,7 +1276,7 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
 
                         dataHandler->GetFormArray<RE::BGSConstructibleObject>().push_back(
                             newForm);  // For whatever reason, it's not added automatically and thus won't show up in game
-                        g_Data.craftRecipe.insert({bo, recipeItem});
+                        g_Data.recipes.Add(eRecipe_Craft, bo, newForm);
                         recipeItem = newForm;
                     }
                 }
@@ -1273,7 +1288,7 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
             }
         } else {
             if (perm.crafting.bRemove) {
-                if (auto recipeItem = MapFindOrNull(g_Data.craftRecipe, bo)) {
+                if (auto recipeItem = g_Data.recipes.Find(eRecipe_Craft, bo)) {
                     recipeItem->benchKeyword = nullptr;
                 }
             }
@@ -1281,13 +1296,8 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
     }
 
     if (g_Config.bEnableSmeltingRecipes) {
-        RE::BGSConstructibleObject *recipeItem = nullptr, *recipeSrc = nullptr;
-
-        auto it = g_Data.smeltRecipe.find(bo);
-        if (it != g_Data.smeltRecipe.end()) recipeItem = it->second;
-
-        it = g_Data.smeltRecipe.find(boSrc);
-        if (it != g_Data.smeltRecipe.end()) recipeSrc = it->second;
+        auto recipeItem = g_Data.recipes.Find(eRecipe_Smelt, bo);
+        auto recipeSrc = g_Data.recipes.Find(eRecipe_Smelt, boSrc);
 
         if (recipeSrc) {
             if (!recipeItem) {
@@ -1297,7 +1307,7 @@ bool QuickArmorRebalance::ApplyChanges(const RE::TESFile* file, RE::FormID id, c
                     newForm->benchKeyword = recipeSrc ? recipeSrc->benchKeyword : RE::TESForm::LookupByEditorID<RE::BGSKeyword>("CraftingSmelter");
 
                     dataHandler->GetFormArray<RE::BGSConstructibleObject>().push_back(newForm);  // For whatever reason, it's not added automatically and thus won't show up in game
-                    g_Data.smeltRecipe.insert({bo, recipeItem});
+                    g_Data.recipes.Add(eRecipe_Smelt, bo, newForm);
                     recipeItem = newForm;
                 }
 
@@ -1578,6 +1588,9 @@ void ::ReplaceRecipe(ArmorChangeParams::RecipeOptions& opts, RE::BGSConstructibl
 //////////////////////////////
 
 void QuickArmorRebalance::DeleteChanges(std::set<RE::TESBoundObject*> items, const char** fields) {
+    bool bLoot = !fields;
+    for (auto field = fields; field && *field; field++) bLoot |= !strcmp(*field, "loot");
+
     std::map<RE::TESFile*, std::vector<RE::TESBoundObject*>> mapFileItems;
     for (auto i : items) {
         if (g_Data.modifiedItems.contains(i)) mapFileItems[i->GetFile(0)].push_back(i);
@@ -1612,7 +1625,11 @@ void QuickArmorRebalance::DeleteChanges(std::set<RE::TESBoundObject*> items, con
         }
 
         WriteJSONFile(path, doc);
+
+        if (bLoot) ReloadLootChanges(i.first, i.second);
     }
+
+    if (bLoot) RebuildLootLists();
 }
 
 /////////////////////////////////////////////
@@ -5,6 +5,7 @@
 
 #include "Config.h"
 #include "NameParsing.h"
+#include "Random.h"
 
 using namespace QuickArmorRebalance;
 
@@ -238,7 +239,7 @@ ArmorSet QuickArmorRebalance::BuildSetFrom(RE::TESBoundObject* baseObj, const st
             if (bLimit) {
             
             if (!best.empty()) {
-                auto one = best.size() == 1 ? best[0] : best[RNG() % best.size()];
+                auto one = best.size() == 1 ? best[0] : best[ThreadRandom().Below((std::uint32_t)best.size())];
                 slots |= (ArmorSlots)one->GetSlotMask();
                 armorSet.push_back(one);
             }            
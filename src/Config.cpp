@@ -16,9 +16,11 @@
 
 #define USER_BLACKLIST_FILE "User Blacklist.json"
 
+#include "ConfigMerge.h"
 #include "Enchantments.h"
 #include "Localization.h"
 #include "LootLists.h"
+#include "Profiler.h"
 
 using namespace rapidjson;
 using namespace QuickArmorRebalance;
@@ -207,16 +209,32 @@ bool QuickArmorRebalance::Config::Load() {
         return false;
     }
 
+    std::vector<JSONFile> files;
+
     for (const auto& entry : std::filesystem::directory_iterator(pathConfig)) {
         if (!entry.is_regular_file()) continue;
         if (_stricmp(entry.path().extension().generic_string().c_str(), ".json")) continue;
 
-        logger::debug("Loading config file {}", entry.path().filename().generic_string());
-        if (LoadFile(entry.path())) {
-            bSuccess = true;
-        } else {
-            logger::warn("Failed to load config file {}", entry.path().filename().generic_string());
-        }
+        files.emplace_back().path = entry.path();
+    }
+
+    SortConfigFiles(files, [](const JSONFile& file) { return file.path.filename().generic_string(); });
+
+    {
+        ScopedTimer timer("Parse config files");
+        ReadJSONFiles(files);
+        Profiler::Get()->Count("Config files parsed", files.size());
+    }
+
+    {
+        ScopedTimer timer("Merge config files");
+        bSuccess = MergeConfigFiles(files, [this](JSONFile& file) {
+            logger::debug("Loading config file {}", file.path.filename().generic_string());
+            if (file.bRead && LoadFile(file.path, file.doc)) return true;
+
+            logger::warn("Failed to load config file {}", file.path.filename().generic_string());
+            return false;
+        });
     }
 
     if (!bSuccess) {
@@ -309,6 +327,9 @@ bool QuickArmorRebalance::Config::Load() {
             g_Config.bHighlights = config["settings"]["highlights"].value_or(true);
             g_Config.bNormalizeModDrops = config["settings"]["normalizedrops"].value_or(true);
             g_Config.fDropRates = config["settings"]["droprate"].value_or(100.0f);
+            g_Config.fLootWeightTolerance = std::clamp(config["settings"]["lootweighttolerance"].value_or(0.5f), 0.0f, 10.0f);
+            g_Config.lootMaxDepth = std::clamp(config["settings"]["lootmaxdepth"].value_or(6), 0, 32);
+            g_Config.lootMaxRollEntries = std::clamp(config["settings"]["lootmaxrollentries"].value_or(0), 0, 1 << 16);
             g_Config.levelGranularity = std::clamp(config["settings"]["levelgranularity"].value_or(3), 1, 5);
             g_Config.craftingRarityMax = std::clamp(config["settings"]["craftingraritymax"].value_or(2), 0, 2);
             g_Config.bDisableCraftingRecipesOnRarity = config["settings"]["craftingraritydisable"].value_or(false);
@@ -331,10 +352,13 @@ bool QuickArmorRebalance::Config::Load() {
             g_Config.bReorderKeywordsForRelevance = config["settings"]["reorderkeywords"].value_or(true);
             g_Config.bEquipPreviewForKeywords = config["settings"]["equipkeywordpreview"].value_or(true);
             g_Config.bExportUntranslated = config["settings"]["exportuntranslated"].value_or(false);
+            g_Config.bExportLootGraph = config["settings"]["exportlootgraph"].value_or(false);
+            g_Config.bExportLootTables = config["settings"]["exportloottables"].value_or(false);
             g_Config.bEnableEnchantmentDistrib = config["settings"]["distenchants"].value_or(true);
             g_Config.bEnchantRandomCharge = config["settings"]["enchantrandomcharge"].value_or(true);
             g_Config.bAlwaysEnchantStaves = config["settings"]["alwaysenchantstaves"].value_or(true);
             g_Config.fEnchantRates = config["settings"]["enchantrate"].value_or(100.0f);
+            g_Config.randomSeed = config["settings"]["randomseed"].value_or((std::int64_t)0);
             g_Config.bShowAllRecipeConditions = config["settings"]["allrecipereqs"].value_or(false);
             g_Config.bEnableRegionalLoot = config["settings"]["regionalloot"].value_or(true);
             g_Config.bEnableCrossRegionLoot = config["settings"]["crossregionloot"].value_or(true);
@@ -561,27 +585,10 @@ namespace {
     }
 }
 
-bool QuickArmorRebalance::Config::LoadFile(std::filesystem::path path) {
+bool QuickArmorRebalance::Config::LoadFile(std::filesystem::path path, Document& d) {
     auto dataHandler = RE::TESDataHandler::GetSingleton();
 
-    auto fp = std::fopen(path.generic_string().c_str(), "rb");
-
-    if (!fp) {
-        logger::warn("Could not open config file {}", path.filename().generic_string());
-        return false;
-    }
-
-    char readBuffer[1 << 16];
-    FileReadStream is(fp, readBuffer, sizeof(readBuffer));
-
-    Document d;
-    d.ParseStream(is);
-    std::fclose(fp);
-
-    if (d.HasParseError()) {
-        logger::warn("JSON parse error: {} ({})", GetParseError_En(d.GetParseError()), d.GetErrorOffset());
-        return false;
-    }
+    if (d.HasParseError()) return false;  // Already reported when read
 
     if (!d.IsObject()) {
         logger::warn("root is not object");
@@ -1037,6 +1044,9 @@ void QuickArmorRebalance::Config::Save() {
                                  {"highlights", g_Config.bHighlights},
                                  {"normalizedrops", g_Config.bNormalizeModDrops},
                                  {"droprate", g_Config.fDropRates},
+                                 {"lootweighttolerance", g_Config.fLootWeightTolerance},
+                                 {"lootmaxdepth", g_Config.lootMaxDepth},
+                                 {"lootmaxrollentries", g_Config.lootMaxRollEntries},
                                  {"levelgranularity", g_Config.levelGranularity},
                                  {"distenchants", g_Config.bEnableEnchantmentDistrib},
                                  {"enchantrate", g_Config.fEnchantRates},
@@ -1069,6 +1079,9 @@ void QuickArmorRebalance::Config::Save() {
                                  {"autodisablewords", tomlDisableWords},
                                  {"language", WStringToString(Localization::Get()->language)},
                                  {"exportuntranslated", g_Config.bExportUntranslated},
+                                 {"exportlootgraph", g_Config.bExportLootGraph},
+                                 {"exportloottables", g_Config.bExportLootTables},
+                                 {"randomseed", g_Config.randomSeed},
                                  {"defaultcosmeticslots", g_Config.slotsDefaultCosmetic},
                                  {"recipeBlacklistConditions", tomlRecipeConditionBlacklist}}},
         {"shortcuts", toml::table{{"escCloseWindow", g_Config.bShortcutEscCloseWindow}}},
@@ -216,7 +216,7 @@ namespace QuickArmorRebalance {
 
     struct Config {
         bool Load();
-        bool LoadFile(std::filesystem::path path);
+        bool LoadFile(std::filesystem::path path, rapidjson::Document& d);
 
         void Save();
 
@@ -326,6 +326,8 @@ namespace QuickArmorRebalance {
         bool bAlwaysEnchantStaves = true;
 
         bool bExportUntranslated = false;
+        bool bExportLootGraph = false;
+        bool bExportLootTables = false;
 
         bool bEnableDAVExports = true;
         bool bEnableDAVExportsAlways = false;
@@ -343,10 +345,16 @@ namespace QuickArmorRebalance {
 
         float fDropRates = 100.0f;
         float fEnchantRates = 100.0f;
+        float fLootWeightTolerance = 0.5f;  // Percent of a weighted list's odds that may be rounded away to keep it to one list
         int verbosity = spdlog::level::info;
         int levelGranularity = 3;
         int craftingRarityMax = 2;
 
+        int lootMaxDepth = 6;        // Nested leveled lists one container roll may go through before they're flattened, 0 for no limit
+        int lootMaxRollEntries = 0;  // Entries one container roll may scan before lists are flattened, 0 for no limit
+
+        std::int64_t randomSeed = 0;  // Seed for the enchantment rolls, 0 to seed from the clock each run
+
         int levelMaxDist = 1;
         int levelEnchDelay = 3;
         float enchChanceBase = 0.1f;
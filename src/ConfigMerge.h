@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Config merge order
+
+    Config files are parsed all at once on worker threads, then applied
+    to the config one at a time. Later files win wherever they overlap,
+    so the order they're applied in decides the result. Shared with
+    tools/ConfigMergeCheck.cpp so the order checked there is the one
+    Config::Load uses. Only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    // Same order as _stricmp: ASCII letters compared as lowercase, then by byte value
+    inline int CompareConfigFileNames(std::string_view a, std::string_view b) {
+        auto Lower = [](char c) { return (unsigned char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c); };
+
+        for (std::size_t i = 0; i < a.size() && i < b.size(); i++) {
+            if (Lower(a[i]) != Lower(b[i])) return Lower(a[i]) - Lower(b[i]);
+        }
+        return a.size() < b.size() ? -1 : a.size() > b.size();
+    }
+
+    // Puts the files in the order they're merged in, by file name rather than whatever order the directory listing gave
+    template <class File, class NameOf>
+    void SortConfigFiles(std::vector<File>& files, NameOf&& nameOf) {
+        std::stable_sort(files.begin(), files.end(), [&](const File& a, const File& b) { return CompareConfigFileNames(nameOf(a), nameOf(b)) < 0; });
+    }
+
+    // Applies the sorted, already parsed files one after another on this thread. apply(file) returns false for a file that didn't
+    // parse or load, which is skipped. Returns whether any file applied
+    template <class Files, class Apply>
+    bool MergeConfigFiles(Files&& files, Apply&& apply) {
+        bool bAny = false;
+        for (auto& file : files) {
+            if (apply(file)) bAny = true;
+        }
+        return bAny;
+    }
+}
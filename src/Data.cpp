@@ -1,8 +1,13 @@
 #include "Data.h"
 
+#include <execution>
+#include <fstream>
+
 #include "ArmorChanger.h"
 #include "Config.h"
 #include "ModIntegrations.h"
+#include "Profiler.h"
+#include "ShardedBucket.h"
 #include "rapidjson/document.h"
 #include "rapidjson/error/en.h"
 #include "rapidjson/error/error.h"
@@ -11,11 +16,91 @@
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/stringbuffer.h"
 
+#define VANILLA_MODELS_FILE "Vanilla Models.bin"
+
 using namespace rapidjson;
 
 namespace QuickArmorRebalance {
     void LoadChangesFromFolder(const char* sub, const Permissions& perm);
-    bool LoadFileChanges(const RE::TESFile* mod, std::filesystem::path path, const Permissions& perm);
+    bool LoadFileChanges(const RE::TESFile* mod, JSONFile& file, const Permissions& perm);
+
+    // Skyrim.esm's armor models only change with the game or with plugins overriding its armor addons, so the list is saved for a game
+    // version and those overrides
+    constexpr std::uint32_t kVanillaModelsVersion = 2;
+
+    struct VanillaModelsHeader {
+        std::uint32_t version;
+        std::uint32_t gameVersion;
+        std::uint64_t fingerprint;
+        std::uint32_t count;
+        std::uint32_t reserved;
+    };
+
+    // Which plugin wins each Skyrim.esm armor addon that something overrides and the models it gives the addon, in form order. The paths
+    // are what the list is built from, so a plugin updated under the same name still changes the fingerprint if it changes a model
+    std::uint64_t GetVanillaModelsFingerprint() {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        auto Mix = [&](std::uint8_t c) {
+            hash ^= c;
+            hash *= 0x100000001b3ull;
+        };
+
+        for (auto addon : RE::TESDataHandler::GetSingleton()->GetFormArray<RE::TESObjectARMA>()) {
+            if ((addon->GetFormID() & 0xff000000) != 0) continue;
+
+            auto file = addon->GetFile(-1);
+            if (!file || !_stricmp(file->fileName, "Skyrim.esm")) continue;
+
+            auto id = addon->GetFormID();
+            for (int i = 0; i < 4; i++) Mix((std::uint8_t)(id >> (8 * i)));
+            for (auto p = file->fileName; *p; p++) Mix((std::uint8_t)FoldPathChar(*p));
+            Mix(0);
+
+            for (int i = 0; i < RE::SEXES::kTotal; i++) {
+                for (auto p = addon->bipedModels[i].model.c_str(); *p; p++) Mix((std::uint8_t)FoldPathChar(*p));
+                Mix(0);
+            }
+        }
+        return hash;
+    }
+
+    bool ReadVanillaModels(const std::filesystem::path& path, std::uint32_t gameVersion, std::uint64_t fingerprint) {
+        std::error_code ec;
+        auto size = std::filesystem::file_size(path, ec);
+        if (ec || size < sizeof(VanillaModelsHeader)) return false;
+
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        VanillaModelsHeader header;
+        if (!file.read((char*)&header, sizeof(header)) || header.version != kVanillaModelsVersion || header.gameVersion != gameVersion ||
+            header.fingerprint != fingerprint)
+            return false;
+
+        // The count has to account for exactly the rest of the file, anything else is a torn or corrupt write
+        if ((size - sizeof(header)) / sizeof(std::uint64_t) != header.count || (size - sizeof(header)) % sizeof(std::uint64_t)) {
+            logger::warn("{} is corrupt, rebuilding", path.filename().generic_string());
+            return false;
+        }
+
+        std::vector<std::uint64_t> hashes(header.count);
+        if (!file.read((char*)hashes.data(), hashes.size() * sizeof(std::uint64_t))) return false;
+
+        g_Data.noModifyModels.insert(hashes.begin(), hashes.end());
+        return true;
+    }
+
+    void WriteVanillaModels(const std::filesystem::path& path, std::uint32_t gameVersion, std::uint64_t fingerprint) {
+        std::vector<std::uint64_t> hashes(g_Data.noModifyModels.begin(), g_Data.noModifyModels.end());
+        std::sort(hashes.begin(), hashes.end());
+
+        std::ofstream file(path, std::ios::binary);
+        VanillaModelsHeader header{kVanillaModelsVersion, gameVersion, fingerprint, (std::uint32_t)hashes.size(), 0};
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)hashes.data(), hashes.size() * sizeof(std::uint64_t));
+
+        if (!file) logger::warn("Could not write {}", path.generic_string());
+    }
 }
 
 using namespace QuickArmorRebalance;
@@ -56,6 +141,40 @@ bool QuickArmorRebalance::ReadJSONFile(std::filesystem::path path, Document& doc
     return true;
 }
 
+bool QuickArmorRebalance::ReadJSONFileInSitu(JSONFile& file) {
+    const auto& path = file.path;
+
+    if (!std::filesystem::exists(path)) {
+        file.doc.SetObject();
+        return true;
+    }
+
+    auto fp = std::fopen(path.generic_string().c_str(), "rb");
+    if (!fp) {
+        logger::warn("Could not open file {}", path.filename().generic_string());
+        return false;
+    }
+
+    std::error_code ec;
+    auto size = std::filesystem::file_size(path, ec);
+    file.buffer.resize(ec ? 1 : (size_t)size + 1);
+    auto nRead = std::fread(file.buffer.data(), 1, file.buffer.size() - 1, fp);
+    std::fclose(fp);
+    file.buffer[nRead] = '\0';
+
+    file.doc.ParseInsitu<kParseCommentsFlag | kParseTrailingCommasFlag>(file.buffer.data());
+
+    if (file.doc.HasParseError()) {
+        logger::warn("{}: JSON parse error: {} ({})", path.generic_string(), GetParseError_En(file.doc.GetParseError()), file.doc.GetErrorOffset());
+    }
+
+    return true;
+}
+
+void QuickArmorRebalance::ReadJSONFiles(std::vector<JSONFile>& files) {
+    std::for_each(std::execution::par, files.begin(), files.end(), [](JSONFile& file) { file.bRead = ReadJSONFileInSitu(file); });
+}
+
 bool QuickArmorRebalance::WriteJSONFile(std::filesystem::path path, rapidjson::Document& doc) {
     if (auto fp = std::fopen(path.generic_string().c_str(), "wb")) {
         char buffer[1 << 16];
@@ -97,46 +216,38 @@ bool QuickArmorRebalance::IsValidItem(RE::TESBoundObject* i) {
     return true;
 }
 
-void ProcessItem(RE::TESBoundObject* i) {
-    if (!IsValidItem(i)) return;
-
-    auto mod = i->GetFile(0);
-    auto it = g_Data.modData.find(mod);
-    ModData* data = nullptr;
-
-    if (it != g_Data.modData.end())
-        data = it->second.get();
-    else {
-        g_Data.sortedMods.push_back(data = (g_Data.modData[mod] = std::make_unique<ModData>(mod)).get());
-        logger::trace("Added {}", mod->fileName);
-    }
-
-    data->items.insert(i);
-}
-
-void CopyRecipe(std::map<RE::TESBoundObject*, RE::BGSConstructibleObject*>& map, RE::TESBoundObject* src, RE::TESBoundObject* tar) {
-    if (map.find(tar) != map.end()) return;
-
-    auto it = map.find(src);
-    if (it != map.end()) map.insert({tar, it->second});
-}
-
 void QuickArmorRebalance::ProcessData() {
     auto dataHandler = RE::TESDataHandler::GetSingleton();
 
-    logger::trace("Processing armor");
-    for (auto i : dataHandler->GetFormArray<RE::TESObjectARMO>()) {
-        ProcessItem(i);
-    }
+    std::optional<ScopedTimer> timer;
+    timer.emplace("Items");
+
+    logger::trace("Processing items");
+    {
+        auto& armors = dataHandler->GetFormArray<RE::TESObjectARMO>();
+        auto& weaps = dataHandler->GetFormArray<RE::TESObjectWEAP>();
+        auto& ammo = dataHandler->GetFormArray<RE::TESAmmo>();
+
+        std::vector<RE::TESBoundObject*> forms;
+        forms.reserve(armors.size() + weaps.size() + ammo.size());
+        forms.insert(forms.end(), armors.begin(), armors.end());
+        forms.insert(forms.end(), weaps.begin(), weaps.end());
+        forms.insert(forms.end(), ammo.begin(), ammo.end());
+
+        // Filtering only reads the forms and config, so it's split across workers and merged per mod afterwards
+        auto buckets = ShardedBucketBy<RE::TESFile*>(forms, IsValidItem, [](RE::TESBoundObject* i) { return i->GetFile(0); });
+
+        for (auto& [mod, items] : buckets) {
+            auto& data = g_Data.modData[mod];
+            if (!data) {
+                g_Data.sortedMods.push_back((data = std::make_unique<ModData>(mod)).get());
+                logger::trace("Added {}", mod->fileName);
+            }
 
-    logger::trace("Processing weapons");
-    for (auto i : dataHandler->GetFormArray<RE::TESObjectWEAP>()) {
-        ProcessItem(i);
-    }
+            data->items = std::move(items);
+        }
 
-    logger::trace("Processing ammo");
-    for (auto i : dataHandler->GetFormArray<RE::TESAmmo>()) {
-        ProcessItem(i);
+        Profiler::Get()->Count("Items processed", forms.size());
     }
 
     if (!g_Data.sortedMods.empty()) {
@@ -153,21 +264,25 @@ void QuickArmorRebalance::ProcessData() {
     auto smelter = RE::TESForm::LookupByEditorID<RE::BGSKeyword>("CraftingSmelter");
     if (!temperBench) return;
 
+    timer.emplace("Recipes");
+
     logger::trace("Processing recipes");
     auto& lsRecipies = dataHandler->GetFormArray<RE::BGSConstructibleObject>();
+    g_Data.recipes.Reserve(lsRecipies.size());
     for (auto i : lsRecipies) {
         if (!i->createdItem) continue;
         auto pObj = i->createdItem->As<RE::TESBoundObject>();
         if (!pObj) continue;
 
         if (i->benchKeyword == temperBench || i->benchKeyword == temperWeapBench)
-            g_Data.temperRecipe.insert({pObj, i});
+            g_Data.recipes.Add(eRecipe_Temper, pObj, i);
         else if (i->benchKeyword == smelter) {
             auto& mats = i->requiredItems;
-            if (mats.numContainerObjects == 1) g_Data.smeltRecipe.insert({mats.containerObjects[0]->obj, i});
+            if (mats.numContainerObjects == 1) g_Data.recipes.Add(eRecipe_Smelt, mats.containerObjects[0]->obj, i);
         } else
-            g_Data.craftRecipe.insert({pObj, i});
+            g_Data.recipes.Add(eRecipe_Craft, pObj, i);
     }
+    Profiler::Get()->Count("Recipes indexed", lsRecipies.size());
 
     if (g_Config.bUseSecondaryRecipes) {
         logger::trace("Building secondary recipes");
@@ -176,13 +291,13 @@ void QuickArmorRebalance::ProcessData() {
             if (!i.strFallbackRecipeSet.empty()) {
                 if (auto as = g_Config.FindArmorSet(i.strFallbackRecipeSet.c_str())) {
                     auto fillRecipes = [as](auto item) {
-                        bool hasTemper = g_Data.temperRecipe.find(item) != g_Data.temperRecipe.end();
-                        bool hasCraft = g_Data.craftRecipe.find(item) != g_Data.craftRecipe.end();
+                        bool hasTemper = g_Data.recipes.Find(eRecipe_Temper, item);
+                        bool hasCraft = g_Data.recipes.Find(eRecipe_Craft, item);
 
                         if (!hasTemper || !hasCraft) {
                             if (auto copy = as->FindMatching(item)) {
-                                if (!hasTemper) CopyRecipe(g_Data.temperRecipe, copy, item);
-                                if (!hasCraft) CopyRecipe(g_Data.craftRecipe, copy, item);
+                                if (!hasTemper) g_Data.recipes.Share(eRecipe_Temper, copy, item);
+                                if (!hasCraft) g_Data.recipes.Share(eRecipe_Craft, copy, item);
                             }
                         }
                     };
@@ -196,9 +311,9 @@ void QuickArmorRebalance::ProcessData() {
 
             /*
             auto reportMissingRecipies = [](auto item) {
-                if (g_Data.temperRecipe.find(item) == g_Data.temperRecipe.end())
+                if (!g_Data.recipes.Find(eRecipe_Temper, item))
                     logger::info("{}: Missing temper recipe", item->GetName());
-                if (g_Data.craftRecipe.find(item) == g_Data.craftRecipe.end())
+                if (!g_Data.recipes.Find(eRecipe_Craft, item))
                     logger::info("{}: Missing craft recipe", item->GetName());
             };
 
@@ -209,11 +324,13 @@ void QuickArmorRebalance::ProcessData() {
         }
     }
 
-    static std::set<RE::TESForm*> recipeConditionForms;
+    std::set<RE::TESForm*> recipeConditionForms;
     for (auto& armorSet : g_Config.armorSets) {
 
         struct RecipeProcessFuncs {
-            static void Pull(RE::TESBoundObject* obj, RE::BGSConstructibleObject* recipe) {
+            std::set<RE::TESForm*>& recipeConditionForms;
+
+            void Pull(RE::TESBoundObject* obj, RE::BGSConstructibleObject* recipe) {
                 for (auto cond = recipe->conditions.head; cond; cond = cond->next) {
                     switch (cond->data.functionData.function.get()) {
                         case RE::FUNCTION_DATA::FunctionID::kGetItemCount:
@@ -231,21 +348,29 @@ void QuickArmorRebalance::ProcessData() {
                 
             }
 
-            static void PullConditions(RE::TESBoundObject* obj) {
-                if (auto recipe = MapFindOrNull(g_Data.temperRecipe, obj)) Pull(obj, recipe);
-                if (auto recipe = MapFindOrNull(g_Data.craftRecipe, obj)) Pull(obj, recipe);
+            void PullConditions(RE::TESBoundObject* obj) {
+                if (auto recipe = g_Data.recipes.Find(eRecipe_Temper, obj)) Pull(obj, recipe);
+                if (auto recipe = g_Data.recipes.Find(eRecipe_Craft, obj)) Pull(obj, recipe);
             }
-        };
+        } funcs{recipeConditionForms};
 
-        for (auto i : armorSet.items) RecipeProcessFuncs::PullConditions(i);
-        for (auto i : armorSet.weaps) RecipeProcessFuncs::PullConditions(i);
-        for (auto i : armorSet.ammo) RecipeProcessFuncs::PullConditions(i);
+        for (auto i : armorSet.items) funcs.PullConditions(i);
+        for (auto i : armorSet.weaps) funcs.PullConditions(i);
+        for (auto i : armorSet.ammo) funcs.PullConditions(i);
     }
 
-    for (auto i : recipeConditionForms) {
-        g_Data.recipeConditions.push_back(i);
-        std::sort(g_Data.recipeConditions.begin(), g_Data.recipeConditions.end(),
-                  [](RE::TESForm* const a, RE::TESForm* const b) { return _stricmp(a->GetName(), b->GetName()) < 0; });        
+    g_Data.recipeConditions.assign(recipeConditionForms.begin(), recipeConditionForms.end());
+    std::sort(g_Data.recipeConditions.begin(), g_Data.recipeConditions.end(),
+              [](RE::TESForm* const a, RE::TESForm* const b) { return _stricmp(a->GetName(), b->GetName()) < 0; });
+
+    timer.emplace("Skyrim model files");
+
+    auto pathVanillaModels = std::filesystem::current_path() / PATH_ROOT VANILLA_MODELS_FILE;
+    auto gameVersion = REL::Module::get().version().pack();
+    auto fingerprint = GetVanillaModelsFingerprint();
+    if (ReadVanillaModels(pathVanillaModels, gameVersion, fingerprint)) {
+        logger::trace("Loaded list of skyrim armor model files");
+        return;
     }
 
     logger::trace("Building list of skyrim armor model files");
@@ -256,30 +381,13 @@ void QuickArmorRebalance::ProcessData() {
 
             for (int i = 0; i < RE::SEXES::kTotal; i++) {
                 if (!addon->bipedModels[i].model.empty()) {
-                    std::string modelPath(addon->bipedModels[i].model);
-                    ToLower(modelPath);
-
-                    auto hash = std::hash<std::string>{}(modelPath);
-                    g_Data.noModifyModels.insert(hash);
-
-                    if (modelPath.length() > 6) {
-                        char* pChar = modelPath.data() + modelPath.length() - 6;  //'_X.nif'
-                        if (*pChar++ == '_') {
-                            if (*pChar == '0') {
-                                *pChar = '1';
-                                hash = std::hash<std::string>{}(modelPath);
-                                g_Data.noModifyModels.insert(hash);
-                            } else if (*pChar == '1') {
-                                *pChar = '0';
-                                hash = std::hash<std::string>{}(modelPath);
-                                g_Data.noModifyModels.insert(hash);
-                            }
-                        }
-                    }
+                    ForEachModelPathVariant(addon->bipedModels[i].model.c_str(), [](std::string_view, std::uint64_t hash) { g_Data.noModifyModels.insert(hash); });
                 }
             }
         }
     }
+
+    WriteVanillaModels(pathVanillaModels, gameVersion, fingerprint);
 }
 
 void QuickArmorRebalance::LoadChangesFromFiles() {
@@ -299,12 +407,21 @@ void QuickArmorRebalance::LoadChangesFromFiles() {
     }
     */
 
-    ImportFromDAV();
+    {
+        ScopedTimer timer("Import from DAV");
+        ImportFromDAV();
+    }
 
     logger::info("Loading changes from files");
-    LoadChangesFromFolder("shared/", QuickArmorRebalance::g_Config.permShared);
+    {
+        ScopedTimer timer("Shared changes");
+        LoadChangesFromFolder("shared/", QuickArmorRebalance::g_Config.permShared);
+    }
     logger::info("{} items affected from shared changes", g_Data.modifiedItemsShared.size());
-    LoadChangesFromFolder("local/", QuickArmorRebalance::g_Config.permLocal);
+    {
+        ScopedTimer timer("Local changes");
+        LoadChangesFromFolder("local/", QuickArmorRebalance::g_Config.permLocal);
+    }
     logger::info("{} items affected from local changes", g_Data.modifiedItems.size());
 }
 
@@ -336,10 +453,30 @@ void QuickArmorRebalance::ForChangesInFolder(const char* sub, const std::functio
 }
 
 void QuickArmorRebalance::LoadChangesFromFolder(const char* sub, const Permissions& perm) {
-    ForChangesInFolder(sub, [&](auto mod, auto path) {
-        if (!LoadFileChanges(mod, path, perm)) logger::warn("Failed to load change file {}", path.filename().generic_string());
+    std::vector<std::pair<const RE::TESFile*, std::filesystem::path>> found;
+    ForChangesInFolder(sub, [&](auto mod, auto path) { found.emplace_back(mod, path); });
+
+    // Apply in load order rather than whatever order the directory listing gave
+    std::stable_sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+        if (a.first->compileIndex != b.first->compileIndex) return a.first->compileIndex < b.first->compileIndex;
+        return a.first->smallFileCompileIndex < b.first->smallFileCompileIndex;
     });
 
+    std::vector<JSONFile> files(found.size());
+    for (size_t i = 0; i < found.size(); i++) files[i].path = found[i].second;
+
+    {
+        ScopedTimer timer("Parse change files");
+        ReadJSONFiles(files);
+    }
+
+    {
+        ScopedTimer timer("Apply change files");
+        for (size_t i = 0; i < files.size(); i++) {
+            if (!LoadFileChanges(found[i].first, files[i], perm)) logger::warn("Failed to load change file {}", files[i].path.filename().generic_string());
+        }
+    }
+
     if (perm.bModifyCustomKeywords) {
         std::filesystem::path dir(sub);
         dir /= PATH_CUSTOMKEYWORDS;
@@ -350,10 +487,11 @@ void QuickArmorRebalance::LoadChangesFromFolder(const char* sub, const Permissio
     }
 }
 
-bool QuickArmorRebalance::LoadFileChanges(const RE::TESFile* mod, std::filesystem::path path, const Permissions& perm) {
-    Document doc;
+bool QuickArmorRebalance::LoadFileChanges(const RE::TESFile* mod, JSONFile& file, const Permissions& perm) {
+    auto& doc = file.doc;
 
-    if (!ReadJSONFile(path, doc, false)) return false;
+    if (!file.bRead) return false;
+    Profiler::Get()->Count("Change files parsed");
 
     if (doc.HasParseError() || !doc.IsObject()) return false;
 
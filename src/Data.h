@@ -1,5 +1,9 @@
 #pragma once
 
+#include "FlatMap.h"
+#include "ModelPaths.h"
+#include "RecipeIndex.h"
+
 std::string& toLowerUTF8(std::string& utf8_str);  // In NameParsing.cpp
 
 namespace QuickArmorRebalance {
@@ -42,6 +46,19 @@ namespace QuickArmorRebalance {
     bool ReadJSONFile(std::filesystem::path path, rapidjson::Document& doc, bool bEditing = true);
     bool WriteJSONFile(std::filesystem::path path, rapidjson::Document& doc);
 
+    struct JSONFile {
+        std::filesystem::path path;
+        std::vector<char> buffer;  // Strings in doc point into this when parsed in-situ
+        rapidjson::Document doc;
+        bool bRead = false;
+    };
+
+    // Read-only alternative to ReadJSONFile - reads the file once into file.buffer and parses it in place rather than copying every string
+    bool ReadJSONFileInSitu(JSONFile& file);
+
+    // Parses all the files in-situ on worker threads - only touches the files themselves, so the results can then be applied in order
+    void ReadJSONFiles(std::vector<JSONFile>& files);
+
     inline int GetJsonBool(const rapidjson::Value& parent, const char* id, bool d = false) {
         if (parent.HasMember(id)) {
             const auto& v = parent[id];
@@ -172,7 +189,7 @@ namespace QuickArmorRebalance {
         ModData(RE::TESFile* mod) : mod(mod) {}
 
         RE::TESFile* mod;
-        std::set<RE::TESBoundObject*> items;
+        std::vector<RE::TESBoundObject*> items;  // Sorted
 
         bool bModified = false;
         bool bHasDynamicVariants = false;
@@ -264,8 +281,6 @@ namespace QuickArmorRebalance {
     };
 
     struct ModLootData {
-        std::map<const ArmorSet*, RE::TESBoundObject*> setList;
-
         std::map<std::string, LootContainerGroup> containerGroups;
         std::map<std::string, LootDistProfile> distProfiles;
 
@@ -276,13 +291,6 @@ namespace QuickArmorRebalance {
         std::map<std::size_t, std::unordered_set<RE::TESObjectARMO*>> prefVartWithout;
 
         std::unordered_map<RE::TESForm*, std::set<RE::TESForm*>> mapContainerCopy;
-
-        std::unordered_map<const void*, RE::TESBoundObject*> cacheGroupList;
-        std::unordered_map<const void*, RE::TESBoundObject*> cacheRegionalGroupTierList[eLoot_TypeCount];
-        std::map<LootDistGroup*, std::map<const LootContainerGroup*, std::map<Region*, RE::TESBoundObject*>>> cacheSourceSelectionList[eLoot_TypeCount];
-        std::map<const LootContainerGroup*, std::map<Region*, RE::TESBoundObject*[3]>> cacheLowerTierItems[eLoot_TypeCount];
-
-        //std::map<Region*, std::map<LootContainerGroup*, RE::TESBoundObject*>> tblRegionSourceCurveCache[eLoot_TypeCount];
     };
 
     struct KeywordChanges {
@@ -307,6 +315,9 @@ namespace QuickArmorRebalance {
         std::vector<RE::EnchantmentItem*> ranks;
         int levelMin = 1;
         int levelMax = INT_MAX;
+
+        // Roll power each rank after the first starts at, ascending. Built by FinalizeEnchantmentConfig once ranks are sorted
+        std::vector<float> thresholds;
     };
 
     struct ObjEnchantParams {
@@ -316,6 +327,8 @@ namespace QuickArmorRebalance {
         float uniquePoolChance = 0.5f;
     };
 
+    using RecipeIndex = BasicRecipeIndex<RE::TESBoundObject, RE::BGSConstructibleObject>;
+
     struct ProcessedData {
         std::map<const RE::TESFile*, std::unique_ptr<ModData>> modData;
         std::vector<ModData*> sortedMods;
@@ -326,27 +339,27 @@ namespace QuickArmorRebalance {
         std::unordered_map<RE::TESBoundObject*, unsigned int> modifiedItems;
         std::unordered_map<RE::TESBoundObject*, unsigned int> modifiedItemsShared;
         std::unordered_set<RE::TESBoundObject*> modifiedItemsDeleted;
-        std::map<RE::TESBoundObject*, RE::BGSConstructibleObject*> temperRecipe;
-        std::map<RE::TESBoundObject*, RE::BGSConstructibleObject*> craftRecipe;
-        std::map<RE::TESBoundObject*, RE::BGSConstructibleObject*> smeltRecipe;
+        RecipeIndex recipes;
 
         std::map<RE::TESObjectARMO*, ArmorSlots> modifiedArmorSlots;
         std::map<RE::TESObjectARMO*, float> modifiedWarmth;
 
-        std::unordered_map<size_t, ArmorSlots> remapFileArmorSlots;
-        std::unordered_set<size_t> noModifyModels;
+        ModelPathInterner modelPaths;
+        std::unordered_map<std::uint64_t, ArmorSlots> remapFileArmorSlots;  // By model path hash, the model slot fix hook reads a snapshot of this
+        std::unordered_set<std::uint64_t> noModifyModels;                   // Model path hashes of Skyrim.esm armor
 
         std::unique_ptr<ModLootData> loot;
         std::map<std::string, LootDistGroup> distGroups;
         std::vector<LootDistGroup*> distGroupsSorted;
 
+        // The enchantment hooks read a snapshot of these, rebuilding loot in game changes them while containers are being initialized
         std::unordered_map<RE::TESContainer*, EnchantProbability> distContainers;
-        std::unordered_set<RE::TESBoundObject*> distItems;
+        FlatSet<RE::FormID> distItems;  // By form ID, checked against every item in every container the enchantment hooks see
 
         std::unordered_map<RE::TESBoundObject*, ObjEnchantParams> enchParams;
         std::unordered_map<RE::TESBoundObject*, WeightedEnchantments*> staffEnchGroup;
 
-        std::vector<RE::TESForm*> recipeConditions;
+        std::vector<RE::TESForm*> recipeConditions;  // Sorted by name
     };
 
     bool IsValidItem(RE::TESBoundObject* i);
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Enchantment rank order
+
+    Sorts the ranks of one enchantment weakest first and drops
+    duplicates. Templated on the rank type so the ordering can be checked
+    without the game (see tools/EnchantRankSortCheck.cpp). Only depends
+    on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    // Every rank's magnitudes make up a row, with a column per base effect any of the ranks has. Columns go by the earliest place the
+    // effect is listed in any rank, so primary effects count first, then by effect ID, so they don't depend on which rank was loaded first.
+    // An effect a rank lacks sorts below any magnitude. Comparing rows is a strict weak order even when ranks have different effects,
+    // which the old pairwise effect matching wasn't, so the result doesn't depend on the order ranks were loaded in. Ranks with the same
+    // row are duplicates, and of those the first one loaded is kept.
+    // forEachEffect(rank, fn) calls fn(base effect ID, magnitude) for each of the rank's effects, in the order the rank lists them
+    template <class Rank, class ForEachEffect>
+    void SortEnchantRanks(std::vector<Rank*>& ranks, ForEachEffect&& forEachEffect) {
+        if (ranks.size() < 2) return;
+
+        std::vector<std::pair<std::size_t, std::uint32_t>> columns;  // Earliest position, effect ID
+        for (auto rank : ranks) {
+            std::size_t pos = 0;
+            forEachEffect(rank, [&](std::uint32_t effect, float) {
+                auto it = std::find_if(columns.begin(), columns.end(), [=](auto& c) { return c.second == effect; });
+                if (it == columns.end())
+                    columns.emplace_back(pos, effect);
+                else
+                    it->first = std::min(it->first, pos);
+                pos++;
+            });
+        }
+        std::sort(columns.begin(), columns.end());
+
+        auto Column = [&](std::uint32_t effect) { return std::find_if(columns.begin(), columns.end(), [=](auto& c) { return c.second == effect; }) - columns.begin(); };
+
+        constexpr float kMissing = -std::numeric_limits<float>::infinity();
+
+        auto width = columns.size();
+        std::vector<float> magnitudes(ranks.size() * width, kMissing);
+        for (std::size_t row = 0; row < ranks.size(); row++) {
+            forEachEffect(ranks[row], [&](std::uint32_t effect, float magnitude) {
+                auto& m = magnitudes[row * width + Column(effect)];
+                if (m == kMissing) m = magnitude + 0.0f;  // First one counts if an effect repeats, +0 folds -0 into 0
+            });
+        }
+
+        auto Row = [&](std::uint32_t row) { return magnitudes.data() + row * width; };
+
+        std::vector<std::uint32_t> order(ranks.size());
+        for (std::uint32_t i = 0; i < order.size(); i++) order[i] = i;
+
+        // Ties go to load order, so of several ranks with the same magnitudes the first one loaded is the one kept
+        std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+            auto [itA, itB] = std::mismatch(Row(a), Row(a) + width, Row(b));
+            return itA != Row(a) + width ? *itA < *itB : a < b;
+        });
+        order.erase(std::unique(order.begin(), order.end(), [&](auto a, auto b) { return std::equal(Row(a), Row(a) + width, Row(b)); }), order.end());
+
+        std::vector<Rank*> sorted;
+        sorted.reserve(order.size());
+        for (auto i : order) sorted.push_back(ranks[i]);
+        ranks = std::move(sorted);
+    }
+}
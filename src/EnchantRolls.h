@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "Random.h"
+
+/*////////////////////////////////////////////////////////////////////
+    Enchantment rolls
+
+    The math deciding whether a distributed item gets enchanted, which
+    rank and how much charge. The game hooks and the offline enchantment
+    simulator (EnchantSimulation) both roll through these, so what the
+    simulator reports is what the game does. Only depends on the
+    standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    struct EnchantRollSettings {
+        float chanceBase = 0.1f;
+        float chanceBonusMax = 0.15f;
+        float chanceBonus = 0.01f;  // Per level the roll is above the item's level
+        float rates = 100.0f;       // Overall enchantment rate, in percent
+        int levelMaxDist = 1;       // Highest distribution group level, where ranks top out
+        int levelDelay = 3;         // Levels the rolls lag behind the container, except for staves
+        float chargeMin = 500.0f;
+        float chargeMax = 3000.0f;
+        bool bAlwaysEnchantStaves = true;
+        bool bRandomCharge = true;  // Weapons come with part of their charge used up
+    };
+
+    // Level the items in a container of the given level are rolled at, less than 1 for none
+    inline int EnchantRollLevel(const EnchantRollSettings& settings, int containerLevel, bool bStaff) {
+        return bStaff ? containerLevel : containerLevel - settings.levelDelay;
+    }
+
+    // Rate is the container's enchantment rate times the item's
+    inline float EnchantChance(const EnchantRollSettings& settings, int level, int itemLevel, float rate) {
+        float chance = settings.chanceBase + std::min(settings.chanceBonus * (level - itemLevel), settings.chanceBonusMax);
+        return chance * (0.01f * settings.rates) * rate;
+    }
+
+    // Somewhere between the item's level and the roll's, scaled by the container's enchantment power times the item's
+    inline float EnchantPower(int itemLevel, int level, float power, Random& rng) {
+        auto t = rng.UniformF();
+        auto spread = std::normal_distribution<float>(1.0f, 0.25f)(rng);
+        return power * std::lerp((float)itemLevel, (float)level, t) * spread;
+    }
+
+    // Roll power each rank after the first starts at, evenly spaced from the enchantment's minimum level up to whichever of its maximum
+    // level and the highest distribution level is lower
+    inline std::vector<float> EnchantRankThresholds(int levelMin, int levelMax, int levelMaxDist, std::size_t ranks) {
+        std::vector<float> thresholds;
+        if (ranks < 2) return thresholds;
+
+        auto steps = ranks - 1;
+        auto span = (float)std::max(0, std::min(levelMaxDist, levelMax) - levelMin);
+        for (std::size_t i = 1; i <= steps; i++) thresholds.push_back(levelMin + span * i / steps);
+        return thresholds;
+    }
+
+    struct EnchantStrength {
+        int charge = 0;
+        std::size_t rank = 0;  // Index into the enchantment's ranks, weakest first
+    };
+
+    // Thresholds from EnchantRankThresholds, null for staff enchantments which have no ranks
+    inline EnchantStrength RollEnchantStrength(const EnchantRollSettings& settings, int itemLevel, int level, float power, const std::vector<float>* thresholds,
+                                               Random& rng) {
+        EnchantStrength ret;
+        ret.charge = (int)std::lerp(settings.chargeMin, settings.chargeMax, std::clamp(EnchantPower(itemLevel, level, power, rng) / settings.levelMaxDist, 0.0f, 1.0f));
+        if (!thresholds || thresholds->empty()) return ret;
+
+        auto rankPower = EnchantPower(itemLevel, level, power, rng);
+        for (auto t : *thresholds) ret.rank += rankPower >= t;
+        return ret;
+    }
+
+    // Charge left on a weapon that comes with some of it used
+    inline float EnchantRemainingCharge(int charge, Random& rng) { return charge * std::pow(rng.UniformF(), 0.33f); }
+}
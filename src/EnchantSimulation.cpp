@@ -0,0 +1,520 @@
+#include "EnchantSimulation.h"
+
+#include "AliasTable.h"
+#include "FlatMap.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <execution>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+
+namespace {
+    using namespace QuickArmorRebalance;
+
+    constexpr std::uint32_t kRollsPerChunk = 1 << 16;
+
+    std::string Lower(std::string_view str) {
+        std::string ret(str);
+        for (auto& c : ret) c = (char)std::tolower((unsigned char)c);
+        return ret;
+    }
+
+    bool Contains(std::string_view str, std::string_view what) { return str.find(what) != std::string_view::npos; }
+
+    // Lowercase ID with the rank number and a "Base" suffix dropped, so every rank and the base enchantment come out the same
+    std::string RankFamily(std::string_view id, std::uint32_t* number = nullptr) {
+        auto family = Lower(id);
+
+        auto digits = family.size();
+        while (digits && std::isdigit((unsigned char)family[digits - 1])) digits--;
+        if (number) *number = digits < family.size() ? (std::uint32_t)std::strtoul(family.c_str() + digits, nullptr, 10) : 0;
+        family.resize(digits);
+
+        if (family.size() > 4 && family.ends_with("base")) family.resize(family.size() - 4);
+        while (!family.empty() && (family.back() == '_' || family.back() == ' ')) family.pop_back();
+        return family;
+    }
+
+    using rapidjson::Value;
+
+    const Value* Member(const Value& parent, const char* id) {
+        if (!parent.IsObject()) return nullptr;
+        auto it = parent.FindMember(id);
+        return it != parent.MemberEnd() ? &it->value : nullptr;
+    }
+
+    std::string_view String(const Value& value) { return {value.GetString(), value.GetStringLength()}; }
+
+    // Same defaults and limits as GetJsonInt and GetJsonFloat
+    int JsonInt(const Value& parent, const char* id, int min, int max, int d) {
+        auto v = Member(parent, id);
+        if (v && v->IsInt()) return std::clamp(v->GetInt(), min, max);
+        return std::max(min, d);
+    }
+
+    float JsonFloat(const Value& parent, const char* id, float min, float max, float d) {
+        auto v = Member(parent, id);
+        if (v && v->IsNumber()) return std::clamp(v->GetFloat(), min, max);
+        return std::max(min, d);
+    }
+
+    // The level buckets and weighted tables of EnchantSampler, for one pool and kind of item
+    class SimSampler {
+    public:
+        SimSampler(const EnchantSimModel& model, const EnchantSimModel::Pool& pool, bool bArmor) {
+            std::vector<std::pair<std::uint32_t, float>> candidates;
+            for (auto& i : pool.enchs) {
+                auto& e = model.enchs[i.first];
+                if (bArmor ? !e.bArmor : !e.bWeapon) continue;
+
+                candidates.push_back(i);
+                levels.push_back(e.levelMin);
+            }
+
+            std::sort(levels.begin(), levels.end());
+            levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+            for (auto level : levels) {
+                std::vector<std::pair<std::uint32_t, double>> weighted;
+                for (auto& i : candidates) {
+                    if (model.enchs[i.first].levelMin <= level) weighted.push_back({i.first, i.second});
+                }
+                tables.emplace_back(weighted);
+            }
+        }
+
+        // Index of the enchantment, or -1 for none
+        int Pick(int level, Random& rng) const {
+            auto it = std::upper_bound(levels.begin(), levels.end(), level);
+            if (it == levels.begin()) return -1;
+
+            auto& table = tables[it - levels.begin() - 1];
+            return table.Empty() ? -1 : (int)table.Pick(rng.Uniform());
+        }
+
+    private:
+        std::vector<int> levels;
+        std::vector<AliasTable<std::uint32_t>> tables;
+    };
+
+    // The staff tables of one group: from each pool the entries that are in the group, and the whole group for pools without any
+    struct SimStaffTables {
+        SimStaffTables(const EnchantSimModel& model, const EnchantSimModel::StaffGroup& group) {
+            std::vector<std::pair<std::uint32_t, double>> weighted;
+            for (std::uint32_t i = 0; i < group.enchs.size(); i++) weighted.push_back({i, group.enchs[i].second});
+            all = AliasTable<std::uint32_t>(weighted);
+
+            for (auto& pool : model.pools) {
+                weighted.clear();
+                for (auto& entry : pool.entries) {
+                    auto it = std::find_if(group.enchs.begin(), group.enchs.end(), [&](auto& i) { return i.first == entry.first; });
+                    if (it != group.enchs.end()) weighted.push_back({(std::uint32_t)(it - group.enchs.begin()), it->second});
+                }
+                pools.emplace_back(weighted);
+            }
+        }
+
+        const AliasTable<std::uint32_t>* Find(std::size_t pool) const {
+            if (!pools[pool].Empty()) return &pools[pool];
+            return all.Empty() ? nullptr : &all;
+        }
+
+        AliasTable<std::uint32_t> all;
+        std::vector<AliasTable<std::uint32_t>> pools;
+    };
+
+    struct SimTask {
+        std::uint32_t level;  // Index into the result levels
+        std::uint32_t first;  // Index of the first roll, for spreading over the pools
+        std::uint32_t rolls;
+
+        EnchantSimulationResult::Level counts;
+    };
+
+    class EnchantRoller {
+    public:
+        EnchantRoller(const EnchantSimModel& model, const EnchantSimulationParams& params) : model(model), params(params), item(params.item) {
+            for (auto& pool : model.pools) {
+                armor.emplace_back(model, pool, true);
+                weapon.emplace_back(model, pool, false);
+            }
+            if (item.kind == EnchantSimKind::kStaff && item.staffGroup >= 0) staff.emplace_back(model, model.staffGroups[item.staffGroup]);
+        }
+
+        // Same steps as AddEnchantments, ShouldEnchant and PickEnchant take for one item in a container of the given level
+        void Roll(int containerLevel, std::uint32_t n, Random& rng, EnchantSimulationResult::Level& counts) const {
+            counts.rolls++;
+
+            auto& settings = model.settings;
+            bool bStaff = item.kind == EnchantSimKind::kStaff;
+
+            auto level = EnchantRollLevel(settings, containerLevel, bStaff);
+            if (level < 1) return;
+
+            if (!(bStaff && settings.bAlwaysEnchantStaves)) {
+                if (rng.UniformF() >= EnchantChance(settings, level, item.level, params.containerRate * item.rate)) return;
+            }
+
+            int pool = item.pool >= 0 ? item.pool : (int)(n % model.pools.size());
+            if (item.uniquePool >= 0 && rng.UniformF() <= item.uniquePoolChance) pool = item.uniquePool;
+
+            auto power = params.containerPower * item.power;
+            EnchantStrength strength;
+
+            if (bStaff) {
+                auto table = staff.empty() ? nullptr : staff.front().Find(pool);
+                if (!table) return;
+
+                table->Pick(rng.Uniform());
+                strength = RollEnchantStrength(settings, item.level, level, power, nullptr, rng);
+            } else {
+                auto& sampler = item.kind == EnchantSimKind::kArmor ? armor[pool] : weapon[pool];
+                auto ench = sampler.Pick(level, rng);
+                if (ench < 0) return;
+
+                auto& e = model.enchs[ench];
+                strength = RollEnchantStrength(settings, item.level, level, power, &e.thresholds, rng);
+
+                counts.ranks[strength.rank]++;
+                if (strength.rank + 1 == e.ranks.size()) counts.topRank++;
+            }
+
+            counts.enchanted++;
+            counts.pools[pool]++;
+
+            if (item.kind != EnchantSimKind::kArmor) {
+                auto span = settings.chargeMax - settings.chargeMin;
+                auto bucket = span > 0.0f ? (int)((strength.charge - settings.chargeMin) * EnchantSimulationResult::kChargeBuckets / span) : 0;
+                counts.charges[std::clamp(bucket, 0, EnchantSimulationResult::kChargeBuckets - 1)]++;
+
+                counts.chargeTotal += strength.charge;
+                counts.remainingTotal += settings.bRandomCharge ? EnchantRemainingCharge(strength.charge, rng) : strength.charge;
+            }
+        }
+
+    private:
+        const EnchantSimModel& model;
+        const EnchantSimulationParams& params;
+        const EnchantSimItem& item;
+
+        std::vector<SimSampler> armor;
+        std::vector<SimSampler> weapon;
+        std::vector<SimStaffTables> staff;  // Just the item's group
+    };
+
+    std::size_t MaxRanks(const EnchantSimModel& model) {
+        std::size_t ret = 1;
+        for (auto& e : model.enchs) ret = std::max(ret, e.ranks.size());
+        return ret;
+    }
+
+    double Percent(std::uint64_t n, std::uint64_t of) { return of ? 100.0 * n / of : 0.0; }
+}
+
+std::uint32_t QuickArmorRebalance::EnchantSimModel::Family(std::string_view name) {
+    auto family = RankFamily(name);
+
+    auto [it, bNew] = families.try_emplace(family, (std::uint32_t)enchs.size());
+    if (bNew) {
+        enchs.emplace_back().name = name;
+        loadedRanks.emplace_back();
+    }
+    return it->second;
+}
+
+void QuickArmorRebalance::EnchantSimModel::Load(const rapidjson::Value& config, std::string_view source) {
+    if (!config.IsObject()) {
+        warnings.push_back(std::string(source) + ": root is not an object");
+        return;
+    }
+
+    if (auto jsonSettings = Member(config, "settings")) {
+        settings.levelDelay = JsonInt(*jsonSettings, "enchLevelDelay", 0, 10, settings.levelDelay);
+        settings.chanceBase = JsonFloat(*jsonSettings, "enchChanceBase", 0.0f, 1.0f, settings.chanceBase);
+        settings.chanceBonus = JsonFloat(*jsonSettings, "enchChanceBonus", 0.0f, 1.0f, settings.chanceBonus);
+        settings.chanceBonusMax = JsonFloat(*jsonSettings, "enchChanceBonusMax", 0.0f, 1.0f, settings.chanceBonusMax);
+        settings.chargeMin = (float)JsonInt(*jsonSettings, "enchWeapChargeMin", 1, 10000, (int)settings.chargeMin);
+        settings.chargeMax = (float)JsonInt(*jsonSettings, "enchWeapChargeMax", 1, 10000, (int)settings.chargeMax);
+    }
+
+    // The highest distribution group level is where ranks top out
+    if (auto jsonLoot = Member(config, "loot")) {
+        if (auto jsonGroups = Member(*jsonLoot, "distGroups"); jsonGroups && jsonGroups->IsObject()) {
+            for (auto& group : jsonGroups->GetObj()) settings.levelMaxDist = std::max(settings.levelMaxDist, JsonInt(group.value, "level", 1, 255, 0));
+        }
+    }
+
+    if (auto jsonEnchs = Member(config, "enchAvailable")) {
+        if (!jsonEnchs->IsObject()) warnings.push_back(std::string(source) + ": enchAvailable expected to be an object");
+
+        auto AddRank = [&](std::uint32_t family, std::string_view id) {
+            std::uint32_t number = 0;
+            RankFamily(id, &number);
+            loadedRanks[family].push_back({number, std::string(id)});
+        };
+
+        if (jsonEnchs->IsObject()) {
+            for (auto& jsonMod : jsonEnchs->GetObj()) {
+                if (!jsonMod.value.IsArray()) continue;
+
+                for (auto& i : jsonMod.value.GetArray()) {
+                    if (i.IsString()) {
+                        AddRank(Family(String(i)), String(i));
+                    } else if (i.IsObject()) {
+                        for (auto& group : i.GetObj()) {
+                            auto family = Family(String(group.name));
+                            if (group.value.IsString())
+                                AddRank(family, String(group.value));
+                            else if (group.value.IsArray()) {
+                                for (auto& id : group.value.GetArray()) {
+                                    if (id.IsString()) AddRank(family, String(id));
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (auto jsonEnchs = Member(config, "enchParams"); jsonEnchs && jsonEnchs->IsObject()) {
+        for (auto& i : jsonEnchs->GetObj()) {
+            auto& e = enchs[Family(String(i.name))];
+
+            if (auto v = Member(i.value, "min"); v && v->IsInt()) e.levelMin = std::max(v->GetInt(), 1);
+            if (auto v = Member(i.value, "max"); v && v->IsInt()) e.levelMax = std::max(v->GetInt(), 1);
+            e.levelMax = std::max(e.levelMin, e.levelMax);
+        }
+    }
+
+    if (auto jsonPools = Member(config, "enchPools")) {
+        if (!jsonPools->IsObject()) warnings.push_back(std::string(source) + ": enchPools expected to be an object");
+
+        if (jsonPools->IsObject()) {
+            for (auto& jsonPool : jsonPools->GetObj()) {
+                auto name = String(jsonPool.name);
+                auto index = FindPool(name);
+                if (index < 0) {
+                    index = (int)pools.size();
+                    pools.emplace_back().name = name;
+                }
+                auto& pool = pools[index];
+                if (!jsonPool.value.IsObject()) continue;
+
+                for (auto& i : jsonPool.value.GetObj()) {
+                    if (!i.value.IsNumber()) {
+                        warnings.push_back(std::string(source) + ": Enchantment pool entry '" + i.name.GetString() + "' incorrect value type");
+                        continue;
+                    }
+
+                    auto id = Lower(String(i.name));
+                    auto it = std::find_if(pool.entries.begin(), pool.entries.end(), [&](auto& entry) { return entry.first == id; });
+                    if (it != pool.entries.end())
+                        it->second = i.value.GetFloat();
+                    else
+                        pool.entries.push_back({id, i.value.GetFloat()});
+                }
+            }
+        }
+    }
+
+    if (auto jsonGroups = Member(config, "enchStaff"); jsonGroups && jsonGroups->IsObject()) {
+        for (auto& jsonGroup : jsonGroups->GetObj()) {
+            if (!jsonGroup.value.IsObject()) continue;
+
+            auto name = String(jsonGroup.name);
+            auto index = FindStaffGroup(name);
+            if (index < 0) {
+                index = (int)staffGroups.size();
+                staffGroups.emplace_back().name = name;
+            }
+            auto& group = staffGroups[index];
+
+            for (auto& jsonMod : jsonGroup.value.GetObj()) {
+                if (!jsonMod.value.IsObject()) continue;
+
+                for (auto& i : jsonMod.value.GetObj()) {
+                    if (!i.value.IsNumber() || i.value.GetDouble() <= 0.0) continue;
+
+                    auto id = Lower(String(i.name));
+                    auto it = std::find_if(group.enchs.begin(), group.enchs.end(), [&](auto& entry) { return entry.first == id; });
+                    if (it != group.enchs.end())
+                        it->second = i.value.GetFloat();
+                    else
+                        group.enchs.push_back({id, i.value.GetFloat()});
+                }
+            }
+        }
+    }
+}
+
+void QuickArmorRebalance::EnchantSimModel::Finalize() {
+    for (std::size_t i = 0; i < enchs.size(); i++) {
+        auto& e = enchs[i];
+        auto& loaded = loadedRanks[i];
+
+        std::stable_sort(loaded.begin(), loaded.end(), [](auto& a, auto& b) { return a.first < b.first; });
+
+        e.ranks.clear();
+        for (auto& rank : loaded) {
+            if (std::find(e.ranks.begin(), e.ranks.end(), rank.second) == e.ranks.end()) e.ranks.push_back(rank.second);
+        }
+        e.thresholds = EnchantRankThresholds(e.levelMin, e.levelMax, settings.levelMaxDist, e.ranks.size());
+
+        auto id = Lower(e.name);
+        bool bWeapon = Contains(id, "weap");
+        bool bArmor = Contains(id, "armor");
+        e.bArmor = bArmor || !bWeapon;
+        e.bWeapon = bWeapon || !bArmor;
+    }
+
+    for (auto& pool : pools) {
+        pool.enchs.clear();
+        for (auto& entry : pool.entries) {
+            auto it = families.find(RankFamily(entry.first));
+            if (it != families.end() && !enchs[it->second].ranks.empty()) {
+                pool.enchs.push_back({it->second, entry.second});
+                continue;
+            }
+
+            bool bStaff = std::any_of(staffGroups.begin(), staffGroups.end(), [&](auto& group) {
+                return std::any_of(group.enchs.begin(), group.enchs.end(), [&](auto& i) { return i.first == entry.first; });
+            });
+            if (!bStaff) warnings.push_back("Pool '" + pool.name + "': no ranks of '" + entry.first + "' are available, it's never picked");
+        }
+    }
+}
+
+int QuickArmorRebalance::EnchantSimModel::FindPool(std::string_view name) const {
+    auto id = Lower(name);
+    for (std::size_t i = 0; i < pools.size(); i++) {
+        if (Lower(pools[i].name) == id) return (int)i;
+    }
+    return -1;
+}
+
+int QuickArmorRebalance::EnchantSimModel::FindStaffGroup(std::string_view name) const {
+    auto id = Lower(name);
+    for (std::size_t i = 0; i < staffGroups.size(); i++) {
+        if (Lower(staffGroups[i].name) == id) return (int)i;
+    }
+    return -1;
+}
+
+QuickArmorRebalance::EnchantSimulationResult QuickArmorRebalance::SimulateEnchantments(const EnchantSimModel& model, const EnchantSimulationParams& params) {
+    EnchantSimulationResult result;
+    if (model.pools.empty()) return result;
+
+    EnchantRoller roller(model, params);
+
+    auto Empty = [&](int level) {
+        EnchantSimulationResult::Level counts;
+        counts.level = level;
+        counts.ranks.resize(MaxRanks(model));
+        counts.pools.resize(model.pools.size());
+        counts.charges.resize(EnchantSimulationResult::kChargeBuckets);
+        return counts;
+    };
+
+    std::vector<SimTask> tasks;
+    for (auto level : params.levels) {
+        auto index = (std::uint32_t)result.levels.size();
+        result.levels.push_back(Empty(level));
+
+        for (std::uint32_t rolls = 0; rolls < params.rolls; rolls += kRollsPerChunk) tasks.push_back({index, rolls, std::min(kRollsPerChunk, params.rolls - rolls), Empty(level)});
+    }
+
+    std::vector<std::size_t> taskIds(tasks.size());
+    std::iota(taskIds.begin(), taskIds.end(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::for_each(std::execution::par, taskIds.begin(), taskIds.end(), [&](std::size_t n) {
+        auto& task = tasks[n];
+        Random rng(MixHash(params.seed ^ MixHash(n + 1)));
+
+        for (std::uint32_t i = 0; i < task.rolls; i++) roller.Roll(task.counts.level, task.first + i, rng, task.counts);
+    });
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& task : tasks) {
+        auto& total = result.levels[task.level];
+        auto& counts = task.counts;
+
+        total.rolls += counts.rolls;
+        total.enchanted += counts.enchanted;
+        total.topRank += counts.topRank;
+        for (std::size_t i = 0; i < counts.ranks.size(); i++) total.ranks[i] += counts.ranks[i];
+        for (std::size_t i = 0; i < counts.pools.size(); i++) total.pools[i] += counts.pools[i];
+        for (std::size_t i = 0; i < counts.charges.size(); i++) total.charges[i] += counts.charges[i];
+        total.chargeTotal += counts.chargeTotal;
+        total.remainingTotal += counts.remainingTotal;
+
+        result.rolls += counts.rolls;
+    }
+
+    return result;
+}
+
+void QuickArmorRebalance::WriteEnchantSimulationReport(const EnchantSimModel& model, const EnchantSimulationParams& params, const EnchantSimulationResult& result,
+                                                       std::ostream& os) {
+    static const char* kKinds[] = {"armor", "weapon", "staff"};
+    auto& item = params.item;
+
+    os << std::fixed << std::setprecision(0);
+    os << "Simulated " << result.rolls << " rolls in " << result.seconds * 1000.0 << "ms (" << result.RollsPerSecond() << " rolls/s)\n";
+
+    std::size_t ranked = 0;
+    for (auto& e : model.enchs) ranked += !e.ranks.empty();
+    os << ranked << " ranked enchantments, " << model.pools.size() << " pools, " << model.staffGroups.size() << " staff groups, ranks top out at level "
+       << model.settings.levelMaxDist << "\n";
+
+    os << std::setprecision(2);
+    os << "Item: " << kKinds[(int)item.kind] << ", level " << item.level << ", rate " << item.rate * params.containerRate << ", power " << item.power * params.containerPower
+       << ", pool " << (item.pool >= 0 ? model.pools[item.pool].name : "(all, evenly)");
+    if (item.uniquePool >= 0) os << ", unique pool " << model.pools[item.uniquePool].name << " at " << item.uniquePoolChance * 100.0 << "%";
+    if (item.kind == EnchantSimKind::kStaff) os << ", staff group " << (item.staffGroup >= 0 ? model.staffGroups[item.staffGroup].name : "(none)");
+    os << "\n";
+
+    auto& settings = model.settings;
+    for (auto& level : result.levels) {
+        os << "\nLevel " << level.level << ": " << Percent(level.enchanted, level.rolls) << "% enchanted (" << level.enchanted << " of " << level.rolls << ")\n";
+        if (!level.enchanted) continue;
+
+        if (item.kind != EnchantSimKind::kStaff) {
+            os << "   Ranks:";
+            auto last = level.ranks.size();
+            while (last > 1 && !level.ranks[last - 1]) last--;
+            for (std::size_t i = 0; i < last; i++) os << (i ? ", " : " ") << i + 1 << ": " << Percent(level.ranks[i], level.enchanted) << "%";
+            os << ", strongest of its enchantment " << Percent(level.topRank, level.enchanted) << "%\n";
+        }
+
+        if (item.kind != EnchantSimKind::kArmor) {
+            os << std::setprecision(0);
+            os << "   Charge: average " << level.chargeTotal / level.enchanted << ", left after use " << level.remainingTotal / level.enchanted << "\n";
+            os << std::setprecision(2);
+
+            auto step = (settings.chargeMax - settings.chargeMin) / EnchantSimulationResult::kChargeBuckets;
+            for (int i = 0; i < EnchantSimulationResult::kChargeBuckets; i++) {
+                if (!level.charges[i]) continue;
+                os << "      " << (int)(settings.chargeMin + step * i) << "-" << (int)(settings.chargeMin + step * (i + 1)) << ": " << Percent(level.charges[i], level.enchanted)
+                   << "%\n";
+            }
+        }
+
+        os << "   Pools:";
+        bool bFirst = true;
+        for (std::size_t i = 0; i < level.pools.size(); i++) {
+            if (!level.pools[i]) continue;
+            os << (bFirst ? " " : ", ") << model.pools[i].name << " " << Percent(level.pools[i], level.enchanted) << "%";
+            bFirst = false;
+        }
+        os << "\n";
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "EnchantRolls.h"
+#include "rapidjson/document.h"
+
+/*////////////////////////////////////////////////////////////////////
+    Enchantment simulation
+
+    Rolls enchantments for one kind of distributed item the way the
+    container hooks do, from the enchantment sections of the config
+    files (enchAvailable, enchParams, enchPools, enchStaff and the
+    enchantment settings), spread over all cores. Reports how often it
+    comes out enchanted, which ranks, how much charge and which pool
+    the enchantment came from, for each container level. Like the loot
+    simulation, every chunk of rolls gets its own random stream from the
+    run seed, so a seed always gives the same report.
+
+    Without the game there are no forms, so enchantments stand in by
+    editor ID. The ranks of one enchantment are those whose IDs match
+    after dropping trailing digits and a trailing "Base" (as in
+    EnchArmorFortifyHealth01 to 06), ordered by that number since their
+    magnitudes aren't known. Enchantments with "weap" in the ID go on
+    weapons, with "armor" on armor, and the rest on both. Worn
+    restrictions are never in the way. Only depends on the standard
+    library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    enum class EnchantSimKind { kArmor, kWeapon, kStaff };
+
+    struct EnchantSimModel {
+        struct Enchantment {
+            std::string name;
+            std::vector<std::string> ranks;  // Weakest first
+            int levelMin = 1;
+            int levelMax = INT_MAX;
+            std::vector<float> thresholds;
+            bool bArmor = true;
+            bool bWeapon = true;
+        };
+
+        struct Pool {
+            std::string name;
+            std::vector<std::pair<std::uint32_t, float>> enchs;  // Ranked enchantments, by index
+            std::vector<std::pair<std::string, float>> entries;  // As listed, by lowercase ID
+        };
+
+        struct StaffGroup {
+            std::string name;
+            std::vector<std::pair<std::string, float>> enchs;  // By lowercase ID
+        };
+
+        EnchantRollSettings settings;
+        std::vector<Enchantment> enchs;
+        std::vector<Pool> pools;
+        std::vector<StaffGroup> staffGroups;
+        std::vector<std::string> warnings;
+
+        // One config file, in the order the game loads them
+        void Load(const rapidjson::Value& config, std::string_view source);
+        // Once every file is loaded: sorts ranks and drops pool entries nothing matched, like FinalizeEnchantmentConfig
+        void Finalize();
+
+        int FindPool(std::string_view name) const;
+        int FindStaffGroup(std::string_view name) const;
+
+    private:
+        std::unordered_map<std::string, std::uint32_t> families;  // Enchantments by rank family
+        std::vector<std::vector<std::pair<std::uint32_t, std::string>>> loadedRanks;
+
+        std::uint32_t Family(std::string_view name);
+    };
+
+    struct EnchantSimItem {
+        EnchantSimKind kind = EnchantSimKind::kArmor;
+        int level = 1;        // The item's distribution level
+        float rate = 1.0f;    // Item's enchantment rate, its set's times its own
+        float power = 1.0f;   // Same for enchantment power
+        int pool = -1;        // Index of its enchantment pool, -1 to spread the rolls evenly over all of them
+        int uniquePool = -1;  // Index of its unique pool, -1 for none
+        float uniquePoolChance = 0.5f;
+        int staffGroup = -1;  // Index of the staff enchantment group, for staves
+    };
+
+    struct EnchantSimulationParams {
+        std::uint64_t seed = 0;
+        std::uint32_t rolls = 1000000;  // Per level
+        std::vector<int> levels;        // Container levels
+        EnchantSimItem item;
+        float containerRate = 1.0f;
+        float containerPower = 1.0f;
+    };
+
+    struct EnchantSimulationResult {
+        static constexpr int kChargeBuckets = 10;
+
+        struct Level {
+            int level = 0;
+            std::uint64_t rolls = 0;
+            std::uint64_t enchanted = 0;
+            std::uint64_t topRank = 0;           // Got the strongest rank of their enchantment
+            std::vector<std::uint64_t> ranks;    // By rank, weakest first
+            std::vector<std::uint64_t> pools;    // By the pool the enchantment came from
+            std::vector<std::uint64_t> charges;  // Weapons by charge, in kChargeBuckets even steps from the minimum to the maximum
+            double chargeTotal = 0.0;
+            double remainingTotal = 0.0;  // Charge left after the random use, when that's on
+        };
+
+        std::vector<Level> levels;
+        std::uint64_t rolls = 0;
+        double seconds = 0.0;
+
+        double RollsPerSecond() const { return seconds > 0.0 ? rolls / seconds : 0.0; }
+    };
+
+    EnchantSimulationResult SimulateEnchantments(const EnchantSimModel& model, const EnchantSimulationParams& params);
+
+    void WriteEnchantSimulationReport(const EnchantSimModel& model, const EnchantSimulationParams& params, const EnchantSimulationResult& result, std::ostream& os);
+}
@@ -1,7 +1,15 @@
 #include "Enchantments.h"
 
+#include "AliasTable.h"
 #include "Config.h"
 #include "Data.h"
+#include "EnchantRankSort.h"
+#include "EnchantRolls.h"
+#include "FlatMap.h"
+#include "PublishedTable.h"
+#include "Random.h"
+
+#include <mutex>
 
 bool QuickArmorRebalance::IsEnchanted(RE::TESBoundObject* obj) {
     if (auto armor = obj->As<RE::TESObjectARMO>()) {
@@ -17,7 +25,22 @@ namespace {
     using namespace QuickArmorRebalance;
     using namespace rapidjson;
 
-    bool ShouldEnchant(RE::TESBoundObject* obj, const EnchantProbability* contParams, int level) {
+    EnchantRollSettings RollSettings() {
+        EnchantRollSettings settings;
+        settings.chanceBase = g_Config.enchChanceBase;
+        settings.chanceBonus = g_Config.enchChanceBonus;
+        settings.chanceBonusMax = g_Config.enchChanceBonusMax;
+        settings.rates = g_Config.fEnchantRates;
+        settings.levelMaxDist = g_Config.levelMaxDist;
+        settings.levelDelay = g_Config.levelEnchDelay;
+        settings.chargeMin = (float)g_Config.enchWeapChargeMin;
+        settings.chargeMax = (float)g_Config.enchWeapChargeMax;
+        settings.bAlwaysEnchantStaves = g_Config.bAlwaysEnchantStaves;
+        settings.bRandomCharge = g_Config.bEnchantRandomCharge;
+        return settings;
+    }
+
+    bool ShouldEnchant(const EnchantRollSettings& settings, RE::TESBoundObject* obj, const EnchantProbability* contParams, int level) {
         auto params = MapFind(g_Data.enchParams, obj);
         if (!params) {
             // logger::info("No ench params: {}", obj->GetName());
@@ -31,41 +54,200 @@ namespace {
             auto weapon = obj->As<RE::TESObjectWEAP>();
             if (weapon->formEnchanting) return false;
 
-            if (weapon->GetWeaponType() == RE::WEAPON_TYPE::kStaff && g_Config.bAlwaysEnchantStaves) return true;
+            if (weapon->GetWeaponType() == RE::WEAPON_TYPE::kStaff && settings.bAlwaysEnchantStaves) return true;
         } else {
             return false;
         }
 
-        float chance = g_Config.enchChanceBase + std::min(g_Config.enchChanceBonus * (level - params->level), g_Config.enchChanceBonusMax);
-        chance *= (0.01f * g_Config.fEnchantRates) * contParams->enchRate * params->base.enchRate * params->unique.enchRate;
-
-        return RNG_f() < chance;
+        return ThreadRandom().UniformF() < EnchantChance(settings, level, params->level, contParams->enchRate * params->base.enchRate * params->unique.enchRate);
     }
 
-    inline float PowerCalc(const ObjEnchantParams* params, const EnchantProbability* contParams, int level) {
-        return contParams->enchPower * params->base.enchPower * params->unique.enchPower * std::lerp((float)params->level, (float)level, RNG_f()) *
-               std::normal_distribution<float>(1.0f, 0.25f)(RNG);
+    RE::EnchantmentItem* PickEnchantStrength(const EnchantRollSettings& settings, RE::EnchantmentItem* ench, const EnchantmentRanks* ranks, const ObjEnchantParams* params,
+                                             const EnchantProbability* contParams, int level, int& charge, bool isStaff) {
+        if (!isStaff && (!ranks || ranks->ranks.empty())) return nullptr;
+
+        auto strength = RollEnchantStrength(settings, params->level, level, contParams->enchPower * params->base.enchPower * params->unique.enchPower,
+                                            isStaff ? nullptr : &ranks->thresholds, ThreadRandom());
+        charge = strength.charge;
+        return isStaff ? ench : ranks->ranks[strength.rank];
     }
 
-    RE::EnchantmentItem* PickEnchantStrength(RE::EnchantmentItem* ench, const ObjEnchantParams* params, const EnchantProbability* contParams, int level, int& charge,
-                                             bool isStaff) {
-        charge = (int)std::lerp(g_Config.enchWeapChargeMin, g_Config.enchWeapChargeMax, std::clamp(PowerCalc(params, contParams, level) / g_Config.levelMaxDist, 0.0f, 1.0f));
-        if (isStaff) return ench;
+    struct EnchantCandidate {
+        RE::EnchantmentItem* ench;
+        const EnchantmentRanks* ranks;  // Null for enchantments only listed for staves
+        float weight;
+        int levelMin;
+        int restriction;  // Index into the pool's worn restrictions, or -1 for none
+    };
+
+    struct EnchantTableKey {
+        std::uint32_t bucket = 0;
+        std::uint64_t restrictions = 0;  // Bit set for each worn restriction list the item has a keyword from
+
+        bool operator==(const EnchantTableKey&) const = default;
+    };
+
+    struct EnchantTableKeyHash {
+        std::uint64_t operator()(const EnchantTableKey& key) const { return MixHash(key.restrictions ^ MixHash(key.bucket)); }
+    };
+
+    // The enchantments from one pool that fit one kind of item, with a weighted table for each level bucket and set of worn restrictions.
+    // All tables are built up front for the sets of restrictions the loaded items have, and read without a lock after that. An item
+    // with some other set, which shouldn't happen, gets its tables built the first time they're needed
+    class EnchantSampler {
+    public:
+        static constexpr std::size_t kMaxRestrictions = 64;
+
+        EnchantSampler(const EnchantmentPool& pool, bool bArmor) {
+            for (auto& i : pool.enchs) {
+                auto e = i.first;
+                if (bArmor) {
+                    if (e->data.castingType != RE::MagicSystem::CastingType::kConstantEffect || e->data.delivery != RE::MagicSystem::Delivery::kSelf) continue;
+                } else {
+                    if (e->data.castingType != RE::MagicSystem::CastingType::kFireAndForget || e->data.delivery != RE::MagicSystem::Delivery::kTouch) continue;
+                }
+
+                auto ranks = MapFind(g_Config.mapEnchantments, e);
+
+                int restriction = -1;
+                if (bArmor && e->data.wornRestrictions) {
+                    auto it = std::find(restrictions.begin(), restrictions.end(), e->data.wornRestrictions);
+                    restriction = (int)(it - restrictions.begin());
+                    if (it == restrictions.end()) restrictions.push_back(e->data.wornRestrictions);
+                }
+
+                candidates.push_back({e, ranks, i.second, ranks ? ranks->levelMin : 1, restriction});
+                levels.push_back(candidates.back().levelMin);
+            }
+
+            if (restrictions.size() > kMaxRestrictions) {
+                logger::warn("Enchantment pool '{}' has more than {} different worn restrictions, the rest are never met", pool.name, kMaxRestrictions);
+                restrictions.resize(kMaxRestrictions);
+            }
+
+            std::sort(levels.begin(), levels.end());
+            levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+            if (restrictions.empty()) {
+                for (std::uint32_t i = 0; i < levels.size(); i++) tables[{i, 0}] = Build({i, 0});
+            }
+        }
+
+        // Builds the tables for every set of worn restrictions that one of the items meets. Before any Pick
+        template <class Items>
+        void Prepare(const Items& items) {
+            if (restrictions.empty()) return;
+
+            std::vector<std::uint64_t> masks;
+            for (auto item : items) {
+                if (item) masks.push_back(RestrictionsOf(item));
+            }
+            std::sort(masks.begin(), masks.end());
+            masks.erase(std::unique(masks.begin(), masks.end()), masks.end());
+
+            for (auto mask : masks) {
+                for (std::uint32_t i = 0; i < levels.size(); i++) tables[{i, mask}] = Build({i, mask});
+            }
+        }
+
+        RE::EnchantmentItem* Pick(RE::TESBoundObject* obj, int level, const EnchantmentRanks*& ranks) {
+            // Only changes where some enchantment's minimum level is reached, so levels in between share a table
+            auto it = std::upper_bound(levels.begin(), levels.end(), level);
+            if (it == levels.begin()) return nullptr;
+
+            EnchantTableKey key{(std::uint32_t)(it - levels.begin() - 1), RestrictionsOf(obj)};
+            if (auto table = tables.Find(key)) return Pick(*table, ranks);
+
+            std::scoped_lock guard(lock);
+            auto [table, bNew] = lateTables.TryEmplace(key);
+            if (bNew) {
+                logger::warn("'{}' has worn restriction keywords no item had when the enchantment tables were built", obj->GetName());
+                *table = Build(key);
+            }
+            return Pick(*table, ranks);
+        }
+
+    private:
+        using Table = AliasTable<std::uint32_t>;
+
+        RE::EnchantmentItem* Pick(const Table& table, const EnchantmentRanks*& ranks) const {
+            if (table.Empty()) return nullptr;
+
+            auto& candidate = candidates[table.Pick(ThreadRandom().Uniform())];
+            ranks = candidate.ranks;
+            return candidate.ench;
+        }
+
+        std::uint64_t RestrictionsOf(RE::TESBoundObject* obj) const {
+            std::uint64_t mask = 0;
+            for (std::size_t i = 0; i < restrictions.size(); i++) {
+                if (obj->HasKeywordInList(restrictions[i], false)) mask |= 1ull << i;
+            }
+            return mask;
+        }
+
+        Table Build(const EnchantTableKey& key) const {
+            std::vector<std::pair<std::uint32_t, double>> weighted;
+            for (std::uint32_t i = 0; i < candidates.size(); i++) {
+                auto& candidate = candidates[i];
+                if (candidate.levelMin > levels[key.bucket]) continue;
+                if (candidate.restriction >= 0 && !((std::size_t)candidate.restriction < kMaxRestrictions && (key.restrictions & (1ull << candidate.restriction)))) continue;
+
+                weighted.push_back({i, candidate.weight});
+            }
+            return Table(weighted);
+        }
+
+        std::vector<EnchantCandidate> candidates;
+        std::vector<RE::BGSListForm*> restrictions;
+        std::vector<int> levels;  // Distinct minimum levels, ascending
+
+        FlatMap<EnchantTableKey, Table, EnchantTableKeyHash> tables;  // Not changed once picking starts
 
-        const auto& ranks = g_Config.mapEnchantments[ench];
-        if (ranks.ranks.empty()) return nullptr;
-        if (ranks.ranks.size() == 1) return ranks.ranks.front();
+        std::mutex lock;
+        FlatMap<EnchantTableKey, Table, EnchantTableKeyHash> lateTables;
+    };
 
-        float power = PowerCalc(params, contParams, level);
+    struct PoolSamplers {
+        template <class Armors>
+        PoolSamplers(const EnchantmentPool& pool, const Armors& armors) : armor(pool, true), weapon(pool, false) {
+            armor.Prepare(armors);
+        }
+
+        EnchantSampler armor;
+        EnchantSampler weapon;
+    };
+
+    // Built by FinalizeEnchantmentConfig, once the pools are done changing
+    std::unordered_map<const EnchantmentPool*, std::unique_ptr<PoolSamplers>> g_EnchantSamplers;
+    // Staff tables by pool and staff group. The group's whole list is under a null pool, for when none of the pool is in the group
+    std::map<std::pair<const EnchantmentPool*, const WeightedEnchantments*>, AliasTable<RE::EnchantmentItem*>> g_StaffEnchantTables;
+
+    void BuildStaffEnchantTables(const WeightedEnchantments* group) {
+        auto Add = [&](const EnchantmentPool* pool) {
+            std::vector<std::pair<RE::EnchantmentItem*, double>> weighted;
+            if (pool) {
+                for (auto& i : pool->enchs) {
+                    auto f = MapFindOr(*group, i.first, 0.0f);
+                    if (f > 0.0f) weighted.emplace_back(i.first, f);
+                }
+            } else {
+                for (auto& i : *group) weighted.emplace_back(i.first, i.second);
+            }
+            g_StaffEnchantTables.try_emplace({pool, group}, weighted);
+        };
 
-        power = (power - ranks.levelMin) / (std::min(g_Config.levelMaxDist, ranks.levelMax) - ranks.levelMin);
-        if (power <= 0) return ranks.ranks.front();
-        if (power >= 1.0f) return ranks.ranks.back();
+        Add(nullptr);
+        for (auto& pool : g_Config.mapEnchPools) Add(&pool.second);
+    }
 
-        return ranks.ranks[(int)(power * (ranks.ranks.size() - 1))];  //-1 because max rank is handled at power>=1.0
+    const AliasTable<RE::EnchantmentItem*>* FindStaffEnchantTable(const EnchantmentPool* pool, const WeightedEnchantments* group) {
+        auto it = g_StaffEnchantTables.find({pool, group});
+        if (it == g_StaffEnchantTables.end() || it->second.Empty()) it = g_StaffEnchantTables.find({nullptr, group});
+        return it != g_StaffEnchantTables.end() && !it->second.Empty() ? &it->second : nullptr;
     }
 
-    RE::EnchantmentItem* PickEnchant(RE::TESBoundObject* obj, const EnchantProbability* contParams, int level, int& charge) {
+    RE::EnchantmentItem* PickEnchant(const EnchantRollSettings& settings, RE::TESBoundObject* obj, const EnchantProbability* contParams, int level, int& charge) {
         auto params = MapFind(g_Data.enchParams, obj);
         if (!params) {
             // logger::info("{}: No params found", obj->GetName());
@@ -78,28 +260,17 @@ namespace {
             return nullptr;
         }
 
-        if (params->unique.enchPool && RNG_f() <= params->uniquePoolChance) pool = params->unique.enchPool;
+        if (params->unique.enchPool && ThreadRandom().UniformF() <= params->uniquePoolChance) pool = params->unique.enchPool;
+
+        auto samplers = MapFind(g_EnchantSamplers, pool);
+        if (!samplers) return nullptr;
 
+        RE::EnchantmentItem* ench = nullptr;
+        const EnchantmentRanks* ranks = nullptr;
         bool isStaff = false;
-        std::vector<std::pair<RE::EnchantmentItem*, float>> mapWeights;
-        mapWeights.reserve(pool->enchs.size());
 
         if (obj->IsArmor()) {
-            for (auto& i : pool->enchs) {
-                auto& ranks = g_Config.mapEnchantments[i.first];
-                if (level < ranks.levelMin) continue;
-
-                auto e = i.first;
-                if (e->data.castingType != RE::MagicSystem::CastingType::kConstantEffect || e->data.delivery != RE::MagicSystem::Delivery::kSelf) {
-                    continue;
-                }
-
-                if (e->data.wornRestrictions) {
-                    if (!obj->HasKeywordInList(e->data.wornRestrictions, false)) continue;
-                }
-
-                mapWeights.emplace_back(i.first, i.second);
-            }
+            ench = (*samplers)->armor.Pick(obj, level, ranks);
         } else if (obj->IsWeapon()) {
             auto weap = obj->As<RE::TESObjectWEAP>();
             if (weap->GetWeaponType() == RE::WEAPON_TYPE::kStaff) {
@@ -107,115 +278,112 @@ namespace {
                 auto group = MapFindOrNull(g_Data.staffEnchGroup, weap);
                 if (!group) return nullptr;
 
-                for (auto& i : pool->enchs) {
-                    auto f = MapFindOr(*group, i.first, 0.0f);
-                    if (f > 0.0f) mapWeights.emplace_back(i.first, f);
-                }
-
-                if (mapWeights.empty()) {
-                    mapWeights.reserve(group->size());
-                    for (auto& i : *group) mapWeights.emplace_back(i.first, i.second);
-                }
+                if (auto table = FindStaffEnchantTable(pool, group)) ench = table->Pick(ThreadRandom().Uniform());
             } else {
-                for (auto& i : pool->enchs) {
-                    auto& ranks = g_Config.mapEnchantments[i.first];
-                    if (level < ranks.levelMin) continue;
-
-                    auto e = i.first;
-                    if (e->data.castingType != RE::MagicSystem::CastingType::kFireAndForget || e->data.delivery != RE::MagicSystem::Delivery::kTouch) {
-                        continue;
-                    }
-
-                    mapWeights.emplace_back(i.first, i.second);
-                }
+                ench = (*samplers)->weapon.Pick(obj, level, ranks);
             }
         }
 
-        if (mapWeights.empty()) {
+        if (!ench) {
             // logger::info("{}: No enchantments", obj->GetName());
             return nullptr;
         }
 
-        // logger::info("{}: Enchantments", obj->GetName());
-        // for (auto& i : mapWeights) logger::info("- {}", i.first->GetName());
-
-        float total = 0.0f;
-        for (auto& i : mapWeights) total += i.second;
+        return PickEnchantStrength(settings, ench, ranks, params, contParams, level, charge, isStaff);
+    }
 
-        auto pick = total * ((double)RNG() / (double)RNG.max());
-        for (auto& i : mapWeights) {
-            pick -= i.second;
-            if (pick <= 0) {
-                return PickEnchantStrength(i.first, params, contParams, level, charge, isStaff);
-            }
-        }
+    // Copy of g_Data's distContainers and distItems for the hooks. Loot rebuilt in game changes those on the main thread while containers
+    // are initialized on others, so the hooks only read tables that are swapped out whole
+    struct DistEnchantTable {
+        std::unordered_map<RE::TESContainer*, EnchantProbability> containers;
+        FlatSet<RE::FormID> items;
+    };
 
-        return nullptr;
-    }
+    PublishedTable<DistEnchantTable> g_DistEnchTable;
 
-    void AddEnchantments(RE::TESObjectREFR* a_this) {
+    void AddEnchantments(RE::TESObjectREFR* a_this, bool bReset) {
         if (!g_Config.bEnableEnchantmentDistrib) return;
 
         if (!a_this->GetBaseObject()) return;
         auto cont = a_this->GetBaseObject()->As<RE::TESObjectCONT>();
         if (!cont) return;
 
-        auto contEnchChance = MapFind(g_Data.distContainers, cont);
+        PublishedTable<DistEnchantTable>::Reader reader(g_DistEnchTable);
+        auto table = reader.Get();
+        if (!table) return;
+
+        auto contEnchChance = MapFind(table->containers, cont);
         if (!contEnchChance) return;
 
-        // logger::info("{} level={}", a_this->GetName(), a_this->GetCalcLevel(true));
+        // Walks the inventory changes directly instead of building the whole inventory with GetInventory. Only entries there have extra
+        // lists to enchant, and most containers have nothing distributed in them so they're done after one set lookup per entry
+        auto changes = a_this->GetInventoryChanges();
+        if (!changes || !changes->entryList) return;
+
+        int level = 0;
+        bool bLevel = false;
+        EnchantRollSettings settings;
+
+        Random random;
+        std::optional<RandomScope> scope;
 
-        int level = a_this->GetCalcLevel(true);
-        level -= g_Config.levelEnchDelay;
+        for (auto entry : *changes->entryList) {
+            if (!entry || !entry->object || !entry->extraLists) continue;
+            if (!table->items.Contains(entry->object->GetFormID())) continue;
 
-        for (auto& item : a_this->GetInventory()) {
-            auto useLevel = level;
-            if (item.first->IsWeapon() && item.first->As<RE::TESObjectWEAP>()->GetWeaponType() == RE::WEAPON_TYPE::kStaff) useLevel += g_Config.levelEnchDelay;
+            // logger::info("- Has: {} x{}", entry->object->GetName(), entry->countDelta);
 
+            if (!bLevel) {
+                // logger::info("{} level={}", a_this->GetName(), a_this->GetCalcLevel(true));
+                level = a_this->GetCalcLevel(true);
+                settings = RollSettings();
+                bLevel = true;
+
+                // Every roll for this container comes from a stream keyed on the reference, the game day and which hook ran, so with the
+                // seed from the log a reported roll can be replayed exactly
+                auto calendar = RE::Calendar::GetSingleton();
+                auto day = calendar ? (std::uint64_t)calendar->GetDaysPassed() : 0;
+                logger::trace("Enchantment rolls for {:08X} on day {} ({})", a_this->GetFormID(), day, bReset ? "reset" : "initialize");
+
+                random = StreamRandom(a_this->GetFormID(), day, bReset);
+                scope.emplace(random);
+            }
+
+            auto item = entry->object;
+            auto useLevel = EnchantRollLevel(settings, level, item->IsWeapon() && item->As<RE::TESObjectWEAP>()->GetWeaponType() == RE::WEAPON_TYPE::kStaff);
             if (useLevel < 1) continue;
 
-            if (g_Data.distItems.contains(item.first)) {
-                // logger::info("- Has: {} x{}", item.first->GetName(), item.second.first);
-
-                auto entry = item.second.second.get();
-                if (entry->extraLists) {
-                    if (true) {
-                        for (auto ls : *entry->extraLists) {
-                            if (!ls || ls->HasType(RE::ExtraEnchantment::EXTRADATATYPE)) continue;
-
-                            if (ShouldEnchant(entry->object, contEnchChance, useLevel)) {
-                                int charge = 0;
-                                auto ench = PickEnchant(entry->object, contEnchChance, useLevel, charge);
-
-                                if (ench) {
-                                    // logger::info("Adding {} to {}", ench->GetName(), item.first->GetName());
-
-                                    ls->Add(new RE::ExtraEnchantment(ench, item.first->IsWeapon() ? (uint16_t)charge : 0));
-                                    if (item.first->IsWeapon() && g_Config.bEnchantRandomCharge) {
-                                        if (!ls->HasType(RE::ExtraCharge::EXTRADATATYPE)) {
-                                            auto pExtra = new RE::ExtraCharge();
-                                            pExtra->charge = charge * std::powf(RNG_f(), 0.33f);
-                                            // logger::info("Charge = {} / {}", pExtra->charge, charge);
-                                            ls->Add(pExtra);
-                                        }
-                                    }
-                                }
-                            }
+            for (auto ls : *entry->extraLists) {
+                if (!ls || ls->HasType(RE::ExtraEnchantment::EXTRADATATYPE)) continue;
 
-                            /*
-                            logger::info("-- Extra list start");
-                            for (auto& extra : *ls) {
-                                if (extra.GetType() == RE::ExtraDataType::kLeveledItem) {
-                                    auto p = static_cast<RE::ExtraLeveledItem*>(&extra);
-                                    logger::info("---- Extra: {:#10x}", p->levItem);
-                                }
+                if (ShouldEnchant(settings, item, contEnchChance, useLevel)) {
+                    int charge = 0;
+                    auto ench = PickEnchant(settings, item, contEnchChance, useLevel, charge);
+
+                    if (ench) {
+                        // logger::info("Adding {} to {}", ench->GetName(), item->GetName());
+
+                        ls->Add(new RE::ExtraEnchantment(ench, item->IsWeapon() ? (uint16_t)charge : 0));
+                        if (item->IsWeapon() && settings.bRandomCharge) {
+                            if (!ls->HasType(RE::ExtraCharge::EXTRADATATYPE)) {
+                                auto pExtra = new RE::ExtraCharge();
+                                pExtra->charge = EnchantRemainingCharge(charge, ThreadRandom());
+                                // logger::info("Charge = {} / {}", pExtra->charge, charge);
+                                ls->Add(pExtra);
                             }
-                            */
                         }
                     }
-                } else {
-                    // logger::info("No extra list: {}", item.first->GetName());
                 }
+
+                /*
+                logger::info("-- Extra list start");
+                for (auto& extra : *ls) {
+                    if (extra.GetType() == RE::ExtraDataType::kLeveledItem) {
+                        auto p = static_cast<RE::ExtraLeveledItem*>(&extra);
+                        logger::info("---- Extra: {:#10x}", p->levItem);
+                    }
+                }
+                */
             }
         }
     }
@@ -234,7 +402,7 @@ namespace {
 
             func(a_this, a3);
 
-            AddEnchantments(a_this);
+            AddEnchantments(a_this, false);
         }
         static inline REL::Relocation<decltype(thunk)> func;
     };
@@ -249,7 +417,7 @@ namespace {
 
             func(a_this, a3);
 
-            AddEnchantments(a_this);
+            AddEnchantments(a_this, true);
         }
         static inline REL::Relocation<decltype(thunk)> func;
     };
@@ -428,24 +596,10 @@ void QuickArmorRebalance::LoadEnchantmentConfigs(std::filesystem::path path, rap
     }
 }
 
-float EnchCmp(RE::EnchantmentItem* a, RE::EnchantmentItem* b) {
-    for (auto effect : a->effects) {
-        bool bFound = false;
-        for (auto effect2 : b->effects) {
-            if (effect->baseEffect == effect2->baseEffect) {
-                float cmp = effect->effectItem.magnitude - effect2->effectItem.magnitude;
-                if (cmp != 0.0f) return cmp;
-                bFound = true;
-                break;
-            }
-        }
-
-        if (!bFound) return 1;
-    }
-    return 0.0f;
-}
-
 void QuickArmorRebalance::FinalizeEnchantmentConfig() {
+    g_EnchantSamplers.clear();
+    g_StaffEnchantTables.clear();
+
     // Delete empty leveled enchantments
     for (auto& pool : g_Config.mapEnchPools) {
         std::erase_if(pool.second.enchs, [](const auto& i) {
@@ -474,17 +628,12 @@ void QuickArmorRebalance::FinalizeEnchantmentConfig() {
 
     // Sort by power & remove any duplicates
     for (auto& i : g_Config.mapEnchantments) {
-        auto& ranks = i.second.ranks;
-        std::sort(ranks.begin(), ranks.end(), [](auto a, auto b) { return EnchCmp(a, b) < 0.0f; });
-
-        for (auto it = ranks.begin(); it != ranks.end(); it++) {
-            auto itNext = it + 1;
-            if (itNext != ranks.end()) {
-                if (!EnchCmp(*it, *itNext)) {
-                    ranks.erase(itNext);
-                }
+        SortEnchantRanks(i.second.ranks, [](RE::EnchantmentItem* ench, auto&& fn) {
+            for (auto effect : ench->effects) {
+                if (effect && effect->baseEffect) fn(effect->baseEffect->GetFormID(), effect->effectItem.magnitude);
             }
-        }
+        });
+        i.second.thresholds = EnchantRankThresholds(i.second.levelMin, i.second.levelMax, g_Config.levelMaxDist, i.second.ranks.size());
 
         /*
         logger::info("Ench pool: {}", i.first->fullName.c_str());
@@ -520,4 +669,14 @@ void QuickArmorRebalance::FinalizeEnchantmentConfig() {
             }
         }
     }
+
+    // Pick tables, now that the pools and ranks are final. Only armor has worn restrictions
+    auto& armors = RE::TESDataHandler::GetSingleton()->GetFormArray<RE::TESObjectARMO>();
+    for (auto& pool : g_Config.mapEnchPools) g_EnchantSamplers[&pool.second] = std::make_unique<PoolSamplers>(pool.second, armors);
+    for (auto& group : g_Config.mapStaffEnchPools) BuildStaffEnchantTables(&group.second);
+}
+
+void QuickArmorRebalance::UpdateDistEnchantmentTable() {
+    auto table = std::make_unique<DistEnchantTable>(DistEnchantTable{g_Data.distContainers, g_Data.distItems});
+    g_DistEnchTable.Publish(table->containers.empty() ? nullptr : std::move(table));
 }
@@ -7,4 +7,5 @@ namespace QuickArmorRebalance {
     bool IsEnchanted(RE::TESBoundObject* obj);
 
     void FinalizeEnchantmentConfig();
+    void UpdateDistEnchantmentTable();  // Call after distContainers or distItems change
 }
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Open addressing hash map
+
+    Linear probing over a single power of two sized array, meant for
+    lookup heavy tables keyed by pointers, form ids and other small
+    values. There is no erase, tables are built then queried
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    inline std::uint64_t MixHash(std::uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdull;
+        x ^= x >> 33;
+        x *= 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return x;
+    }
+
+    template <class Key>
+    struct FlatHash {
+        std::uint64_t operator()(const Key& key) const {
+            if constexpr (std::is_pointer_v<Key>)
+                return MixHash((std::uint64_t)(std::uintptr_t)key);
+            else if constexpr (std::is_integral_v<Key> || std::is_enum_v<Key>)
+                return MixHash((std::uint64_t)key);
+            else
+                return MixHash((std::uint64_t)std::hash<Key>{}(key));
+        }
+    };
+
+    template <class Key, class Value, class Hash = FlatHash<Key>>
+    class FlatMap {
+    public:
+        Value* Find(const Key& key) {
+            if (!count) return nullptr;
+            for (auto i = Hash{}(key) & mask;; i = (i + 1) & mask) {
+                auto& slot = slots[i];
+                if (!slot.used) return nullptr;
+                if (slot.key == key) return &slot.value;
+            }
+        }
+
+        const Value* Find(const Key& key) const { return const_cast<FlatMap*>(this)->Find(key); }
+        bool Contains(const Key& key) const { return Find(key) != nullptr; }
+
+        // Returns the value for key, default constructing it if it wasn't there
+        std::pair<Value*, bool> TryEmplace(const Key& key) {
+            if ((count + 1) * 2 > slots.size()) Rehash(std::max<std::size_t>(16, slots.size() * 2));
+
+            for (auto i = Hash{}(key) & mask;; i = (i + 1) & mask) {
+                auto& slot = slots[i];
+                if (!slot.used) {
+                    slot.used = true;
+                    slot.key = key;
+                    count++;
+                    return {&slot.value, true};
+                }
+                if (slot.key == key) return {&slot.value, false};
+            }
+        }
+
+        Value& operator[](const Key& key) { return *TryEmplace(key).first; }
+
+        void Reserve(std::size_t n) {
+            std::size_t size = 16;
+            while (size < n * 2) size *= 2;
+            if (size > slots.size()) Rehash(size);
+        }
+
+        void Clear() {
+            slots.clear();
+            count = 0;
+            mask = 0;
+        }
+
+        std::size_t Size() const { return count; }
+        bool Empty() const { return !count; }
+
+        template <class Fn>
+        void ForEach(Fn&& fn) const {
+            for (auto& slot : slots)
+                if (slot.used) fn(slot.key, slot.value);
+        }
+
+    private:
+        struct Slot {
+            Key key{};
+            Value value{};
+            bool used = false;
+        };
+
+        void Rehash(std::size_t size) {
+            std::vector<Slot> old(size);
+            std::swap(old, slots);
+            mask = size - 1;
+            count = 0;
+
+            for (auto& slot : old) {
+                if (slot.used) *TryEmplace(slot.key).first = std::move(slot.value);
+            }
+        }
+
+        std::vector<Slot> slots;
+        std::size_t count = 0;
+        std::size_t mask = 0;
+    };
+
+    // Set for lookups that mostly miss. A small bitmap over the key hashes turns most misses away with a single load before the table
+    // is probed at all
+    template <class Key, class Hash = FlatHash<Key>>
+    class FlatSet {
+    public:
+        void Insert(const Key& key) {
+            auto bit = Hash{}(key) >> (64 - kFilterBitsLog2);
+            filter[bit / 64] |= 1ull << (bit % 64);
+            keys[key] = true;
+        }
+
+        bool Contains(const Key& key) const {
+            auto bit = Hash{}(key) >> (64 - kFilterBitsLog2);
+            if (!(filter[bit / 64] & (1ull << (bit % 64)))) return false;
+            return keys.Contains(key);
+        }
+
+        std::size_t Size() const { return keys.Size(); }
+        bool Empty() const { return keys.Empty(); }
+
+    private:
+        static constexpr int kFilterBitsLog2 = 16;  // 8KB, so a few thousand keys still leave nearly all of it clear
+
+        std::vector<std::uint64_t> filter = std::vector<std::uint64_t>((1 << kFilterBitsLog2) / 64);
+        FlatMap<Key, bool, Hash> keys;
+    };
+}
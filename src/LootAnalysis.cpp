@@ -0,0 +1,182 @@
+#include "LootAnalysis.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+QuickArmorRebalance::LootExpectation::LootExpectation(const LootGraph& graph) : graph(graph), dense(graph.items.size(), 0.0) {
+    // Nodes only point at nodes before them, so one pass in order sees every child first
+    maxLevel.resize(graph.nodes.size(), 1);
+    std::vector<int> levels{1};
+    for (std::size_t i = 0; i < graph.nodes.size(); i++) {
+        for (auto& entry : graph.nodes[i].entries) {
+            maxLevel[i] = std::max(maxLevel[i], entry.level);
+            if (entry.ref.IsNode()) maxLevel[i] = std::max(maxLevel[i], maxLevel[entry.ref.index]);
+            levels.push_back(entry.level);
+        }
+    }
+
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+    for (auto level : levels) {
+        if (level >= 1) breakpoints.push_back(level);
+    }
+
+    targetAttachments.resize(graph.targets.size());
+    for (std::uint32_t i = 0; i < graph.attachments.size(); i++) targetAttachments[graph.attachments[i].target].push_back(i);
+}
+
+const QuickArmorRebalance::LootCounts& QuickArmorRebalance::LootExpectation::Expected(std::uint32_t node, int level) {
+    level = std::clamp(level, 0, (int)maxLevel[node]);  // Past the highest level below this list, every level gives the same result
+
+    auto key = ((std::uint64_t)node << 16) | (std::uint16_t)level;
+    if (auto it = memo.find(key); it != memo.end()) return it->second;
+
+    auto& list = graph.nodes[node];
+    auto& entries = list.entries;
+
+    // Entries are in level order, same as the game keeps them
+    std::size_t lower = 0, upper = 0;
+    while (upper < entries.size() && level >= entries[upper].level) upper++;
+
+    Weighted refs;
+    if (upper) {
+        auto chance = (100 - std::min<int>(list.chanceNone, 100)) / 100.0;
+
+        if (list.flags & LootGraph::kUseAll) {
+            for (std::size_t i = 0; i < upper; i++) refs.push_back({entries[i].ref, chance * entries[i].count});
+        } else {
+            if (!(list.flags & LootGraph::kCalculateFromAllLevelsLTOrEqPCLevel)) {
+                lower = upper - 1;
+                while (lower > 0 && entries[lower - 1].level == entries[upper - 1].level) lower--;
+            }
+
+            // Each item in count being rolled separately or not only changes the spread, not the expected count
+            auto pick = chance / (upper - lower);
+            for (auto i = lower; i < upper; i++) refs.push_back({entries[i].ref, pick * entries[i].count});
+        }
+    }
+
+    auto counts = Sum(refs, level);
+    return memo.emplace(key, std::move(counts)).first->second;
+}
+
+QuickArmorRebalance::LootCounts QuickArmorRebalance::LootExpectation::ExpectedForTarget(std::uint32_t target, int level) {
+    Weighted refs;
+    for (auto i : targetAttachments[target]) refs.push_back({graph.attachments[i].ref, (double)graph.attachments[i].count});
+    return Sum(refs, level);
+}
+
+QuickArmorRebalance::LootCounts QuickArmorRebalance::LootExpectation::Sum(const Weighted& refs, int level) {
+    // Work out every sublist before touching the scratch, since that recurses back through here
+    std::vector<const LootCounts*> lists(refs.size(), nullptr);
+    for (std::size_t i = 0; i < refs.size(); i++) {
+        if (refs[i].first.IsNode()) lists[i] = &Expected(refs[i].first.index, level);
+    }
+
+    auto Add = [&](std::uint32_t item, double n) {
+        if (n <= 0.0) return;
+        if (dense[item] == 0.0) touched.push_back(item);
+        dense[item] += n;
+    };
+
+    for (std::size_t i = 0; i < refs.size(); i++) {
+        auto [ref, weight] = refs[i];
+        if (ref.IsItem())
+            Add(ref.index, weight);
+        else if (lists[i]) {
+            for (auto& count : *lists[i]) Add(count.first, weight * count.second);
+        }
+    }
+
+    std::sort(touched.begin(), touched.end());
+
+    LootCounts ret;
+    ret.reserve(touched.size());
+    for (auto item : touched) {
+        ret.push_back({item, dense[item]});
+        dense[item] = 0.0;
+    }
+    touched.clear();
+
+    return ret;
+}
+
+namespace {
+    using namespace QuickArmorRebalance;
+
+    void WriteCSVString(std::ostream& os, const std::string& str) {
+        os << '"';
+        for (auto c : str) {
+            if (c == '"') os << '"';
+            os << c;
+        }
+        os << '"';
+    }
+
+    void WriteFormID(std::ostream& os, std::uint32_t id) {
+        auto flags = os.flags();
+        os << "0x" << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << id;
+        os.flags(flags);
+    }
+}
+
+void QuickArmorRebalance::WriteLootTablesCSV(LootExpectation& expectation, std::ostream& os) {
+    auto& graph = expectation.Graph();
+
+    os << "target_id,target,level,item_id,item,expected\n";
+    os << std::setprecision(9);
+
+    for (std::uint32_t i = 0; i < graph.targets.size(); i++) {
+        auto& target = graph.targets[i];
+        for (auto level : expectation.Breakpoints()) {
+            for (auto& count : expectation.ExpectedForTarget(i, level)) {
+                auto& item = graph.items[count.first];
+
+                WriteFormID(os, target.id);
+                os << ',';
+                WriteCSVString(os, target.name);
+                os << ',' << level << ',';
+                WriteFormID(os, item.id);
+                os << ',';
+                WriteCSVString(os, item.name);
+                os << ',' << count.second << '\n';
+            }
+        }
+    }
+}
+
+void QuickArmorRebalance::WriteLootTablesJSON(LootExpectation& expectation, std::ostream& os) {
+    auto& graph = expectation.Graph();
+
+    os << std::setprecision(9);
+    os << "{\n\"levels\": [";
+    for (std::size_t i = 0; i < expectation.Breakpoints().size(); i++) os << (i ? ", " : "") << expectation.Breakpoints()[i];
+
+    os << "],\n\"items\": [";
+    for (std::size_t i = 0; i < graph.items.size(); i++) {
+        os << (i ? ",\n" : "\n") << "{\"id\": " << graph.items[i].id << ", \"name\": ";
+        WriteJSONString(os, graph.items[i].name);
+        os << '}';
+    }
+
+    // Items are referred to by their index in the list above
+    os << "\n],\n\"targets\": [";
+    for (std::uint32_t i = 0; i < graph.targets.size(); i++) {
+        os << (i ? ",\n" : "\n") << "{\"id\": " << graph.targets[i].id << ", \"name\": ";
+        WriteJSONString(os, graph.targets[i].name);
+        os << ", \"levels\": [";
+
+        bool bFirst = true;
+        for (auto level : expectation.Breakpoints()) {
+            os << (bFirst ? "\n" : ",\n") << "{\"level\": " << level << ", \"expected\": [";
+            bFirst = false;
+
+            auto counts = expectation.ExpectedForTarget(i, level);
+            for (std::size_t j = 0; j < counts.size(); j++) os << (j ? ", " : "") << '[' << counts[j].first << ", " << counts[j].second << ']';
+            os << "]}";
+        }
+        os << "]}";
+    }
+    os << "\n]\n}\n";
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LootGraph.h"
+
+/*////////////////////////////////////////////////////////////////////
+    Loot analysis
+
+    Exact expected item counts for a loot graph, following the same
+    rules the game uses to resolve leveled lists: chance none, use all,
+    the player level thresholds and whether all lower levels are used.
+    Results are memoized per list and level, and a list's level is
+    capped at the highest entry level below it since nothing changes
+    past that, so shared sublists are only ever worked out a handful of
+    times. Only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    // Expected count of each item, by item index in ascending order
+    using LootCounts = std::vector<std::pair<std::uint32_t, double>>;
+
+    class LootExpectation {
+    public:
+        explicit LootExpectation(const LootGraph& graph);
+
+        // Expected items from a single roll of the list by a player of the given level
+        const LootCounts& Expected(std::uint32_t node, int level);
+
+        // Expected items added to a target by everything attached to it
+        LootCounts ExpectedForTarget(std::uint32_t target, int level);
+
+        // Levels where some list's result changes, each result holds until the next level listed
+        const std::vector<int>& Breakpoints() const { return breakpoints; }
+
+        const LootGraph& Graph() const { return graph; }
+
+    private:
+        using Weighted = std::vector<std::pair<LootRef, double>>;
+
+        // Sums the weighted items and lists, computing any lists that aren't known yet first
+        LootCounts Sum(const Weighted& refs, int level);
+
+        const LootGraph& graph;
+        std::vector<std::uint16_t> maxLevel;  // Highest entry level anywhere under each node
+        std::vector<int> breakpoints;
+        std::vector<std::vector<std::uint32_t>> targetAttachments;
+        std::unordered_map<std::uint64_t, LootCounts> memo;
+
+        // Scratch for summing
+        std::vector<double> dense;
+        std::vector<std::uint32_t> touched;
+    };
+
+    // One row per target, breakpoint level and item with a non zero expected count
+    void WriteLootTablesCSV(LootExpectation& expectation, std::ostream& os);
+    void WriteLootTablesJSON(LootExpectation& expectation, std::ostream& os);
+}
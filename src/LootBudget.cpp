@@ -0,0 +1,206 @@
+#include "LootBudget.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+
+namespace {
+    using namespace QuickArmorRebalance;
+
+    constexpr std::uint64_t kMaxFoldWeight = 1ull << 32;  // Keeps the multiplied weights well clear of overflowing
+
+    LootCost NodeCost(const LootNode& node, const std::vector<LootCost>& costs) {
+        LootCost ret;
+        for (auto& entry : node.entries) {
+            if (!entry.ref.IsNode()) continue;
+
+            auto& child = costs[entry.ref.index];
+            ret.depth = std::max(ret.depth, child.depth);
+            ret.entries = std::max(ret.entries, child.entries);
+        }
+
+        ret.depth++;
+        ret.entries += (std::uint32_t)node.entries.size();
+        return ret;
+    }
+
+    LootCost RefCost(LootRef ref, const std::vector<LootCost>& costs) { return ref.IsNode() ? costs[ref.index] : LootCost{}; }
+
+    // Picks one entry, and every entry is always in range with a count of one, so each entry is a plain share of the odds
+    bool IsPlainPick(const LootNode& node) {
+        if (node.flags & LootGraph::kUseAll) return false;
+        return std::all_of(node.entries.begin(), node.entries.end(), [](const LootEntry& entry) { return entry.level == 1 && entry.count == 1; });
+    }
+
+    bool FitsOneList(const LootGraph::Weights& weights) {
+        std::map<LootRef, std::uint64_t> combined;
+        for (auto& i : weights) combined[i.first] += i.second;
+
+        std::uint64_t divisor = 0, total = 0;
+        for (auto& i : combined) divisor = std::gcd(divisor, i.second);
+        for (auto& i : combined) total += i.second / divisor;
+
+        return total <= LootGraph::kMaxEntries;
+    }
+
+    class Flattener {
+    public:
+        Flattener(LootGraph& graph, const LootBudget& budget) : graph(graph), budget(budget), costs(ComputeLootCosts(graph)) {}
+
+        bool OverDepth(const LootCost& cost) const { return budget.maxDepth && cost.depth > budget.maxDepth; }
+        bool OverEntries(const LootCost& cost) const { return budget.maxRollEntries && cost.entries > budget.maxRollEntries; }
+        bool Over(const LootCost& cost) const { return OverDepth(cost) || OverEntries(cost); }
+
+        LootRef Flatten(std::uint32_t index, std::uint32_t& nFlattened) {
+            auto ref = LootRef::Node(index);
+
+            while (ref.IsNode() && Over(costs[ref.index])) {
+                auto folded = Fold(ref.index);
+                if (!folded) break;
+
+                auto cost = costs[ref.index];
+                auto foldedCost = RefCost(folded, costs);
+                bool bBetter = (OverDepth(cost) && foldedCost.depth < cost.depth) ||
+                               (OverEntries(cost) && foldedCost.entries < cost.entries && foldedCost.depth <= cost.depth);
+                if (!bBetter) break;
+
+                ref = folded;
+                nFlattened++;
+            }
+
+            return ref;
+        }
+
+        // Keeps the costs in step with any nodes added since
+        void Update() {
+            for (auto i = costs.size(); i < graph.nodes.size(); i++) costs.push_back(NodeCost(graph.nodes[i], costs));
+        }
+
+        LootGraph& graph;
+        const LootBudget& budget;
+        std::vector<LootCost> costs;
+
+    private:
+        // Rebuilds the node with the sublists that put it over budget weighted in, or returns nothing if that can't be done exactly in one list
+        LootRef Fold(std::uint32_t index) {
+            auto node = graph.nodes[index];  // Copied since adding nodes can move it
+            if (!IsPlainPick(node)) return {};
+
+            auto entries = (std::uint32_t)node.entries.size();
+
+            std::vector<bool> fold(node.entries.size());
+            std::uint64_t multiple = 1;
+            bool bAny = false;
+            for (std::size_t i = 0; i < node.entries.size(); i++) {
+                auto ref = node.entries[i].ref;
+                if (!ref.IsNode()) continue;
+
+                auto& cost = costs[ref.index];
+                if (!(budget.maxDepth && cost.depth + 1 > budget.maxDepth) && !(budget.maxRollEntries && entries + cost.entries > budget.maxRollEntries)) continue;
+
+                auto& child = graph.nodes[ref.index];
+                if (child.chanceNone || !IsPlainPick(child)) return {};
+                // A count passed down to a list that rolls each one separately would otherwise become copies of a single roll
+                if (!(node.flags & LootGraph::kCalculateForEachItemInCount) && (child.flags & LootGraph::kCalculateForEachItemInCount)) return {};
+
+                if (!child.entries.empty()) multiple = std::lcm(multiple, (std::uint64_t)child.entries.size());
+                if (multiple > kMaxFoldWeight) return {};
+
+                fold[i] = bAny = true;
+            }
+            if (!bAny) return {};
+
+            LootGraph::Weights weights;
+            for (std::size_t i = 0; i < node.entries.size(); i++) {
+                auto ref = node.entries[i].ref;
+                if (!fold[i]) {
+                    weights.push_back({ref, multiple});
+                    continue;
+                }
+
+                auto& child = graph.nodes[ref.index];
+                if (child.entries.empty()) {
+                    weights.push_back({{}, multiple});  // Rolls nothing either way
+                    continue;
+                }
+
+                auto share = multiple / child.entries.size();
+                for (auto& entry : child.entries) weights.push_back({entry.ref, share});
+            }
+
+            if (!FitsOneList(weights)) return {};
+
+            auto ret = graph.AddWeightedNode(node.purpose, node.flags, std::move(weights), 0.0, node.chanceNone);
+            Update();
+            return ret;
+        }
+    };
+}
+
+std::vector<QuickArmorRebalance::LootCost> QuickArmorRebalance::ComputeLootCosts(const LootGraph& graph) {
+    // Nodes only point at nodes before them, so one pass in order sees every child first
+    std::vector<LootCost> costs;
+    costs.reserve(graph.nodes.size());
+    for (auto& node : graph.nodes) costs.push_back(NodeCost(node, costs));
+    return costs;
+}
+
+std::vector<std::pair<std::string, QuickArmorRebalance::LootCost>> QuickArmorRebalance::LootGroupCosts(const LootGraph& graph) {
+    auto costs = ComputeLootCosts(graph);
+
+    std::vector<std::pair<std::string, LootCost>> ret;
+    for (auto& root : graph.roots) {
+        auto& group = root.group.empty() ? root.name : root.group;
+        auto it = std::find_if(ret.begin(), ret.end(), [&](const auto& i) { return i.first == group; });
+        if (it == ret.end()) it = ret.insert(ret.end(), {group, {}});
+
+        auto cost = RefCost(root.ref, costs);
+        it->second.depth = std::max(it->second.depth, cost.depth);
+        it->second.entries = std::max(it->second.entries, cost.entries);
+    }
+    return ret;
+}
+
+QuickArmorRebalance::LootFlattenResult QuickArmorRebalance::FlattenLootGraph(LootGraph& graph, const LootBudget& budget) {
+    LootFlattenResult result;
+    if (!budget.maxDepth && !budget.maxRollEntries) return result;
+
+    Flattener flattener(graph, budget);
+
+    // Bottom up, so a list's sublists are already within budget where they can be by the time it's looked at
+    auto nOriginal = (std::uint32_t)graph.nodes.size();
+    std::vector<LootRef> nodeMap(nOriginal);
+    auto remap = [&](LootRef ref) { return ref.IsNode() && ref.index < nOriginal ? nodeMap[ref.index] : ref; };
+
+    for (std::uint32_t i = 0; i < nOriginal; i++) {
+        auto node = graph.nodes[i];
+
+        bool bChanged = false;
+        for (auto& entry : node.entries) {
+            auto ref = remap(entry.ref);
+            bChanged |= ref != entry.ref;
+            entry.ref = ref;
+        }
+
+        auto index = i;
+        if (bChanged) {
+            auto ref = graph.AddNode(std::move(node));
+            flattener.Update();
+            index = ref.index;
+        }
+
+        nodeMap[i] = flattener.Flatten(index, result.flattened);
+    }
+
+    for (auto& attachment : graph.attachments) attachment.ref = remap(attachment.ref);
+    for (auto& root : graph.roots) root.ref = remap(root.ref);
+
+    graph.Prune();
+
+    auto costs = ComputeLootCosts(graph);
+    for (auto& root : graph.roots) {
+        if (flattener.Over(RefCost(root.ref, costs))) result.overBudget++;
+    }
+
+    return result;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "LootGraph.h"
+
+/*////////////////////////////////////////////////////////////////////
+    Loot resolution budget
+
+    Every nested list is another form the game has to look up and roll
+    each time a container is filled, so deep chains of selection lists
+    cost more per roll than their list count suggests. This tracks how
+    deep a roll can go and how many entries it can scan on the way, and
+    folds sublists into their parents where that keeps the odds exact,
+    until everything fits the budget or nothing more can be folded.
+    Only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    // Zero for no limit
+    struct LootBudget {
+        int maxDepth = 0;                  // Nested lists one roll can go through
+        std::uint32_t maxRollEntries = 0;  // Entries one roll can scan along its longest path
+    };
+
+    struct LootCost {
+        int depth = 0;
+        std::uint32_t entries = 0;
+    };
+
+    // Worst case cost of rolling each node, by node index
+    std::vector<LootCost> ComputeLootCosts(const LootGraph& graph);
+
+    // Worst cost of any root in each container group, in order of first appearance
+    std::vector<std::pair<std::string, LootCost>> LootGroupCosts(const LootGraph& graph);
+
+    struct LootFlattenResult {
+        std::uint32_t flattened = 0;   // Lists that had sublists folded into them
+        std::uint32_t overBudget = 0;  // Roots still over budget afterwards
+    };
+
+    // Rebuilds lists that go over budget with their sublists' entries weighted in directly, then prunes the lists nothing uses anymore.
+    // Only folds sublists whose odds can be carried over exactly into a single list
+    LootFlattenResult FlattenLootGraph(LootGraph& graph, const LootBudget& budget);
+}
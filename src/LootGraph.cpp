@@ -0,0 +1,455 @@
+#include "LootGraph.h"
+
+#include "FlatMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <ostream>
+
+namespace {
+    std::uint64_t HashNode(const QuickArmorRebalance::LootNode& node) {
+        using QuickArmorRebalance::MixHash;
+
+        auto hash = MixHash(((std::uint64_t)node.flags << 8) | node.chanceNone);
+        for (auto& entry : node.entries) {
+            hash = MixHash(hash ^ (((std::uint64_t)entry.ref.kind << 32) | entry.ref.index));
+            hash = MixHash(hash ^ (((std::uint64_t)entry.level << 16) | entry.count));
+        }
+        return hash;
+    }
+
+    constexpr int kMaxWeightDepth = 3;  // Extra levels of remainder lists to try before settling for rounded odds
+
+    struct Rounding {
+        std::vector<std::uint64_t> slots;
+        std::uint64_t total = 0;
+        double error = 1.0;  // Total variation distance from the exact odds
+    };
+
+    // Rounds the weights to about nSlots entries, never dropping a ref entirely
+    Rounding RoundWeights(const QuickArmorRebalance::LootGraph::Weights& weights, std::uint64_t total, std::uint64_t nSlots) {
+        Rounding ret;
+        ret.slots.reserve(weights.size());
+        for (auto& i : weights) {
+            auto n = std::max<std::uint64_t>(1, (std::uint64_t)std::llround((double)i.second * nSlots / total));
+            ret.slots.push_back(n);
+            ret.total += n;
+        }
+
+        // Checked exactly first so floating point noise is never reported as an approximation
+        bool bExact = true;
+        for (std::size_t i = 0; i < weights.size() && bExact; i++) bExact = ret.slots[i] * total == weights[i].second * ret.total;
+
+        ret.error = 0.0;
+        if (!bExact) {
+            for (std::size_t i = 0; i < weights.size(); i++) ret.error += std::abs((double)ret.slots[i] / ret.total - (double)weights[i].second / total);
+            ret.error *= 0.5;
+        }
+        return ret;
+    }
+}
+
+QuickArmorRebalance::LootRef QuickArmorRebalance::LootGraph::AddItem(void* form, std::uint32_t id, const char* name) {
+    auto [it, bNew] = itemIndex.try_emplace(form, (std::uint32_t)items.size());
+    if (bNew) items.push_back({form, id, name ? name : ""});
+    return LootRef::Item(it->second);
+}
+
+QuickArmorRebalance::LootRef QuickArmorRebalance::LootGraph::FindItem(const void* form) const {
+    auto it = itemIndex.find(form);
+    return it != itemIndex.end() ? LootRef::Item(it->second) : LootRef{};
+}
+
+QuickArmorRebalance::LootRef QuickArmorRebalance::LootGraph::FindNode(const LootNode& node) const {
+    // Entries only ever point at items and nodes that were already interned, so comparing them directly is enough to share whole sub-graphs
+    auto range = nodeIndex.equal_range(HashNode(node));
+    for (auto it = range.first; it != range.second; ++it) {
+        auto& prev = nodes[it->second];
+        if (prev.flags == node.flags && prev.chanceNone == node.chanceNone && prev.entries == node.entries) return LootRef::Node(it->second);
+    }
+    return {};
+}
+
+QuickArmorRebalance::LootRef QuickArmorRebalance::LootGraph::AddNode(LootNode node) {
+    if (auto prev = FindNode(node)) {
+        deduplicated[node.purpose]++;
+        return prev;
+    }
+
+    auto hash = HashNode(node);
+    auto index = (std::uint32_t)nodes.size();
+    nodeIndex.emplace(hash, index);
+    nodes.push_back(std::move(node));
+    return LootRef::Node(index);
+}
+
+QuickArmorRebalance::LootRef QuickArmorRebalance::LootGraph::AddWeightedNode(const char* purpose, std::uint8_t flags, Weights weights, double tolerance,
+                                                                              std::uint8_t chanceNone) {
+    double error = 0.0;
+    auto ref = EncodeWeights(purpose, flags, std::move(weights), tolerance, chanceNone, kMaxWeightDepth, error);
+
+    if (error > 0.0) {
+        approximated++;
+        maxApproximationError = std::max(maxApproximationError, error);
+    }
+
+    return ref;
+}
+
+QuickArmorRebalance::LootRef QuickArmorRebalance::LootGraph::EncodeWeights(const char* purpose, std::uint8_t flags, Weights weights, double tolerance, std::uint8_t chanceNone,
+                                                                            int depth, double& error) {
+    // Every entry of a use-all list drops, so its weights are how many of each there are rather than odds. They go in as given, without
+    // folding repeats, dividing or rounding
+    if (flags & kUseAll) {
+        std::vector<LootEntry> entries;
+        for (auto& i : weights) entries.insert(entries.end(), i.second, LootEntry{i.first});
+
+        if (entries.empty()) return {};
+        if (entries.size() == 1 && !chanceNone) return entries[0].ref;
+
+        // More than fit in one list go into use-all lists of their own, which still give every entry
+        while (entries.size() > kMaxEntries) {
+            std::vector<LootEntry> lists;
+            for (std::size_t front = 0; front < entries.size(); front += kMaxEntries) {
+                auto back = std::min(entries.size(), front + kMaxEntries);
+                if (back - front == 1)
+                    lists.push_back(entries[front]);
+                else
+                    lists.push_back(LootEntry{AddNode(LootNode{purpose, flags, 0, std::vector<LootEntry>(entries.begin() + front, entries.begin() + back)})});
+            }
+            entries = std::move(lists);
+        }
+
+        return AddNode(LootNode{purpose, flags, chanceNone, std::move(entries)});
+    }
+
+    // Repeats of the same ref are just more weight, keep the first one's place
+    Weights combined;
+    std::unordered_map<std::uint64_t, std::size_t> index;
+    for (auto& i : weights) {
+        if (!i.second) continue;
+
+        auto [it, bNew] = index.try_emplace(((std::uint64_t)i.first.kind << 32) | i.first.index, combined.size());
+        if (bNew)
+            combined.push_back(i);
+        else
+            combined[it->second].second += i.second;
+    }
+    weights = std::move(combined);
+
+    if (weights.empty()) return {};
+    if (weights.size() == 1 && !chanceNone) return weights[0].first;
+
+    std::uint64_t divisor = 0;
+    for (auto& i : weights) divisor = std::gcd(divisor, i.second);
+
+    std::uint64_t total = 0;
+    for (auto& i : weights) total += (i.second /= divisor);
+
+    auto AddRepeated = [&](const std::vector<std::uint64_t>& slots, std::uint8_t chance) {
+        LootNode node{purpose, flags, chance, {}};
+        for (std::size_t i = 0; i < weights.size(); i++) node.entries.insert(node.entries.end(), slots[i], LootEntry{weights[i].first});
+        return AddNode(std::move(node));
+    };
+
+    std::vector<std::uint64_t> slots(weights.size());
+
+    // Exact odds fit in one list
+    if (total <= kMaxEntries) {
+        for (std::size_t i = 0; i < weights.size(); i++) slots[i] = weights[i].second;
+        return AddRepeated(slots, chanceNone);
+    }
+
+    // Too many refs to give each their own entry, split them into even chunks under a list weighted by each chunk's total
+    if (weights.size() >= kMaxEntries) {
+        auto nChunks = (weights.size() + kMaxEntries - 2) / (kMaxEntries - 1);
+
+        Weights chunks;
+        auto front = weights.begin();
+        for (std::size_t i = 0; i < nChunks; i++) {
+            auto back = front + (weights.end() - front) / (nChunks - i);
+
+            std::uint64_t chunkTotal = 0;
+            for (auto it = front; it != back; ++it) chunkTotal += it->second;
+
+            double chunkError = 0.0;
+            chunks.push_back({EncodeWeights(purpose, flags, Weights(front, back), tolerance, 0, depth, chunkError), chunkTotal});
+            error += chunkError * chunkTotal / total;
+
+            front = back;
+        }
+
+        double topError = 0.0;
+        auto ret = EncodeWeights(purpose, flags, std::move(chunks), tolerance, chanceNone, depth, topError);
+        error += topError;
+        return ret;
+    }
+
+    // Smallest rounding that stays within tolerance, one entry each is always possible here
+    auto best = RoundWeights(weights, total, 0);
+    for (auto nSlots = weights.size(); nSlots <= kMaxEntries; nSlots++) {
+        auto rounding = RoundWeights(weights, total, nSlots);
+        if (rounding.total > kMaxEntries) break;
+        if (rounding.error < best.error) best = std::move(rounding);
+        if (best.error <= tolerance) break;
+    }
+
+    if (best.error <= tolerance || !depth) {
+        error += best.error;
+        return AddRepeated(best.slots, chanceNone);
+    }
+
+    // Otherwise give each ref its whole number of entries out of the maximum, and send the leftover entries to a list of the remainders.
+    // That's exact as long as the remainder list is, and any error it has is scaled down by how few entries it gets
+    LootNode node{purpose, flags, chanceNone, {}};
+
+    Weights remainders;
+    std::uint64_t nWhole = 0;
+    for (std::size_t i = 0; i < weights.size(); i++) {
+        auto scaled = weights[i].second * kMaxEntries;
+        slots[i] = scaled / total;
+        nWhole += slots[i];
+        remainders.push_back({weights[i].first, scaled % total});
+    }
+
+    for (std::size_t i = 0; i < weights.size(); i++) node.entries.insert(node.entries.end(), slots[i], LootEntry{weights[i].first});
+
+    if (auto nLeft = kMaxEntries - nWhole) {
+        double subError = 0.0;
+        auto sub = EncodeWeights(purpose, flags, std::move(remainders), tolerance, 0, depth - 1, subError);
+        node.entries.insert(node.entries.end(), nLeft, LootEntry{sub});
+        error += subError * nLeft / kMaxEntries;
+    }
+
+    return AddNode(std::move(node));
+}
+
+std::uint32_t QuickArmorRebalance::LootGraph::AddTarget(void* form, std::uint32_t id, const char* name, bool bList) {
+    auto [it, bNew] = targetIndex.try_emplace(form, (std::uint32_t)targets.size());
+    if (bNew) targets.push_back({form, id, name ? name : "", bList});
+    return it->second;
+}
+
+void QuickArmorRebalance::LootGraph::Append(LootGraph&& other) {
+    std::vector<std::uint32_t> itemMap(other.items.size());
+    for (std::size_t i = 0; i < other.items.size(); i++) {
+        auto& item = other.items[i];
+        itemMap[i] = AddItem(item.form, item.id, item.name.c_str()).index;
+    }
+
+    std::vector<std::uint32_t> targetMap(other.targets.size());
+    for (std::size_t i = 0; i < other.targets.size(); i++) {
+        auto& target = other.targets[i];
+        targetMap[i] = AddTarget(target.form, target.id, target.name.c_str(), target.bList);
+    }
+
+    // Nodes only point at nodes added before them, so they can be remapped and interned in order
+    std::vector<std::uint32_t> nodeMap(other.nodes.size());
+    auto remap = [&](LootRef ref) {
+        if (ref.IsItem()) return LootRef::Item(itemMap[ref.index]);
+        if (ref.IsNode()) return LootRef::Node(nodeMap[ref.index]);
+        return ref;
+    };
+
+    nodes.reserve(nodes.size() + other.nodes.size());
+    for (std::size_t i = 0; i < other.nodes.size(); i++) {
+        auto& node = other.nodes[i];
+        for (auto& entry : node.entries) entry.ref = remap(entry.ref);
+        nodeMap[i] = AddNode(std::move(node)).index;
+    }
+
+    for (auto& i : other.deduplicated) deduplicated[i.first] += i.second;
+    approximated += other.approximated;
+    maxApproximationError = std::max(maxApproximationError, other.maxApproximationError);
+
+    attachments.reserve(attachments.size() + other.attachments.size());
+    for (auto& attachment : other.attachments) {
+        attachment.target = targetMap[attachment.target];
+        if (attachment.enchFrom != LootAttachment::kOwnEnch) attachment.enchFrom = targetMap[attachment.enchFrom];
+        attachment.ref = remap(attachment.ref);
+        attachments.push_back(attachment);
+    }
+
+    for (auto& root : other.roots) roots.push_back({std::move(root.name), remap(root.ref), std::move(root.group)});
+
+    other = LootGraph();
+}
+
+QuickArmorRebalance::LootRef QuickArmorRebalance::LootGraph::Import(const LootGraph& other, LootRef ref, std::vector<LootRef>& remap) {
+    auto Copy = [&](LootRef ref) {
+        if (ref.IsItem()) {
+            auto& item = other.items[ref.index];
+            return AddItem(item.form, item.id, item.name.c_str());
+        }
+        return ref.IsNode() ? remap[ref.index] : ref;
+    };
+
+    if (!ref.IsNode()) return Copy(ref);
+
+    remap.resize(other.nodes.size());
+    if (remap[ref.index]) return remap[ref.index];
+
+    // Nodes only point at nodes before them, so marking from ref down reaches everything, and copying up from there copies children first
+    std::vector<bool> reachable(ref.index + 1);
+    reachable[ref.index] = true;
+    for (auto i = ref.index + 1; i-- > 0;) {
+        if (!reachable[i] || remap[i]) continue;
+        for (auto& entry : other.nodes[i].entries) {
+            if (entry.ref.IsNode()) reachable[entry.ref.index] = true;
+        }
+    }
+
+    for (std::uint32_t i = 0; i <= ref.index; i++) {
+        if (!reachable[i] || remap[i]) continue;
+
+        auto node = other.nodes[i];
+        for (auto& entry : node.entries) entry.ref = Copy(entry.ref);
+
+        // Not counted as deduplicated, sharing a node the other graph already shared isn't news
+        auto prev = FindNode(node);
+        remap[i] = prev ? prev : AddNode(std::move(node));
+    }
+
+    return remap[ref.index];
+}
+
+void QuickArmorRebalance::LootGraph::Prune() {
+    // Nodes only point at nodes before them, so marking from the back reaches everything in one pass
+    std::vector<bool> reachable(nodes.size());
+    for (auto& attachment : attachments) {
+        if (attachment.ref.IsNode()) reachable[attachment.ref.index] = true;
+    }
+    for (auto& root : roots) {
+        if (root.ref.IsNode()) reachable[root.ref.index] = true;
+    }
+
+    for (auto i = nodes.size(); i-- > 0;) {
+        if (!reachable[i]) continue;
+        for (auto& entry : nodes[i].entries) {
+            if (entry.ref.IsNode()) reachable[entry.ref.index] = true;
+        }
+    }
+
+    std::vector<std::uint32_t> nodeMap(nodes.size());
+    auto remap = [&](LootRef ref) { return ref.IsNode() ? LootRef::Node(nodeMap[ref.index]) : ref; };
+
+    std::vector<LootNode> kept;
+    nodeIndex.clear();
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        if (!reachable[i]) continue;
+
+        auto& node = nodes[i];
+        for (auto& entry : node.entries) entry.ref = remap(entry.ref);
+
+        nodeMap[i] = (std::uint32_t)kept.size();
+        nodeIndex.emplace(HashNode(node), nodeMap[i]);
+        kept.push_back(std::move(node));
+    }
+    nodes = std::move(kept);
+
+    for (auto& attachment : attachments) attachment.ref = remap(attachment.ref);
+    for (auto& root : roots) root.ref = remap(root.ref);
+}
+
+void QuickArmorRebalance::WriteJSONString(std::ostream& os, std::string_view str) {
+    os << '"';
+    for (unsigned char c : str) {
+        switch (c) {
+            case '"':
+                os << "\\\"";
+                break;
+            case '\\':
+                os << "\\\\";
+                break;
+            case '\n':
+                os << "\\n";
+                break;
+            case '\r':
+                os << "\\r";
+                break;
+            case '\t':
+                os << "\\t";
+                break;
+            default:
+                if (c < 0x20) {
+                    static const char* hex = "0123456789abcdef";
+                    os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+                } else
+                    os << (char)c;
+                break;
+        }
+    }
+    os << '"';
+}
+
+void QuickArmorRebalance::WriteJSONRef(std::ostream& os, LootRef ref) {
+    switch (ref.kind) {
+        case LootRef::kItem:
+            os << "\"i" << ref.index << '"';
+            break;
+        case LootRef::kNode:
+            os << "\"n" << ref.index << '"';
+            break;
+        default:
+            os << "null";
+            break;
+    }
+}
+
+void QuickArmorRebalance::LootGraph::WriteJSON(std::ostream& os) const {
+    os << "{\n\"items\": [";
+    for (std::size_t i = 0; i < items.size(); i++) {
+        os << (i ? ",\n" : "\n") << "{\"id\": " << items[i].id << ", \"name\": ";
+        WriteJSONString(os, items[i].name);
+        os << '}';
+    }
+
+    os << "\n],\n\"nodes\": [";
+    for (std::size_t i = 0; i < nodes.size(); i++) {
+        auto& node = nodes[i];
+        os << (i ? ",\n" : "\n") << "{\"purpose\": ";
+        WriteJSONString(os, node.purpose);
+        os << ", \"flags\": " << (int)node.flags << ", \"chanceNone\": " << (int)node.chanceNone << ", \"entries\": [";
+        for (std::size_t j = 0; j < node.entries.size(); j++) {
+            auto& entry = node.entries[j];
+            os << (j ? ", " : "") << '[';
+            WriteJSONRef(os, entry.ref);
+            os << ", " << entry.level << ", " << entry.count << ']';
+        }
+        os << "]}";
+    }
+
+    os << "\n],\n\"targets\": [";
+    for (std::size_t i = 0; i < targets.size(); i++) {
+        os << (i ? ",\n" : "\n") << "{\"id\": " << targets[i].id << ", \"name\": ";
+        WriteJSONString(os, targets[i].name);
+        os << ", \"list\": " << (targets[i].bList ? "true" : "false") << '}';
+    }
+
+    os << "\n],\n\"attachments\": [";
+    for (std::size_t i = 0; i < attachments.size(); i++) {
+        auto& attachment = attachments[i];
+        os << (i ? ",\n" : "\n") << "{\"target\": " << attachment.target << ", \"ref\": ";
+        WriteJSONRef(os, attachment.ref);
+        os << ", \"count\": " << attachment.count << ", \"order\": " << attachment.order;
+        os << ", \"ench\": [" << attachment.ench.rate << ", " << attachment.ench.power << "]";
+        os << ", \"enchBase\": [" << attachment.enchBase.rate << ", " << attachment.enchBase.power << "]";
+        if (attachment.enchFrom != LootAttachment::kOwnEnch) os << ", \"enchFrom\": " << attachment.enchFrom;
+        os << '}';
+    }
+
+    os << "\n],\n\"roots\": [";
+    for (std::size_t i = 0; i < roots.size(); i++) {
+        os << (i ? ",\n" : "\n") << "{\"name\": ";
+        WriteJSONString(os, roots[i].name);
+        os << ", \"ref\": ";
+        WriteJSONRef(os, roots[i].ref);
+        if (!roots[i].group.empty()) {
+            os << ", \"group\": ";
+            WriteJSONString(os, roots[i].group);
+        }
+        os << '}';
+    }
+    os << "\n]\n}\n";
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <compare>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Loot graph
+
+    Plain data description of the leveled lists to generate: nodes are
+    the lists, refs point at either an item or another node, and
+    attachments place a ref into a container or an existing list.
+
+    Planning only ever builds one of these, creating the actual forms is
+    a separate step (MaterializeLootGraph in LootLists.cpp). Items and
+    targets carry an opaque form pointer that only the materializer looks
+    at, everything else only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    struct LootRef {
+        enum Kind : std::uint8_t { kNone, kItem, kNode };
+
+        Kind kind = kNone;
+        std::uint32_t index = 0;
+
+        static LootRef Item(std::uint32_t i) { return {kItem, i}; }
+        static LootRef Node(std::uint32_t i) { return {kNode, i}; }
+
+        bool IsNode() const { return kind == kNode; }
+        bool IsItem() const { return kind == kItem; }
+        explicit operator bool() const { return kind != kNone; }
+
+        auto operator<=>(const LootRef&) const = default;
+    };
+
+    struct LootEntry {
+        LootRef ref;  // kNone is an empty roll
+        std::uint16_t level = 1;
+        std::uint16_t count = 1;
+
+        auto operator<=>(const LootEntry&) const = default;
+    };
+
+    // One leveled list
+    struct LootNode {
+        const char* purpose = "";  // Static string, groups lists in reports
+        std::uint8_t flags = 0;
+        std::uint8_t chanceNone = 0;
+        std::vector<LootEntry> entries;
+    };
+
+    struct LootItem {
+        void* form = nullptr;
+        std::uint32_t id = 0;
+        std::string name;
+    };
+
+    struct LootTarget {
+        void* form = nullptr;
+        std::uint32_t id = 0;
+        std::string name;
+        bool bList = false;  // An existing leveled list rather than a container
+    };
+
+    struct LootEnch {
+        float rate = 1.0f;
+        float power = 1.0f;
+    };
+
+    struct LootAttachment {
+        static constexpr std::uint32_t kOwnEnch = ~0u;
+
+        std::uint32_t target = 0;
+        LootRef ref;
+        std::uint16_t count = 1;
+        std::uint32_t order = 0;  // Applied in ascending order, ties keep the order they were added in
+
+        LootEnch ench;      // From the container entry
+        LootEnch enchBase;  // From the container group
+
+        std::uint32_t enchFrom = kOwnEnch;  // For containers copying another's loot, the target to take the enchantment rates from instead
+    };
+
+    // Named entry points, for reports
+    struct LootRoot {
+        std::string name;
+        LootRef ref;
+        std::string group;  // Container group it was planned for
+    };
+
+    class LootGraph {
+    public:
+        // Same values as RE::TESLeveledList::Flag
+        enum Flags : std::uint8_t {
+            kCalculateFromAllLevelsLTOrEqPCLevel = 1 << 0,
+            kCalculateForEachItemInCount = 1 << 1,
+            kUseAll = 1 << 2,
+        };
+
+        static constexpr std::size_t kMaxEntries = 0xff;  // Not 0x100 because num_entries would roll to 0 at max size
+
+        using Weights = std::vector<std::pair<LootRef, std::uint64_t>>;
+
+        LootRef AddItem(void* form, std::uint32_t id, const char* name);
+        // Returns the existing node if one with the same flags, chance and entries was already added
+        LootRef AddNode(LootNode node);
+        // Adds a list picking each ref in proportion to its weight, using as few entries as it can. Odds that can't be fit in kMaxEntries
+        // are nested or rounded, keeping the total variation distance from the exact odds within tolerance where possible. With kUseAll
+        // the weights are counts and every entry is kept as given
+        LootRef AddWeightedNode(const char* purpose, std::uint8_t flags, Weights weights, double tolerance, std::uint8_t chanceNone = 0);
+        std::uint32_t AddTarget(void* form, std::uint32_t id, const char* name, bool bList);
+        void Attach(const LootAttachment& attachment) { attachments.push_back(attachment); }
+        void AddRoot(std::string name, LootRef ref, std::string group = {}) { roots.push_back({std::move(name), ref, std::move(group)}); }
+
+        // Existing item or identical node, if there is one
+        LootRef FindItem(const void* form) const;
+        LootRef FindNode(const LootNode& node) const;
+
+        // Moves all of other onto the end of this graph, sharing items and targets with the same form and identical nodes
+        void Append(LootGraph&& other);
+        // Copies ref and every node it reaches from other, sharing items with the same form and identical nodes. remap holds what other's
+        // nodes became, for copying several refs from the same graph; start it empty
+        LootRef Import(const LootGraph& other, LootRef ref, std::vector<LootRef>& remap);
+        // Removes nodes no attachment or root can reach anymore, keeping the rest in order
+        void Prune();
+
+        const LootNode& Node(LootRef ref) const { return nodes[ref.index]; }
+
+        // Same graph always writes the same text, one node per line, so runs can be diffed
+        void WriteJSON(std::ostream& os) const;
+
+        std::vector<LootItem> items;
+        std::vector<LootNode> nodes;
+        std::vector<LootTarget> targets;
+        std::vector<LootAttachment> attachments;
+        std::vector<LootRoot> roots;
+
+        // Nodes that were added again and shared instead, by purpose
+        std::map<const char*, std::uint32_t> deduplicated;
+
+        // Weighted lists whose odds had to be rounded, and the largest total variation distance that introduced
+        std::uint32_t approximated = 0;
+        double maxApproximationError = 0.0;
+
+    private:
+        LootRef EncodeWeights(const char* purpose, std::uint8_t flags, Weights weights, double tolerance, std::uint8_t chanceNone, int depth, double& error);
+
+        std::unordered_map<const void*, std::uint32_t> itemIndex;
+        std::unordered_map<const void*, std::uint32_t> targetIndex;
+        std::unordered_multimap<std::uint64_t, std::uint32_t> nodeIndex;
+    };
+
+    // Writes str as a quoted JSON string
+    void WriteJSONString(std::ostream& os, std::string_view str);
+    // Writes ref as "i<index>", "n<index>" or null
+    void WriteJSONRef(std::ostream& os, LootRef ref);
+}
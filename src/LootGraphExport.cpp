@@ -0,0 +1,356 @@
+#include "LootGraphExport.h"
+
+#include "LootBudget.h"
+#include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <istream>
+#include <iterator>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string_view>
+
+namespace {
+    using namespace QuickArmorRebalance;
+
+    // Distinct refs a node points at, with how many of its entries point at each, in order of first appearance
+    std::vector<std::pair<LootRef, std::uint32_t>> Children(const LootNode& node) {
+        std::vector<std::pair<LootRef, std::uint32_t>> ret;
+        for (auto& entry : node.entries) {
+            if (!entry.ref) continue;
+
+            auto it = std::find_if(ret.begin(), ret.end(), [&](const auto& i) { return i.first == entry.ref; });
+            if (it == ret.end())
+                ret.push_back({entry.ref, 1});
+            else
+                it->second++;
+        }
+        return ret;
+    }
+
+    // Node purposes are static strings everywhere else, so the ones read back are kept for the rest of the run too
+    const char* InternPurpose(const std::string& purpose) {
+        static std::mutex lock;
+        static std::set<std::string, std::less<>> purposes;
+
+        std::lock_guard guard(lock);
+        return purposes.insert(purpose).first->c_str();
+    }
+
+    using rapidjson::Value;
+
+    class GraphReader {
+    public:
+        GraphReader(LootGraph& graph, std::string& error) : graph(graph), error(error) {}
+
+        bool Read(const Value& root) {
+            if (!root.IsObject()) return Fail("graph is not an object");
+
+            auto items = Array(root, "items");
+            auto nodes = Array(root, "nodes");
+            auto targets = Array(root, "targets");
+            auto attachments = Array(root, "attachments");
+            auto roots = Array(root, "roots");
+            if (!items || !nodes || !targets || !attachments || !roots) return false;
+
+            nItems = items->Size();
+            for (auto& i : items->GetArray()) {
+                if (!i.IsObject()) return Fail("malformed item");
+                graph.items.push_back({nullptr, (std::uint32_t)Number(i, "id"), String(i, "name")});
+            }
+
+            // Same order as written, so each node only points at ones already read
+            for (auto& i : nodes->GetArray()) {
+                if (!i.IsObject()) return Fail("malformed node");
+
+                auto entries = Member(i, "entries");
+                if (!entries || !entries->IsArray()) return Fail("node without entries");
+
+                LootNode node{InternPurpose(String(i, "purpose")), (std::uint8_t)Number(i, "flags"), (std::uint8_t)Number(i, "chanceNone"), {}};
+                for (auto& entry : entries->GetArray()) {
+                    if (!entry.IsArray() || entry.Size() != 3 || !entry[1].IsNumber() || !entry[2].IsNumber()) return Fail("malformed entry");
+
+                    LootEntry e;
+                    if (!Ref(entry[0], e.ref)) return false;
+                    e.level = (std::uint16_t)entry[1].GetDouble();
+                    e.count = (std::uint16_t)entry[2].GetDouble();
+                    node.entries.push_back(e);
+                }
+                nodeMap.push_back(graph.AddNode(std::move(node)).index);
+            }
+
+            for (auto& i : targets->GetArray()) {
+                if (!i.IsObject()) return Fail("malformed target");
+
+                auto list = Member(i, "list");
+                graph.targets.push_back({nullptr, (std::uint32_t)Number(i, "id"), String(i, "name"), list && list->IsTrue()});
+            }
+
+            for (auto& i : attachments->GetArray()) {
+                if (!i.IsObject()) return Fail("malformed attachment");
+
+                LootAttachment attachment;
+                attachment.target = (std::uint32_t)Number(i, "target");
+                if (attachment.target >= graph.targets.size()) return Fail("attachment to a missing target");
+
+                auto ref = Member(i, "ref");
+                if (!ref || !Ref(*ref, attachment.ref)) return Fail("attachment without a ref");
+
+                attachment.count = (std::uint16_t)Number(i, "count", 1);
+                attachment.order = (std::uint32_t)Number(i, "order");
+                attachment.ench = Ench(i, "ench");
+                attachment.enchBase = Ench(i, "enchBase");
+                if (Member(i, "enchFrom")) attachment.enchFrom = (std::uint32_t)Number(i, "enchFrom");
+                graph.attachments.push_back(attachment);
+            }
+
+            for (auto& i : roots->GetArray()) {
+                if (!i.IsObject()) return Fail("malformed root");
+
+                auto ref = Member(i, "ref");
+
+                LootRef r;
+                if (!ref || !Ref(*ref, r)) return Fail("root without a ref");
+                graph.AddRoot(String(i, "name"), r, String(i, "group"));
+            }
+
+            return true;
+        }
+
+    private:
+        bool Fail(const char* what) {
+            error = what;
+            return false;
+        }
+
+        static const Value* Member(const Value& value, const char* key) {
+            auto it = value.FindMember(key);
+            return it != value.MemberEnd() ? &it->value : nullptr;
+        }
+
+        const Value* Array(const Value& root, const char* key) {
+            auto value = Member(root, key);
+            if (!value || !value->IsArray()) {
+                error = std::string("missing ") + key;
+                return nullptr;
+            }
+            return value;
+        }
+
+        static double Number(const Value& value, const char* key, double def = 0.0) {
+            auto member = Member(value, key);
+            return member && member->IsNumber() ? member->GetDouble() : def;
+        }
+
+        static std::string String(const Value& value, const char* key) {
+            auto member = Member(value, key);
+            return member && member->IsString() ? std::string(member->GetString(), member->GetStringLength()) : std::string();
+        }
+
+        static LootEnch Ench(const Value& value, const char* key) {
+            auto member = Member(value, key);
+            if (!member || !member->IsArray() || member->Size() != 2 || !(*member)[0].IsNumber() || !(*member)[1].IsNumber()) return {};
+            return {(*member)[0].GetFloat(), (*member)[1].GetFloat()};
+        }
+
+        bool Ref(const Value& value, LootRef& ref) {
+            if (value.IsNull()) {
+                ref = {};
+                return true;
+            }
+            if (!value.IsString() || value.GetStringLength() < 2) return Fail("malformed ref");
+
+            auto str = value.GetString();
+            auto index = (std::uint32_t)std::strtoul(str + 1, nullptr, 10);
+            switch (str[0]) {
+                case 'i':
+                    if (index >= nItems) return Fail("ref to a missing item");
+                    ref = LootRef::Item(index);
+                    return true;
+                case 'n':
+                    if (index >= nodeMap.size()) return Fail("ref to a node that isn't defined before it");
+                    ref = LootRef::Node(nodeMap[index]);
+                    return true;
+                default:
+                    return Fail("malformed ref");
+            }
+        }
+
+        LootGraph& graph;
+        std::string& error;
+
+        std::uint32_t nItems = 0;
+        std::vector<std::uint32_t> nodeMap;  // Identical nodes in the file are shared, so indices can shift
+    };
+}
+
+std::vector<QuickArmorRebalance::LootNodeMetrics> QuickArmorRebalance::ComputeLootNodeMetrics(const LootGraph& graph) {
+    auto costs = ComputeLootCosts(graph);
+    std::vector<LootNodeMetrics> ret(graph.nodes.size());
+
+    // One bit per item for each node, filled bottom up since nodes only point at nodes before them
+    auto words = (graph.items.size() + 63) / 64;
+    std::vector<std::uint64_t> reachable(graph.nodes.size() * words);
+
+    for (std::size_t i = 0; i < graph.nodes.size(); i++) {
+        auto& node = graph.nodes[i];
+        auto& metrics = ret[i];
+        auto bits = reachable.data() + i * words;
+
+        auto children = Children(node);
+        metrics.entries = (std::uint32_t)node.entries.size();
+        metrics.fanOut = (std::uint32_t)children.size();
+        metrics.depth = costs[i].depth;
+
+        for (auto& child : children) {
+            if (child.first.IsItem())
+                bits[child.first.index / 64] |= 1ull << (child.first.index % 64);
+            else {
+                ret[child.first.index].parents++;
+
+                auto childBits = reachable.data() + child.first.index * words;
+                for (std::size_t w = 0; w < words; w++) bits[w] |= childBits[w];
+            }
+        }
+
+        for (std::size_t w = 0; w < words; w++) metrics.reachableItems += std::popcount(bits[w]);
+    }
+
+    for (auto& attachment : graph.attachments) {
+        if (attachment.ref.IsNode()) ret[attachment.ref.index].attached++;
+    }
+
+    return ret;
+}
+
+QuickArmorRebalance::LootGraphSummary QuickArmorRebalance::SummarizeLootGraph(const LootGraph& graph, const std::vector<LootNodeMetrics>& metrics) {
+    LootGraphSummary ret;
+    ret.nodes = (std::uint32_t)graph.nodes.size();
+    ret.items = (std::uint32_t)graph.items.size();
+    ret.targets = (std::uint32_t)graph.targets.size();
+
+    for (auto& i : metrics) {
+        ret.entries += i.entries;
+        if (i.parents > 1) ret.shared++;
+        ret.maxDepth = std::max(ret.maxDepth, i.depth);
+        ret.maxEntries = std::max(ret.maxEntries, i.entries);
+        ret.maxFanOut = std::max(ret.maxFanOut, i.fanOut);
+        ret.maxReachableItems = std::max(ret.maxReachableItems, i.reachableItems);
+    }
+
+    return ret;
+}
+
+void QuickArmorRebalance::WriteLootGraphDOT(const LootGraph& graph, const std::vector<LootNodeMetrics>& metrics, std::ostream& os) {
+    os << "digraph LootGraph {\nrankdir=LR;\nnode [shape=box, fontsize=10];\n";
+
+    // Labels are written as JSON strings, which DOT reads the same way, including \n for a line break
+    for (std::size_t i = 0; i < graph.nodes.size(); i++) {
+        auto& node = graph.nodes[i];
+        auto& m = metrics[i];
+
+        auto label = std::string(node.purpose) + "\n" + std::to_string(m.entries) + " entries, depth " + std::to_string(m.depth) + "\n" +
+                     std::to_string(m.parents) + " parents, " + std::to_string(m.reachableItems) + " items";
+        if (node.chanceNone) label += "\n" + std::to_string(node.chanceNone) + "% none";
+
+        os << 'n' << i << " [label=";
+        WriteJSONString(os, label);
+        if (node.flags & LootGraph::kUseAll) os << ", style=bold";
+        os << "];\n";
+
+        for (auto& child : Children(node)) {
+            if (!child.first.IsNode()) continue;
+
+            os << 'n' << i << " -> n" << child.first.index;
+            if (child.second > 1) os << " [label=\"x" << child.second << "\"]";
+            os << ";\n";
+        }
+    }
+
+    // Only the targets something is attached to, each edge once
+    std::set<std::pair<std::uint32_t, std::uint32_t>> edges;
+    std::vector<bool> used(graph.targets.size());
+    for (auto& attachment : graph.attachments) {
+        if (!attachment.ref.IsNode()) continue;
+        used[attachment.target] = true;
+        edges.insert({attachment.target, attachment.ref.index});
+    }
+
+    for (std::size_t i = 0; i < graph.targets.size(); i++) {
+        if (!used[i]) continue;
+
+        os << 't' << i << " [shape=" << (graph.targets[i].bList ? "note" : "folder") << ", label=";
+        WriteJSONString(os, graph.targets[i].name);
+        os << "];\n";
+    }
+    for (auto& i : edges) os << 't' << i.first << " -> n" << i.second << ";\n";
+
+    os << "}\n";
+}
+
+void QuickArmorRebalance::WriteLootGraphAdjacency(const LootGraph& graph, const std::vector<LootNodeMetrics>& metrics, std::ostream& os) {
+    auto summary = SummarizeLootGraph(graph, metrics);
+
+    os << "{\n\"summary\": {\"nodes\": " << summary.nodes << ", \"items\": " << summary.items << ", \"targets\": " << summary.targets
+       << ", \"entries\": " << summary.entries << ", \"shared\": " << summary.shared << ", \"maxDepth\": " << summary.maxDepth
+       << ", \"maxEntries\": " << summary.maxEntries << ", \"maxFanOut\": " << summary.maxFanOut << ", \"maxReachableItems\": " << summary.maxReachableItems
+       << "},\n\"nodes\": [";
+
+    for (std::size_t i = 0; i < graph.nodes.size(); i++) {
+        auto& node = graph.nodes[i];
+        auto& m = metrics[i];
+
+        os << (i ? ",\n" : "\n") << "{\"id\": \"n" << i << "\", \"purpose\": ";
+        WriteJSONString(os, node.purpose);
+        os << ", \"entries\": " << m.entries << ", \"fanOut\": " << m.fanOut << ", \"depth\": " << m.depth << ", \"parents\": " << m.parents
+           << ", \"attached\": " << m.attached << ", \"reachableItems\": " << m.reachableItems << ", \"children\": [";
+
+        bool bFirst = true;
+        for (auto& child : Children(node)) {
+            os << (bFirst ? "" : ", ") << '[';
+            WriteJSONRef(os, child.first);
+            os << ", " << child.second << ']';
+            bFirst = false;
+        }
+        os << "]}";
+    }
+
+    // Attachments grouped by target, in attachment order
+    std::vector<std::vector<LootRef>> attached(graph.targets.size());
+    for (auto& attachment : graph.attachments) attached[attachment.target].push_back(attachment.ref);
+
+    os << "\n],\n\"targets\": [";
+    bool bFirst = true;
+    for (std::size_t i = 0; i < graph.targets.size(); i++) {
+        if (attached[i].empty()) continue;
+
+        os << (bFirst ? "\n" : ",\n") << "{\"id\": " << graph.targets[i].id << ", \"name\": ";
+        WriteJSONString(os, graph.targets[i].name);
+        os << ", \"refs\": [";
+        for (std::size_t j = 0; j < attached[i].size(); j++) {
+            if (j) os << ", ";
+            WriteJSONRef(os, attached[i][j]);
+        }
+        os << "]}";
+        bFirst = false;
+    }
+    os << "\n]\n}\n";
+}
+
+bool QuickArmorRebalance::ReadLootGraphJSON(std::istream& is, LootGraph& graph, std::string& error) {
+    std::string text(std::istreambuf_iterator<char>(is), {});
+
+    rapidjson::Document doc;
+    doc.Parse<rapidjson::kParseCommentsFlag | rapidjson::kParseTrailingCommasFlag>(text.data(), text.size());
+    if (doc.HasParseError()) {
+        error = std::string(rapidjson::GetParseError_En(doc.GetParseError())) + " at offset " + std::to_string(doc.GetErrorOffset());
+        return false;
+    }
+
+    GraphReader reader(graph, error);
+    return reader.Read(doc);
+}
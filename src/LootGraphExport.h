@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "LootGraph.h"
+
+/*////////////////////////////////////////////////////////////////////
+    Loot graph export
+
+    Size and shape metrics for each generated list, written out as a
+    GraphViz DOT file to look at and a JSON adjacency list to diff or
+    script against. The graph JSON written by LootGraph::WriteJSON can
+    be read back in, so all of this also works offline on a graph saved
+    from a game session (see tools/LootGraphTool.cpp). Only depends on
+    the standard library and rapidjson, which is header-only
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    struct LootNodeMetrics {
+        std::uint32_t entries = 0;         // Entries in the list itself
+        std::uint32_t fanOut = 0;          // Distinct items and lists it points at
+        int depth = 0;                     // Lists down to the deepest item, counting this one
+        std::uint32_t parents = 0;         // Distinct lists that use it
+        std::uint32_t attached = 0;        // Times it's placed straight into a container or existing list
+        std::uint32_t reachableItems = 0;  // Distinct items any roll of it could give
+    };
+
+    struct LootGraphSummary {
+        std::uint32_t nodes = 0;
+        std::uint32_t items = 0;
+        std::uint32_t targets = 0;
+        std::uint64_t entries = 0;
+        std::uint32_t shared = 0;  // Lists with more than one parent
+        int maxDepth = 0;
+        std::uint32_t maxEntries = 0;
+        std::uint32_t maxFanOut = 0;
+        std::uint32_t maxReachableItems = 0;
+    };
+
+    // By node index
+    std::vector<LootNodeMetrics> ComputeLootNodeMetrics(const LootGraph& graph);
+    LootGraphSummary SummarizeLootGraph(const LootGraph& graph, const std::vector<LootNodeMetrics>& metrics);
+
+    // Lists and targets as boxes labelled with their purpose and metrics. Items are left out, they're only counted in the labels, since
+    // there are usually far more of them than there are lists
+    void WriteLootGraphDOT(const LootGraph& graph, const std::vector<LootNodeMetrics>& metrics, std::ostream& os);
+
+    // Every list with its metrics and distinct children, every target with what's attached to it, and the summary
+    void WriteLootGraphAdjacency(const LootGraph& graph, const std::vector<LootNodeMetrics>& metrics, std::ostream& os);
+
+    // Reads a graph written by LootGraph::WriteJSON. Forms aren't saved, so items and targets come back without them and the graph is
+    // only good for inspecting. Returns false with a reason on malformed input
+    bool ReadLootGraphJSON(std::istream& is, LootGraph& graph, std::string& error);
+}
@@ -4,6 +4,18 @@
 #include "ArmorSetBuilder.h"
 #include "Config.h"
 #include "Data.h"
+#include "Enchantments.h"
+#include "LootAnalysis.h"
+#include "LootBudget.h"
+#include "LootGraph.h"
+#include "LootGraphExport.h"
+#include "LootSimulation.h"
+#include "Profiler.h"
+#include "ShardedBucket.h"
+
+#include <array>
+#include <fstream>
+#include <optional>
 
 /*//////////////////
 Loot table notes
@@ -18,7 +30,7 @@ Loot table notes
 
 */
 
-// #define RUN_DISTRIBUTION_TESTS 10
+// #define RUN_DISTRIBUTION_TESTS 10000  // Simulated rolls per container and level
 // #define TEST_FOR_DUPLICATE_LISTS
 
 using namespace rapidjson;
@@ -157,7 +169,7 @@ void QuickArmorRebalance::LoadLootChanges(RE::TESBoundObject* item, const Value&
 
     if (jsonLoot.HasMember("piece") && jsonLoot["piece"].GetBool()) {
         piece = item;
-        g_Data.distItems.insert(item);
+        g_Data.distItems.Insert(item->GetFormID());
     }
 
     if (auto armor = item->As<RE::TESObjectARMO>()) {
@@ -181,7 +193,7 @@ void QuickArmorRebalance::LoadLootChanges(RE::TESBoundObject* item, const Value&
                 if (auto setitem = RE::TESForm::LookupByID<RE::TESObjectARMO>(id)) {
                     if (!DoNotDistribute(setitem)) {
                         items.push_back(setitem);
-                        g_Data.distItems.insert(setitem);
+                        g_Data.distItems.Insert(setitem->GetFormID());
                     }
                 }
             }
@@ -355,19 +367,16 @@ void QuickArmorRebalance::ValidateLootConfig() {
     }
 }
 
-std::map<std::string, RE::TESBoundObject*> g_TestList;
-
 namespace {
     using namespace QuickArmorRebalance;
 
-    int g_nLListsCreated = 0;
     std::map<const char*, int> g_nLLTypes;
 
 #ifdef TEST_FOR_DUPLICATE_LISTS
     std::vector<RE::TESLevItem*> g_createdLists;
 #endif
 
-    const size_t kLLMaxSize = 0xff;  // Not 0x100 because num_entries would roll to 0 at max size
+    const size_t kLLMaxSize = LootGraph::kMaxEntries;
 
     RE::TESLevItem* CreateLeveledList(const char* reason) {
         auto dataHandler = RE::TESDataHandler::GetSingleton();
@@ -378,8 +387,8 @@ namespace {
             dataHandler->GetFormArray<RE::TESLevItem>().push_back(newForm);
         }
 
-        g_nLListsCreated++;
         g_nLLTypes[reason]++;
+        Profiler::Get()->Count("Leveled lists created");
         return newForm;
     }
 
@@ -398,746 +407,1291 @@ namespace {
         logger::info(">>>End list<<<");
     }
 
-    void AddListEntries(std::vector<RE::TESBoundObject*>& entries, RE::TESBoundObject* entry, int n) {
-        while (n--) entries.push_back(entry);
+    int GetGroupEntriesForLevel(int level, QuickArmorRebalance::LootDistGroup* group) {
+        auto r = group->level - level;
+        if (r > group->early) return 0;
+        if (r > 0) return (int)std::round(std::lerp(group->maxw, 1, (float)r / group->early));
+        r += group->peak;
+        if (r >= 0) return group->maxw;
+
+        r += group->falloff;
+        if (r > 0) return (int)std::round(std::lerp(group->minw, group->maxw, (float)r / group->falloff));
+
+        return group->minw;
     }
 
+    // Sets of groups and regions are ordered by address, so sort them by name to plan the same graph every run
     template <class T>
-    RE::TESBoundObject* BuildListFrom(const char* purpose, T* const* items, size_t count, uint8_t flags, uint8_t chanceNone = 0) {
-        if (!count) return nullptr;
-        if (!chanceNone) {
-            if (count == 1) return const_cast<T*>(*items);
-
-            // Might be multiple entries of the same item
-            if (items[0] == items[count - 1]) {  // First and last is quick check, then verify
-                for (int i = 1; i < count; i++) {
-                    if (items[0] != items[i]) goto NotSame;
-                }
-                return const_cast<T*>(*items);
-            }
-        }
-    NotSame:
-        if (count <= kLLMaxSize) {
-            auto list = CreateLeveledList(purpose);
-            list->llFlags = (RE::TESLeveledList::Flag)flags;
-            list->entries.resize(list->numEntries = (uint8_t)count);
-            list->chanceNone = chanceNone;
-            for (int i = 0; i < count; i++) {
-                auto& e = list->entries[i];
-                e.count = 1;
-                e.form = items[i];
-                e.level = 1;
-                e.itemExtra = nullptr;
-            }
-            // LogListContents(list);
-            return list;
-        } else {
-            auto split = 1 + count / kLLMaxSize;
-            auto slice = count / split;
-
-            auto list = CreateLeveledList(purpose);
-            list->llFlags = (RE::TESLeveledList::Flag)flags;
-            list->entries.resize(split);
-            list->chanceNone = chanceNone;
-            auto front = items;
-            for (int i = 0; i < split; i++) {
-                auto& e = list->entries[i];
-                e.count = 1;
-                e.form = BuildListFrom(purpose, front, count > kLLMaxSize ? slice : count, flags);
-                e.level = 1;
-                e.itemExtra = nullptr;
-
-                front += slice;
-                count -= slice;
-            }
+    std::vector<T*> SortedByName(const std::set<T*>& set) {
+        std::vector<T*> ret(set.begin(), set.end());
+        std::sort(ret.begin(), ret.end(), [](T* a, T* b) { return a->name < b->name; });
+        return ret;
+    }
 
-            // LogListContents(list);
-#ifdef TEST_FOR_DUPLICATE_LISTS
-            g_createdLists.push_back(list);
-#endif
-            return list;
+    // Grouped in order of first appearance rather than by file address, for the same reason
+    template <class T>
+    KeyedBuckets<RE::TESFile*, T> GroupByFile(const std::vector<T>& items, auto GetFile) {
+        KeyedBuckets<RE::TESFile*, T> ret;
+        for (auto i : items) {
+            auto file = GetFile(i);
+            auto it = std::find_if(ret.begin(), ret.end(), [=](const auto& b) { return b.first == file; });
+            if (it == ret.end()) it = ret.emplace(ret.end(), file, std::vector<T>{});
+            it->second.push_back(i);
         }
+        return ret;
     }
 
-    RE::TESBoundObject* BuildListFrom(const char* purpose, const std::vector<RE::TESObjectARMO*>& items, uint8_t flags) {
-        return BuildListFrom(purpose, items.data(), items.size(), flags);
-    }
+    // Up to three pointers or small values packed into one key, so a nested lookup is a single probe
+    struct MemoKey {
+        std::uint64_t a = 0, b = 0, c = 0;
+
+        auto operator<=>(const MemoKey&) const = default;
+    };
+
+    struct MemoKeyHash {
+        std::uint64_t operator()(const MemoKey& key) const { return MixHash(key.a ^ MixHash(key.b ^ MixHash(key.c))); }
+    };
 
-    RE::TESBoundObject* BuildListFrom(const char* purpose, const std::vector<RE::TESBoundObject*>& items, uint8_t flags) {
-        return BuildListFrom(purpose, items.data(), items.size(), flags);
+    std::uint64_t MemoKeyPart(const void* ptr) { return (std::uintptr_t)ptr; }
+    std::uint64_t MemoKeyPart(int n) { return (std::uint32_t)n; }
+    std::uint64_t MemoKeyPart(LootRef ref) { return ((std::uint64_t)ref.kind << 32) | ref.index; }
+
+    template <class... T>
+    MemoKey MakeMemoKey(T... parts) {
+        static_assert(sizeof...(T) <= 3);
+        std::uint64_t packed[3]{MemoKeyPart(parts)...};
+        return {packed[0], packed[1], packed[2]};
     }
 
-    RE::TESBoundObject* BuildContentList(const std::vector<RE::TESBoundObject*>& contents) {
-        if (!QuickArmorRebalance::g_Config.bNormalizeModDrops) return BuildListFrom("Items", contents, RE::TESLeveledList::kCalculateForEachItemInCount);
+    struct MemoStats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t inserts = 0;
+    };
 
-        std::vector<RE::TESBoundObject*> modLists;
-        std::map<RE::TESFile*, std::vector<RE::TESBoundObject*>> map;
+    // Planner memo table that counts whether it's paying off. Values can move when something is inserted, so don't hold on to them
+    // across a call that could add to the same cache
+    template <class Value>
+    class MemoCache {
+    public:
+        Value* Find(const MemoKey& key) {
+            auto ret = map.Find(key);
+            (ret ? stats.hits : stats.misses)++;
+            return ret;
+        }
 
-        for (auto i : contents) map[i->GetFile(0)].push_back(i);
-        for (const auto& i : map) {
-            modLists.push_back(BuildListFrom("Items", i.second, RE::TESLeveledList::kCalculateForEachItemInCount));
+        Value& Insert(const MemoKey& key, Value value) {
+            stats.inserts++;
+            return map[key] = std::move(value);
         }
 
-        return BuildListFrom("Mod Grouped Items", modLists, RE::TESLeveledList::kCalculateForEachItemInCount);
-    }
+        // Found, or default constructed and counted as a miss
+        std::pair<Value*, bool> FindOrInsert(const MemoKey& key) {
+            auto ret = map.TryEmplace(key);
+            if (ret.second) {
+                stats.misses++;
+                stats.inserts++;
+            } else
+                stats.hits++;
+            return ret;
+        }
 
-    RE::TESBoundObject* BuildArmorSetList(const QuickArmorRebalance::ArmorSet* set) {
-        auto it = QuickArmorRebalance::g_Data.loot->setList.find(set);
-        if (it != QuickArmorRebalance::g_Data.loot->setList.end()) return it->second;
+        const MemoStats& Stats() const { return stats; }
 
-        unsigned int covered = 0;
-        std::vector<RE::TESBoundObject*> pieces;
+    private:
+        FlatMap<MemoKey, Value, MemoKeyHash> map;
+        MemoStats stats;
+    };
 
-        for (auto i : *set) {
-            auto slots = (ArmorSlots)i->GetSlotMask();
-            if (!slots) continue;
-            if (covered & slots) continue;
+    using CurveLists = std::vector<std::pair<LootDistGroup*, LootRef>>;
 
-            std::vector<RE::TESObjectARMO*> conflicts;
+    // Container group, region and tier of a bucket of items in a container group's contents, the same whether or not the bucket exists
+    MemoKey LootFeed(const LootContainerGroup* group, const Region* region, const LootDistGroup* tier) { return MakeMemoKey(group, region, tier); }
 
-            // Two passes - first find potential conflicts, then pick them out
-            // This has to happen just to cover weird situations where pieces overlap inconsistently
-            // Technically would require repeating until it stops changing, but you'd have to design an armor set just
-            // to be obnoxious intentionally
-            for (auto j : *set) {
-                auto slots2 = (ArmorSlots)j->GetSlotMask();
-                if (slots & slots2) slots |= slots2;
-            }
-            for (auto j : *set) {
-                auto slots2 = (ArmorSlots)j->GetSlotMask();
-                if (slots & slots2) conflicts.push_back(j);
-            }
+    using LootFeeds = FlatSet<MemoKey, MemoKeyHash>;
 
-            if (conflicts.size() > 1)
-                pieces.push_back(BuildListFrom("Set Slot Randomization", conflicts, 0));
-            else
-                pieces.push_back(i);
+    // One container group and region's list from a planner, and the content buckets it was built from
+    struct PlannedRoot {
+        const LootContainerGroup* group;
+        const Region* region;
+        LootRef list;
+        std::vector<MemoKey> feeds;  // Sorted
+    };
 
-            covered |= slots;
-        }
+    // One loot type's lists from the last build, before they were merged and flattened, so roots none of whose items changed can be
+    // copied over instead of planned again
+    struct LootPlan {
+        LootGraph graph;
+        std::vector<PlannedRoot> roots;
+    };
 
-        return QuickArmorRebalance::g_Data.loot->setList[set] = BuildListFrom("Armor Set", pieces, RE::TESLeveledList::kUseAll);
+    // Which roots of the last plan can be copied: none of their buckets changed, and no root that has to be planned again reads from the
+    // same container groups. Roots reading the same groups share memo entries in a planner, including the lower tier lists filled in
+    // along the way, so they're planned together to come out the same as a full plan would
+    std::vector<bool> ReusableRoots(const LootPlan& plan, const LootFeeds& changed) {
+        std::vector<bool> reusable(plan.roots.size(), true);
+        std::unordered_set<std::uint64_t> replanned;  // Container groups
+
+        auto Groups = [](const PlannedRoot& root, auto&& fn) {
+            fn(MemoKeyPart(root.group));
+            for (auto& feed : root.feeds) fn(feed.a);
+        };
+
+        for (bool bMore = true; bMore;) {
+            bMore = false;
+            for (std::size_t i = 0; i < plan.roots.size(); i++) {
+                if (!reusable[i]) continue;
+
+                auto& root = plan.roots[i];
+                bool bDirty = std::any_of(root.feeds.begin(), root.feeds.end(), [&](const MemoKey& feed) { return changed.Contains(feed); });
+                Groups(root, [&](std::uint64_t group) { bDirty |= replanned.contains(group); });
+                if (!bDirty) continue;
+
+                reusable[i] = false;
+                Groups(root, [&](std::uint64_t group) { replanned.insert(group); });
+                bMore = true;
+            }
+        }
+        return reusable;
     }
 
-    RE::TESBoundObject* BuildContentList(const std::vector<const QuickArmorRebalance::ArmorSet*>& contents) {
-        if (!QuickArmorRebalance::g_Config.bNormalizeModDrops) {
-            std::vector<RE::TESBoundObject*> sets;
+    // Plans the leveled lists for one loot type into its own graph. Only reads the loot configuration and items, and keeps its caches
+    // to itself, so each loot type can be planned on its own thread
+    class LootPlanner {
+    public:
+        explicit LootPlanner(ELootType lootType) : lootType(lootType) {}
+
+        // Copies the roots of the last plan that changed items don't reach instead of planning them
+        LootPlanner(ELootType lootType, const LootPlan& previous, const LootFeeds& changed) : lootType(lootType), previous(&previous) {
+            auto reusable = ReusableRoots(previous, changed);
+            for (std::uint32_t i = 0; i < previous.roots.size(); i++) {
+                if (reusable[i]) reusableRoots[MakeMemoKey(previous.roots[i].group, previous.roots[i].region)] = i;
+            }
+        }
 
-            for (auto i : contents) sets.push_back(BuildArmorSetList(i));
+        void Plan() {
+            std::uint32_t order = 0;
+            for (auto& i : g_Data.loot->containerGroups) PlanContainerGroup(i.first, i.second, order++);
 
-            return BuildListFrom("Armor Sets List", sets, RE::TESLeveledList::kCalculateForEachItemInCount);
+            if (auto n = cacheChanceList.Stats().hits) Profiler::Get()->Count("Chance lists reused", n);
         }
 
-        std::vector<RE::TESBoundObject*> modLists;
-        std::map<RE::TESFile*, std::vector<const QuickArmorRebalance::ArmorSet*>> map;
+        // Adds this planner's memo counters to the totals, by cache
+        void AddMemoStats(std::map<std::string, MemoStats>& totals) const {
+            auto Add = [&](const char* name, const MemoStats& stats) {
+                auto& total = totals[name];
+                total.hits += stats.hits;
+                total.misses += stats.misses;
+                total.inserts += stats.inserts;
+            };
 
-        for (const auto& i : contents) map[(*i)[0]->GetFile(0)].push_back(i);
-        for (const auto& i : map) {
-            std::vector<RE::TESBoundObject*> sets;
-            for (auto j : i.second) sets.push_back(BuildArmorSetList(j));
-            modLists.push_back(BuildListFrom("Armor Sets List", sets, RE::TESLeveledList::kCalculateForEachItemInCount));
+            Add("Armor Set", cacheSetList.Stats());
+            Add("Group", cacheGroupList.Stats());
+            Add("Regional Group Tier", cacheRegionalGroupTierList.Stats());
+            Add("Source Selection", cacheSourceSelectionList.Stats());
+            Add("Lower Tier Items", cacheLowerTierItems.Stats());
+            Add("Chance", cacheChanceList.Stats());
+            Add("Copy Targets", cacheCopyTargets.Stats());
         }
 
-        return BuildListFrom("Mod Groupped Armor Sets List", modLists, RE::TESLeveledList::kCalculateForEachItemInCount);
-    }
+        std::uint32_t Reused() const { return nReused; }
 
-    RE::TESBoundObject* BuildGroupList(const LootContainerGroup::Rarities& contents, const LootContainerGroup::Rarities& fallback, RE::TESBoundObject** lowerTier, auto Fetch) {
-        RE::TESBoundObject* ret = nullptr;
-        auto cachePtr = &Fetch(contents, 0);
-        if (MapFind(g_Data.loot->cacheGroupList, cachePtr, ret)) {
-            // Cache unused due to RegionalGroupTierList cache
-            // logger::info("Group List cache used");
+        LootGraph graph;
+        std::vector<PlannedRoot> roots;
+
+    private:
+        LootRef Item(RE::TESBoundObject* item) { return graph.AddItem(item, item->GetFormID(), item->GetName()); }
+
+        template <class T>
+        std::vector<LootRef> Items(const std::vector<T*>& items) {
+            std::vector<LootRef> ret;
+            ret.reserve(items.size());
+            for (auto i : items) ret.push_back(Item(i));
             return ret;
         }
 
-        RE::TESBoundObject* lists[3] = {nullptr, nullptr, nullptr};
+        LootRef BuildWeightedList(const char* purpose, LootGraph::Weights weights, uint8_t flags, uint8_t chanceNone = 0) {
+            return graph.AddWeightedNode(purpose, flags, std::move(weights), g_Config.fLootWeightTolerance / 100.0, chanceNone);
+        }
 
-        int nUsed = 0;
-        for (int i = 0; i < 3; i++) {
-            if ((lists[i] = BuildContentList(!Fetch(contents, i).empty() ? Fetch(contents, i) : Fetch(fallback, i)))) nUsed++;
+        LootRef BuildListFrom(const char* purpose, const LootRef* items, size_t count, uint8_t flags, uint8_t chanceNone = 0) {
+            // Might be multiple entries of the same item, the encoder folds them into one weight
+            LootGraph::Weights weights;
+            weights.reserve(count);
+            for (size_t i = 0; i < count; i++) weights.push_back({items[i], 1});
+            return BuildWeightedList(purpose, std::move(weights), flags, chanceNone);
         }
 
-        constexpr int weight[] = {15, 4, 1};
-        constexpr int weightTotal = 20;
+        LootRef BuildListFrom(const char* purpose, const std::vector<LootRef>& items, uint8_t flags) { return BuildListFrom(purpose, items.data(), items.size(), flags); }
 
-        if (!nUsed)
-            ret = nullptr;
-        else {
-            for (int i = 0; i < 3; i++) {
-                if (lists[i]) lowerTier[i] = lists[i];
+        LootRef BuildContentList(const std::vector<RE::TESBoundObject*>& contents) {
+            if (!g_Config.bNormalizeModDrops) return BuildListFrom("Items", Items(contents), RE::TESLeveledList::kCalculateForEachItemInCount);
+
+            std::vector<LootRef> modLists;
+            for (const auto& i : GroupByFile(contents, [](RE::TESBoundObject* i) { return i->GetFile(0); })) {
+                modLists.push_back(BuildListFrom("Items", Items(i.second), RE::TESLeveledList::kCalculateForEachItemInCount));
             }
 
-            if (nUsed == 1) {
-                if (lists[0])
-                    ret = lists[0];  // If its a common, just always return the common
-                else {
-                    for (int i = 0; i < 3; i++) {
-                        if (!lists[i]) {
-                            lists[i] = lowerTier[i];
-                            nUsed++;
-                        }
-                    }
+            return BuildListFrom("Mod Grouped Items", modLists, RE::TESLeveledList::kCalculateForEachItemInCount);
+        }
 
-                    if (nUsed == 1) {
-                        for (int i = 1; i < 3; i++)
-                            if (lists[i]) {
-                                if (!g_Config.bEnableRarityNullLoot || i == 0)
-                                    ret = lists[i];
-                                else
-                                    ret = BuildListFrom("Rarity List", &lists[i], 1, RE::TESLeveledList::kCalculateForEachItemInCount,
-                                                        100 - (uint8_t)(100.f * (float)weight[i] / weightTotal));
-                                break;
-                            }
-                    }
+        LootRef BuildArmorSetList(const ArmorSet* set) {
+            if (auto cached = cacheSetList.Find(MakeMemoKey(set))) return *cached;
+
+            unsigned int covered = 0;
+            std::vector<LootRef> pieces;
+
+            for (auto i : *set) {
+                auto slots = (ArmorSlots)i->GetSlotMask();
+                if (!slots) continue;
+                if (covered & slots) continue;
+
+                std::vector<RE::TESObjectARMO*> conflicts;
+
+                // Two passes - first find potential conflicts, then pick them out
+                // This has to happen just to cover weird situations where pieces overlap inconsistently
+                // Technically would require repeating until it stops changing, but you'd have to design an armor set just
+                // to be obnoxious intentionally
+                for (auto j : *set) {
+                    auto slots2 = (ArmorSlots)j->GetSlotMask();
+                    if (slots & slots2) slots |= slots2;
+                }
+                for (auto j : *set) {
+                    auto slots2 = (ArmorSlots)j->GetSlotMask();
+                    if (slots & slots2) conflicts.push_back(j);
                 }
+
+                if (conflicts.size() > 1)
+                    pieces.push_back(BuildListFrom("Set Slot Randomization", Items(conflicts), 0));
+                else
+                    pieces.push_back(Item(i));
+
+                covered |= slots;
             }
 
-            if (!ret) {
-                std::vector<RE::TESBoundObject*> r;
+            return cacheSetList.Insert(MakeMemoKey(set), BuildListFrom("Armor Set", pieces, RE::TESLeveledList::kUseAll));
+        }
 
-                // Add most rare to least rare, letting it not add more rare entries if they don't exist
+        LootRef BuildContentList(const std::vector<const ArmorSet*>& contents) {
+            if (!g_Config.bNormalizeModDrops) {
+                std::vector<LootRef> sets;
 
-                bool bAdd = false;
-                for (int i = 2; i >= 0; i--) {
-                    if (lists[i]) {
-                        bAdd = true;
-                    }
+                for (auto i : contents) sets.push_back(BuildArmorSetList(i));
 
-                    if (bAdd && !(!lists[i] && !g_Config.bEnableRarityNullLoot)) AddListEntries(r, lowerTier[i], weight[i]);  // Lower tier will have current tier if appropriate
-                }
+                return BuildListFrom("Armor Sets List", sets, RE::TESLeveledList::kCalculateForEachItemInCount);
+            }
 
-                ret = BuildListFrom("Rarity List", r, RE::TESLeveledList::kCalculateForEachItemInCount);
+            std::vector<LootRef> modLists;
+            for (const auto& i : GroupByFile(contents, [](const ArmorSet* i) { return (*i)[0]->GetFile(0); })) {
+                std::vector<LootRef> sets;
+                for (auto j : i.second) sets.push_back(BuildArmorSetList(j));
+                modLists.push_back(BuildListFrom("Armor Sets List", sets, RE::TESLeveledList::kCalculateForEachItemInCount));
             }
+
+            return BuildListFrom("Mod Groupped Armor Sets List", modLists, RE::TESLeveledList::kCalculateForEachItemInCount);
         }
 
-        return g_Data.loot->cacheGroupList[cachePtr] = ret;
-    }
+        LootRef BuildGroupList(const LootContainerGroup::Rarities& contents, const LootContainerGroup::Rarities& fallback, LootRef* lowerTier, auto Fetch) {
+            auto key = MakeMemoKey(&Fetch(contents, 0));
+            if (auto cached = cacheGroupList.Find(key)) return *cached;  // Rarely hit, the regional group tier cache catches most repeats first
 
-    int GetGroupEntriesForLevel(int level, QuickArmorRebalance::LootDistGroup* group) {
-        auto r = group->level - level;
-        if (r > group->early) return 0;
-        if (r > 0) return (int)std::round(std::lerp(group->maxw, 1, (float)r / group->early));
-        r += group->peak;
-        if (r >= 0) return group->maxw;
+            LootRef ret;
 
-        r += group->falloff;
-        if (r > 0) return (int)std::round(std::lerp(group->minw, group->maxw, (float)r / group->falloff));
+            LootRef lists[3];
 
-        return group->minw;
-    }
+            int nUsed = 0;
+            for (int i = 0; i < 3; i++) {
+                if ((lists[i] = BuildContentList(!Fetch(contents, i).empty() ? Fetch(contents, i) : Fetch(fallback, i)))) nUsed++;
+            }
 
-    RE::TESForm* BuildCurve(int level, const std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*>& lists) {
-        if (lists.empty()) return nullptr;
-        if (lists.size() == 1) return lists.begin()->second;
+            constexpr int weight[] = {15, 4, 1};
+            constexpr int weightTotal = 20;
 
-        std::vector<RE::TESBoundObject*> entries;
+            if (nUsed) {
+                for (int i = 0; i < 3; i++) {
+                    if (lists[i]) lowerTier[i] = lists[i];
+                }
 
-        for (auto& i : lists) {
-            auto n = GetGroupEntriesForLevel(level, i.first);
-            // logger::info("{}[{}]: {}", i.first->name, level, n);
-            while (n-- > 0) entries.push_back(i.second);
-        }
+                if (nUsed == 1) {
+                    if (lists[0])
+                        ret = lists[0];  // If its a common, just always return the common
+                    else {
+                        for (int i = 0; i < 3; i++) {
+                            if (!lists[i]) {
+                                lists[i] = lowerTier[i];
+                                nUsed++;
+                            }
+                        }
 
-        return BuildListFrom("Level Curve", entries, 0);
-    }
+                        if (nUsed == 1) {
+                            for (int i = 1; i < 3; i++)
+                                if (lists[i]) {
+                                    if (!g_Config.bEnableRarityNullLoot || i == 0)
+                                        ret = lists[i];
+                                    else
+                                        ret = BuildListFrom("Rarity List", &lists[i], 1, RE::TESLeveledList::kCalculateForEachItemInCount,
+                                                            100 - (uint8_t)(100.f * (float)weight[i] / weightTotal));
+                                    break;
+                                }
+                        }
+                    }
+                }
 
-    RE::TESBoundObject* BuildCurveList(std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*> lists) {
-        if (lists.empty()) return nullptr;
-        if (lists.size() == 1) {
-            if (lists.begin()->first == nullptr)  // Only want to return the list directly if its unleveled - otherwise, we need a list just to have a min level
-                return lists.begin()->second;
-        }
+                if (!ret) {
+                    LootGraph::Weights r;
 
-        assert(!lists.contains(nullptr));
+                    // Add most rare to least rare, letting it not add more rare entries if they don't exist
 
-        std::vector<std::pair<uint16_t, RE::TESForm*>> curves;
+                    bool bAdd = false;
+                    for (int i = 2; i >= 0; i--) {
+                        if (lists[i]) {
+                            bAdd = true;
+                        }
 
-        int minLevel = 0xffff;
-        int maxLevel = 0;
+                        if (bAdd && !(!lists[i] && !g_Config.bEnableRarityNullLoot)) r.push_back({lowerTier[i], weight[i]});  // Lower tier will have current tier if appropriate
+                    }
 
-        for (auto& i : lists) {
-            minLevel = std::min(minLevel, i.first->level - i.first->early);
-            maxLevel = std::max(maxLevel, i.first->level + i.first->peak);
+                    ret = BuildWeightedList("Rarity List", std::move(r), RE::TESLeveledList::kCalculateForEachItemInCount);
+                }
+            }
+
+            return cacheGroupList.Insert(key, ret);
         }
 
-        minLevel = std::max(minLevel, 1);
-        maxLevel = std::min(maxLevel, 255);
+        LootRef BuildCurve(int level, const CurveLists& lists) {
+            if (lists.empty()) return {};
+            if (lists.size() == 1) return lists[0].second;
 
-        for (int level = minLevel; level <= maxLevel; level = level < maxLevel ? std::min(level + QuickArmorRebalance::g_Config.levelGranularity, maxLevel) : maxLevel + 1) {
-            auto curve = BuildCurve(level, lists);
+            LootGraph::Weights entries;
 
-            if (curve) curves.push_back({level, curve});
-        }
+            for (auto& i : lists) {
+                auto n = GetGroupEntriesForLevel(level, i.first);
+                if (n > 0) entries.push_back({i.second, (uint64_t)n});
+            }
 
-        auto list = CreateLeveledList("Level Curve Selection");
-        list->llFlags = RE::TESLeveledList::kCalculateForEachItemInCount;
-        list->entries.resize(list->numEntries = (uint8_t)curves.size());
-        for (int i = 0; i < list->numEntries; i++) {
-            auto& e = list->entries[i];
-            e.count = 1;
-            e.form = curves[i].second;
-            e.level = curves[i].first;
-            e.itemExtra = nullptr;
+            return BuildWeightedList("Level Curve", std::move(entries), 0);
         }
 
-        return list;
-    }
+        LootRef BuildCurveList(const CurveLists& lists) {
+            if (lists.empty()) return {};
+            if (lists.size() == 1) {
+                if (lists[0].first == nullptr)  // Only want to return the list directly if its unleveled - otherwise, we need a list just to have a min level
+                    return lists[0].second;
+            }
 
-    void FillContents(const std::map<RE::TESForm*, QuickArmorRebalance::ContainerChance>& containers, RE::TESBoundObject* curveList, const EnchantProbability& enchBase) {
-        if (!curveList) return;
+            LootNode node{"Level Curve Selection", RE::TESLeveledList::kCalculateForEachItemInCount, 0, {}};
 
-        std::map<int, RE::TESBoundObject*> chances;
+            int minLevel = 0xffff;
+            int maxLevel = 0;
 
-        for (auto& entry : containers) {
-            if (entry.second.chance <= 0) continue;
+            for (auto& i : lists) {
+                minLevel = std::min(minLevel, i.first->level - i.first->early);
+                maxLevel = std::max(maxLevel, i.first->level + i.first->peak);
+            }
 
-            auto list = chances[entry.second.chance];
-            if (!list) {
-                auto chance = std::clamp((int)std::round(entry.second.chance * QuickArmorRebalance::g_Config.fDropRates / 100.0f), 1, 100);
-                if (chance < 100) {
-                    chances[entry.second.chance] = list =
-                        BuildListFrom("Chance", &curveList, 1, RE::TESLeveledList::kCalculateForEachItemInCount, (int8_t)(100 - entry.second.chance));
-                } else {
-                    chances[entry.second.chance] = list = curveList;  // No reason to make an intermediate table at 100%
+            minLevel = std::max(minLevel, 1);
+            maxLevel = std::min(maxLevel, 255);
+
+            int nCollapsed = 0;
+            for (int level = minLevel; level <= maxLevel; level = level < maxLevel ? std::min(level + g_Config.levelGranularity, maxLevel) : maxLevel + 1) {
+                auto curve = BuildCurve(level, lists);
+                if (!curve) continue;
+
+                // An entry holds until the next one's level, so a run of levels with the same curve (like through a peak) only needs its first
+                if (!node.entries.empty() && node.entries.back().ref == curve) {
+                    nCollapsed++;
+                    continue;
                 }
+
+                node.entries.push_back({curve, (uint16_t)level});
             }
 
-            if (auto container = entry.first->As<RE::TESContainer>()) {
-                container->AddObjectToContainer(list, entry.second.count, nullptr);
-
-                // Adding
-                auto& ench = g_Data.distContainers[container];
-
-                // Record the enchantment rates
-                // This is a mess because we need to store defaults, but we can also have multiple entries
-                // Only proper way to ensure a specific enchantment setup is having all container references have the same enchantment rates
-                if (!entry.second.ench.IsDefault()) {
-                    if (ench.IsDefault() || ench == enchBase) {
-                        ench = entry.second.ench;
-                        ench.enchPower *= enchBase.enchPower;
-                        ench.enchRate *= enchBase.enchRate;
-                    } else {  // potentially conflicting entries, just take the more favorable of the two
-                        ench.enchRate = std::max(ench.enchRate, entry.second.ench.enchRate * enchBase.enchRate);
-                        ench.enchPower = std::max(ench.enchPower, entry.second.ench.enchPower * enchBase.enchPower);
-                    }
-                } else if (!enchBase.IsDefault()) {
-                    if (ench.IsDefault()) ench = enchBase;
-                    // Else it is either enchBase, or it's been modified by something else - just leave it alone
-                }
+            if (nCollapsed) Profiler::Get()->Count("Level curve entries collapsed", nCollapsed);
 
-                for (auto copyTo : g_Data.loot->mapContainerCopy[entry.first]) {
-                    if (auto containerCopy = copyTo->As<RE::TESContainer>()) {
-                        containerCopy->AddObjectToContainer(list, entry.second.count, nullptr);
-                        g_Data.distContainers[containerCopy] = ench;
-                    }
-                }
-            } else if (auto llist = entry.first->As<RE::TESLevItem>()) {
-                if (llist->numEntries < kLLMaxSize) {
-                    llist->entries.resize(llist->entries.size() + 1);
+            return graph.AddNode(std::move(node));
+        }
 
-                    auto& e = llist->entries.back();
-                    e.count = (uint16_t)entry.second.count;
-                    e.form = list;
-                    e.level = 1;
-                    e.itemExtra = nullptr;
+        // Shared by every container group, region and tier fill with the same curve list and final drop chance, the container's chance
+        // scaled by fDropRates. That's also the chance the list is given, so fDropRates changes the odds and not just which containers
+        // get a chance list at all
+        LootRef ChanceList(LootRef curveList, int chance) {
+            if (chance >= 100) return curveList;  // No reason to make an intermediate table at 100%
 
-                    llist->numEntries++;
+            auto key = MakeMemoKey(curveList, chance);
+            if (auto cached = cacheChanceList.Find(key)) return *cached;
+
+            return cacheChanceList.Insert(key, BuildListFrom("Chance", &curveList, 1, RE::TESLeveledList::kCalculateForEachItemInCount, (uint8_t)(100 - chance)));
+        }
+
+        // Containers cloned from this one, as targets in container order
+        const std::vector<std::uint32_t>& CopyTargets(RE::TESForm* form) {
+            auto [targets, bNew] = cacheCopyTargets.FindOrInsert(MakeMemoKey(form));
+            if (!bNew) return *targets;
+
+            if (auto copies = MapFind(g_Data.loot->mapContainerCopy, form)) {
+                std::vector<RE::TESForm*> copyTo(copies->begin(), copies->end());
+                std::sort(copyTo.begin(), copyTo.end(), [](auto a, auto b) { return a->GetFormID() < b->GetFormID(); });
+
+                for (auto i : copyTo) {
+                    if (i->As<RE::TESContainer>()) targets->push_back(graph.AddTarget(i, i->GetFormID(), i->GetName(), false));
                 }
             }
+            return *targets;
         }
-    }
 
-    /*
-void BuildSetLists() {
-for (const auto& i : QuickArmorRebalance::g_Data.loot->containerGroups) {
-    auto& group = i.second;
-    if (!group.small.empty()) {
-        std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*> contentsLists;
-        for (auto& j : group.pieces) {
-            if (auto list = BuildGroupList(j.second)) contentsLists[j.first] = list;
-        }
+        void FillContents(const LootContainerGroup::ContainerChanceMap& containers, LootRef curveList, const EnchantProbability& enchBase, std::uint32_t order) {
+            if (!curveList) return;
 
-        if (auto pieceList = BuildCurveList(std::move(contentsLists))) {
-            FillContents(group.small, pieceList, group.ench);
-        }
-    }
+            std::vector<const LootContainerGroup::ContainerChanceMap::value_type*> entries;
+            for (auto& entry : containers) entries.push_back(&entry);
+            std::sort(entries.begin(), entries.end(), [](auto a, auto b) { return a->first->GetFormID() < b->first->GetFormID(); });
 
-    if (!group.large.empty()) {
-        std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*> contentsLists;
-        for (auto& j : group.sets) {
-            if (auto list = BuildGroupList(j.second)) contentsLists[j.first] = list;
-        }
+            for (auto entry : entries) {
+                if (entry->second.chance <= 0) continue;
 
-        if (auto pieceList = BuildCurveList(std::move(contentsLists))) {
-            FillContents(group.large, pieceList, group.ench);
-        }
-    }
+                auto list = ChanceList(curveList, std::clamp((int)std::round(entry->second.chance * g_Config.fDropRates / 100.0f), 1, 100));
 
-    if (!group.weapon.empty()) {
-        std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*> contentsLists;
-        for (auto& j : group.weapons) {
-            if (auto list = BuildGroupList(j.second)) contentsLists[j.first] = list;
-        }
+                auto form = entry->first;
+                bool bList = !form->As<RE::TESContainer>();
+                if (bList && !form->As<RE::TESLevItem>()) continue;
 
-        if (auto pieceList = BuildCurveList(std::move(contentsLists))) {
-            FillContents(group.weapon, pieceList, group.ench);
+                LootAttachment attachment;
+                attachment.target = graph.AddTarget(form, form->GetFormID(), form->GetName(), bList);
+                attachment.ref = list;
+                attachment.count = (std::uint16_t)entry->second.count;
+                attachment.order = order;
+                attachment.ench = {entry->second.ench.enchRate, entry->second.ench.enchPower};
+                attachment.enchBase = {enchBase.enchRate, enchBase.enchPower};
+                graph.Attach(attachment);
+
+                auto source = attachment.target;
+                for (auto i : CopyTargets(form)) {
+                    attachment.target = i;
+                    attachment.enchFrom = source;
+                    graph.Attach(attachment);
+                }
+            }
         }
-    }
-}
-}
-    */
 
-    /*
-    RE::TESBoundObject* BuildRegionalGroupCurveList(ELootType lootType, LootContainerGroup* group, Region* region) {
-        RE::TESBoundObject* ret = nullptr;
-        if (!group->contents.contains(region)) region = nullptr;
+        LootRef BuildRegionalGroupTierList(LootContainerGroup* group, Region* region, LootDistGroup* tier) {
+            // Read whether it's found or falls back, adding items where there were none changes that
+            feeds.push_back(LootFeed(group, region, tier));
+            feeds.push_back(LootFeed(group, nullptr, tier));
 
-        if (MapFind(g_Data.loot->tblRegionSourceCurveCache[lootType][region], group, ret)) return ret;
+            // Looked up rather than inserted, the container groups are shared between the planners
+            static const LootContainerGroup::Rarities kNoItems{};
 
-        std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*> contentsLists;
+            const LootContainerGroup::Rarities* rarities = nullptr;
+            const LootContainerGroup::Rarities* fallback = nullptr;
 
-        for (auto& tier : group->contents[region]) {
-            auto& fallback = group->contents[nullptr][tier.first];
+            if (auto defaultTiers = MapFind(group->contents, nullptr)) fallback = MapFind(*defaultTiers, tier);
+            if (!fallback) fallback = &kNoItems;
+
+            if (auto regionTiers = MapFind(group->contents, region)) {
+                rarities = MapFind(*regionTiers, tier);
+            }
 
-            // auto Builder = [](const LootContainerGroup::Rarities& contents, const LootContainerGroup::Rarities& fallback, int rarity) {
-            //     return BuildContentList(!contents[rarity].weapons.empty() ? contents[rarity].weapons : fallback[rarity].weapons);
-            // };
+            if (!rarities) rarities = fallback;
 
-            RE::TESBoundObject* list = nullptr;
+            auto key = MakeMemoKey(rarities);
+            if (auto cached = cacheRegionalGroupTierList.Find(key)) return *cached;
+
+            LootRef list;
+            // Written through by BuildGroupList, nothing it calls adds to this cache so the slot stays put
+            auto lowerTier = cacheLowerTierItems.FindOrInsert(MakeMemoKey(group, region)).first->data();
 
             switch (lootType) {
                 case eLoot_Set: {
-                    list = BuildGroupList(tier.second, fallback, [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].sets; });
+                    list = BuildGroupList(*rarities, *fallback, lowerTier, [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].sets; });
                 } break;
                 case eLoot_Armor: {
-                    list = BuildGroupList(tier.second, fallback, [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].pieces; });
+                    list = BuildGroupList(*rarities, *fallback, lowerTier, [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].pieces; });
                 } break;
                 case eLoot_Weapon: {
-                    list = BuildGroupList(tier.second, fallback, [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].weapons; });
+                    list = BuildGroupList(*rarities, *fallback, lowerTier, [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].weapons; });
                 } break;
             }
 
-            if (list) contentsLists[tier.first] = list;
+            return cacheRegionalGroupTierList.Insert(key, list);
         }
 
-        return g_Data.loot->tblRegionSourceCurveCache[lootType][region][group] = BuildCurveList(contentsLists);
-    }
-    */
+        LootRef BuildSourceSelectionList(LootContainerGroup& group, Region* region, LootDistGroup* tier) {
+            auto key = MakeMemoKey(tier, &group, region);
+            if (auto cached = cacheSourceSelectionList.Find(key)) {
+                // Read again by this root, even though an earlier one did the reading
+                auto& read = *sourceSelectionFeeds.Find(key);
+                feeds.insert(feeds.end(), read.begin(), read.end());
+                return *cached;
+            }
 
-    RE::TESBoundObject* BuildRegionalGroupTierList(ELootType lootType, LootContainerGroup* group, Region* region, LootDistGroup* tier) {
-        const LootContainerGroup::Rarities* rarities = nullptr;
+            auto first = feeds.size();
+            auto list = PlanSourceSelectionList(group, region, tier);
+            sourceSelectionFeeds[key].assign(feeds.begin() + first, feeds.end());
+            return cacheSourceSelectionList.Insert(key, list);
+        }
 
-        auto& fallback = group->contents[nullptr][tier];
+        LootRef PlanSourceSelectionList(LootContainerGroup& group, Region* region, LootDistGroup* tier) {
+            if (!g_Config.bEnableMigratedLoot) return BuildRegionalGroupTierList(&group, region, tier);
 
-        if (auto regionTiers = MapFind(group->contents, region)) {
-            rarities = MapFind(*regionTiers, tier);
-        }
+            LootGraph::Weights entries;
+            for (int i = 0; i < eRegion_RarityCount; i++) {
+                std::vector<LootRef> groupList;
+                for (auto iGroup : SortedByName(group.migration[i])) {
+                    if ((!iGroup->regions.empty() && !iGroup->regions.contains(region))) continue;
 
-        if (!rarities) rarities = &fallback;
+                    if (auto list = BuildRegionalGroupTierList(iGroup, region, tier)) groupList.push_back(list);
+                }
 
-        RE::TESBoundObject* ret = nullptr;
-        auto cachePtr = rarities;
-        if (MapFind(g_Data.loot->cacheRegionalGroupTierList[lootType], cachePtr, ret)) {
-            // Cache actively used
-            // logger::info("RegionalGroupTierList cache used");
-            return ret;
+                if (groupList.empty()) continue;
+                entries.push_back({BuildListFrom("Group Selection", groupList, 0), (uint64_t)std::max(0, g_Config.nMigrationRarityEntries[i])});
+            }
+
+            return BuildWeightedList("Group Rarity Selection", std::move(entries), 0);
         }
 
-        std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*> contentsLists;
+        LootRef BuildRegionSelectionList(LootContainerGroup& group, Region* region, LootDistGroup* tier) {
+            if (!region) {
+                logger::info("FIXME");
+                return {};
+            }
 
-        RE::TESBoundObject* list = nullptr;
+            if (!g_Config.bEnableRegionalLoot || !g_Config.bEnableCrossRegionLoot) {
+                return BuildSourceSelectionList(group, region, tier);
+            }
 
-        switch (lootType) {
-            case eLoot_Set: {
-                list = BuildGroupList(*rarities, fallback, g_Data.loot->cacheLowerTierItems[lootType][group][region],
-                                      [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].sets; });
-            } break;
-            case eLoot_Armor: {
-                list = BuildGroupList(*rarities, fallback, g_Data.loot->cacheLowerTierItems[lootType][group][region],
-                                      [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].pieces; });
-            } break;
-            case eLoot_Weapon: {
-                list = BuildGroupList(*rarities, fallback, g_Data.loot->cacheLowerTierItems[lootType][group][region],
-                                      [](const LootContainerGroup::Rarities& items, int rarity) -> auto& { return items[rarity].weapons; });
-            } break;
-        }
+            LootGraph::Weights entries;
+            for (int i = 0; i < eRegion_RarityCount; i++) {
+                std::vector<LootRef> regionList;
+                for (auto iRegion : SortedByName(region->rarity[i])) {
+                    if (!iRegion->IsValid()) {
+                        continue;
+                    }
 
-        return g_Data.loot->cacheRegionalGroupTierList[lootType][cachePtr] = list;
-    }
+                    if (auto list = BuildSourceSelectionList(group, iRegion, tier)) regionList.push_back(list);
+                }
 
-    RE::TESBoundObject* BuildSourceSelectionList(ELootType lootType, LootContainerGroup& group, Region* region, LootDistGroup* tier) {
-        RE::TESBoundObject* ret = nullptr;
-        // if (MapFind(g_Data.loot->tblRegionSourceCache[lootType][region], &group, ret)) return ret;
-        auto& cache = g_Data.loot->cacheSourceSelectionList[lootType][tier][&group];
-        auto cachePtr = region;
-        if (MapFind(cache, cachePtr, ret)) {
-            // logger::info("SourceSelectionList cache used");
-            return ret;
-        }
+                if (regionList.empty()) continue;
+                entries.push_back({BuildListFrom("Region Selection", regionList, 0), (uint64_t)std::max(0, g_Config.nRegionRarityEntries[i])});
+            }
 
-        if (!g_Config.bEnableMigratedLoot) {
-            return cache[cachePtr] = BuildRegionalGroupTierList(lootType, &group, region, tier);
+            return BuildWeightedList("Region Rarity Selection", std::move(entries), 0);
         }
 
-        std::vector<RE::TESBoundObject*> entries;
-        for (int i = 0; i < eRegion_RarityCount; i++) {
-            std::vector<RE::TESBoundObject*> groupList;
-            for (auto iGroup : group.migration[i]) {
-                if ((!iGroup->regions.empty() && !iGroup->regions.contains(region))) continue;
+        LootRef BuildRegionalCurveSelectionList(LootContainerGroup& group, Region* region) {
+            if (!group.bLeveled) return BuildRegionSelectionList(group, region, nullptr);
 
-                if (auto list = BuildRegionalGroupTierList(lootType, iGroup, region, tier)) groupList.push_back(list);
+            CurveLists contentsLists;
+            for (auto tier : g_Data.distGroupsSorted) {
+                if (auto list = BuildRegionSelectionList(group, region, tier)) contentsLists.push_back({tier, list});
             }
 
-            if (groupList.empty()) continue;
-            AddListEntries(entries, BuildListFrom("Group Selection", groupList, 0), g_Config.nMigrationRarityEntries[i]);
+            return BuildCurveList(contentsLists);
         }
 
-        // logger::info("Building list for [{}] {} - {} - {}", (int)lootType, group.name, region ? region->name : "<universal>", tier ? tier->name : "<unleveled>");
+        void PlanContainerGroup(const std::string& groupName, LootContainerGroup& group, std::uint32_t order) {
+            auto& regionContainers = lootType == eLoot_Set ? group.large : lootType == eLoot_Armor ? group.small : group.weapon;
 
-        return cache[cachePtr] = BuildListFrom("Group Rarity Selection", entries, 0);
-    }
+            std::vector<std::pair<Region*, const LootContainerGroup::ContainerChanceMap*>> regions;
+            for (auto& it : regionContainers) {
+                if (!it.second.empty()) regions.push_back({it.first, &it.second});
+            }
+            std::sort(regions.begin(), regions.end(), [](const auto& a, const auto& b) { return !a.first ? b.first != nullptr : b.first && a.first->name < b.first->name; });
 
-    RE::TESBoundObject* BuildRegionSelectionList(ELootType lootType, LootContainerGroup& group, Region* region, LootDistGroup* tier) {
-        if (!region) {
-            logger::info("FIXME");
-            return nullptr;
-        }
+            for (auto& it : regions) {
+                feeds.clear();
+
+                LootRef list;
+                if (auto reuse = reusableRoots.Find(MakeMemoKey(&group, it.first))) {
+                    auto& root = previous->roots[*reuse];
+                    list = graph.Import(previous->graph, root.list, imported);
+                    feeds = root.feeds;
+                    nReused++;
+                } else {
+                    list = BuildRegionalCurveSelectionList(group, it.first);
+                    std::sort(feeds.begin(), feeds.end());
+                    feeds.erase(std::unique(feeds.begin(), feeds.end()), feeds.end());
+                }
+                roots.push_back({&group, it.first, list, std::move(feeds)});
+
+                FillContents(*it.second, list, group.ench, order);
 
-        if (!g_Config.bEnableRegionalLoot || !g_Config.bEnableCrossRegionLoot) {
-            return BuildSourceSelectionList(lootType, group, region, tier);
+                if (list) graph.AddRoot(std::format("[{}] {} - {}", (int)lootType, groupName, it.first ? it.first->name : "<universal>"), list, groupName);
+            }
         }
 
-        std::vector<RE::TESBoundObject*> entries;
-        for (int i = 0; i < eRegion_RarityCount; i++) {
-            std::vector<RE::TESBoundObject*> regionList;
-            for (auto iRegion : region->rarity[i]) {
-                // if (!iRegion->IsValid() || (!group.regions.empty() && !group.regions.contains(iRegion))) continue;
-                if (!iRegion->IsValid()) {
-                    continue;
+        ELootType lootType;
+
+        const LootPlan* previous = nullptr;
+        FlatMap<MemoKey, std::uint32_t, MemoKeyHash> reusableRoots;  // Container group, region
+        std::vector<LootRef> imported;                                // What the last plan's nodes became in this one
+        std::uint32_t nReused = 0;
+
+        std::vector<MemoKey> feeds;                                                      // Read by the root being planned
+        FlatMap<MemoKey, std::vector<MemoKey>, MemoKeyHash> sourceSelectionFeeds;  // Same key as the cache
+
+        MemoCache<LootRef> cacheSetList;                         // Armor set
+        MemoCache<LootRef> cacheGroupList;                       // Rarity contents
+        MemoCache<LootRef> cacheRegionalGroupTierList;           // Rarity contents
+        MemoCache<LootRef> cacheSourceSelectionList;             // Tier, container group, region
+        MemoCache<std::array<LootRef, 3>> cacheLowerTierItems;   // Container group, region
+        MemoCache<LootRef> cacheChanceList;                      // Curve list, final chance
+        MemoCache<std::vector<std::uint32_t>> cacheCopyTargets;  // Container
+    };
+
+    // Plans every loot type and leaves what each planned in plans. With changed buckets and the plans from the last build, roots the
+    // changes don't reach are copied from those instead of planned again
+    LootGraph PlanContainerLootLists(std::vector<LootPlan>& plans, const LootFeeds* changed) {
+        // Merge any wrong regions into the generic one up front, the planners only read the container groups
+        for (auto& i : g_Data.loot->containerGroups) {
+            auto& group = i.second;
+            if (group.regions.empty()) continue;
+
+            auto Merge = [&](std::map<Region*, LootContainerGroup::ContainerChanceMap>& containers) {
+                auto& d = containers[nullptr];
+                for (auto& it : containers) {
+                    if (it.first && !it.second.empty() && (!it.first->IsValid() || !group.regions.contains(it.first))) {
+                        logger::info("Container group '{}' has containers in external region '{}', merging into default group", i.first, it.first->name);
+                        d.insert(it.second.begin(), it.second.end());
+                        it.second.clear();
+                    }
                 }
+            };
 
-                if (auto list = BuildSourceSelectionList(lootType, group, iRegion, tier)) regionList.push_back(list);
-            }
+            Merge(group.large);
+            Merge(group.small);
+            Merge(group.weapon);
+        }
+
+        constexpr ELootType kLootTypes[] = {eLoot_Set, eLoot_Armor, eLoot_Weapon};
 
-            if (regionList.empty()) continue;
-            AddListEntries(entries, BuildListFrom("Region Selection", regionList, 0), g_Config.nRegionRarityEntries[i]);
+        std::vector<LootPlanner> planners;
+        planners.reserve(std::size(kLootTypes));
+        for (std::size_t i = 0; i < std::size(kLootTypes); i++) {
+            if (changed && i < plans.size())
+                planners.emplace_back(kLootTypes[i], plans[i], *changed);
+            else
+                planners.emplace_back(kLootTypes[i]);
         }
+        std::for_each(std::execution::par, planners.begin(), planners.end(), [](LootPlanner& planner) { planner.Plan(); });
 
-        return BuildListFrom("Region Rarity Selection", entries, 0);
-    }
+        std::uint32_t nReused = 0, nRoots = 0;
+        for (auto& planner : planners) {
+            nReused += planner.Reused();
+            nRoots += (std::uint32_t)planner.roots.size();
+        }
+        if (changed) {
+            Profiler::Get()->Count("Loot roots reused", nReused);
+            logger::info("{} of {} loot roots planned again, the rest copied from the last build", nRoots - nReused, nRoots);
+        }
 
-    RE::TESBoundObject* BuildRegionalCurveSelectionList(ELootType lootType, LootContainerGroup& group, Region* region) {
-        std::map<QuickArmorRebalance::LootDistGroup*, RE::TESBoundObject*> contentsLists;
+        std::map<std::string, MemoStats> memoStats;
+        for (auto& planner : planners) planner.AddMemoStats(memoStats);
+        for (auto& i : memoStats) {
+            auto& stats = i.second;
+            Profiler::Get()->Count(std::format("Loot memo {} hits", i.first).c_str(), stats.hits);
+            Profiler::Get()->Count(std::format("Loot memo {} misses", i.first).c_str(), stats.misses);
+            logger::info("Loot memo {}: {} hits, {} misses, {} inserted ({:.1f}% hit rate)", i.first, stats.hits, stats.misses, stats.inserts,
+                         stats.hits + stats.misses ? 100.0 * stats.hits / (stats.hits + stats.misses) : 0.0);
+        }
 
-        if (!group.bLeveled) return BuildRegionSelectionList(lootType, group, region, nullptr);
+        std::vector<LootPlan> planned;
+        for (auto& planner : planners) planned.push_back({planner.graph, std::move(planner.roots)});
+        plans = std::move(planned);
 
-        for (auto tier : g_Data.distGroupsSorted) {
-            // auto tier = &distGroup.second;
+        LootGraph graph;
+        for (auto& planner : planners) graph.Append(std::move(planner.graph));
 
-            auto list = BuildRegionSelectionList(lootType, group, region, tier);
-            if (list) contentsLists[tier] = list;
-        }
+        // Back to container group order, with each group's sets, then armor, then weapons
+        std::stable_sort(graph.attachments.begin(), graph.attachments.end(), [](const LootAttachment& a, const LootAttachment& b) { return a.order < b.order; });
+
+        return graph;
+    }
 
-        return BuildCurveList(contentsLists);
+    RE::TESBoundObject* ResolveLootRef(const LootGraph& graph, const std::vector<RE::TESLevItem*>& lists, LootRef ref) {
+        switch (ref.kind) {
+            case LootRef::kItem:
+                return static_cast<RE::TESBoundObject*>(graph.items[ref.index].form);
+            case LootRef::kNode:
+                return lists[ref.index];
+            default:
+                return nullptr;
+        }
     }
 
-    RE::TESBoundObject* BuildContainerGroupLoot(ELootType lootType, LootContainerGroup& group, LootContainerGroup::ContainerChanceMap& containers, Region* region) {
-        RE::TESBoundObject* contentsList = nullptr;
+    // Creates the forms for the whole graph at once, has to run on the main thread
+    using PlacedLoot = std::vector<std::pair<RE::TESBoundObject*, std::uint16_t>>;
+
+    // What the loot lists were last built from and what they put where, so changes made in game can be rebuilt in place
+    struct LootState {
+        bool bBuilt = false;
+
+        LootGraph graph;
+        std::vector<RE::TESLevItem*> lists;  // Form for each node
+        std::vector<RE::TESLevItem*> spare;  // Emptied lists nothing uses anymore, reused before creating more
+        RE::TESLevItem* empty = nullptr;     // Stands in for container entries that were taken out
+
+        std::unordered_map<RE::TESForm*, PlacedLoot> placed;                                  // Added to each container and leveled list, in attachment order
+        std::unordered_map<RE::TESContainer*, std::optional<EnchantProbability>> enchBefore;  // Enchantment rates from before any loot was added
+
+        std::map<RE::TESBoundObject*, ItemDistData> dist;  // Distribution the lists were built from
+        std::vector<LootPlan> plans;                       // Planned from it, by loot type
 
-        // contentsList = BuildRegionSelectionList(lootType, group, region);
-        contentsList = BuildRegionalCurveSelectionList(lootType, group, region);
+        // Entry arrays swapped out of containers and leveled lists. Never freed, since the game may be reading one on another thread,
+        // and only rebuilds in game swap any out
+        std::vector<RE::ContainerObject**> retiredObjects;
+        std::vector<RE::SimpleArray<RE::LEVELED_OBJECT>> retiredEntries;
+    };
+
+    LootState g_LootState;
+
+    struct MaterializeStats {
+        std::uint32_t created = 0;
+        std::uint32_t recycled = 0;
+        std::uint32_t kept = 0;
+    };
+
+    // Puts a filled in array in place of the list's entries. The count never covers more than the array being read has
+    void SwapLeveledEntries(RE::TESLevItem* list, RE::SimpleArray<RE::LEVELED_OBJECT>&& entries, LootState& state) {
+        auto n = (std::uint8_t)entries.size();
+        if (n < list->numEntries) list->numEntries = n;
 
-        FillContents(containers, contentsList, group.ench);
-        return contentsList;
+        if (!list->entries.empty()) state.retiredEntries.push_back(std::move(list->entries));
+        list->entries = std::move(entries);
+        list->numEntries = n;
     }
 
-    void BuildContainerLootLists() {
-        for (auto& i : QuickArmorRebalance::g_Data.loot->containerGroups) {
-            auto& group = i.second;
+    void WriteLeveledList(const LootGraph& graph, const std::vector<RE::TESLevItem*>& lists, const LootNode& node, RE::TESLevItem* list, LootState& state) {
+        RE::SimpleArray<RE::LEVELED_OBJECT> entries;
+        entries.resize(node.entries.size());
+        for (size_t j = 0; j < node.entries.size(); j++) {
+            auto& e = entries[j];
+            e.count = node.entries[j].count;
+            e.form = ResolveLootRef(graph, lists, node.entries[j].ref);
+            e.level = node.entries[j].level;
+            e.itemExtra = nullptr;
+        }
 
-            if (!group.regions.empty()) {
-                // Merge any wrong regions into the generic one
+        list->llFlags = (RE::TESLeveledList::Flag)node.flags;
+        list->chanceNone = node.chanceNone;
+        SwapLeveledEntries(list, std::move(entries), state);
+        // LogListContents(list);
+#ifdef TEST_FOR_DUPLICATE_LISTS
+        g_createdLists.push_back(list);
+#endif
+    }
 
-                auto Merge = [&](std::map<Region*, LootContainerGroup::ContainerChanceMap>& containers) {
-                    auto& d = containers[nullptr];
-                    for (auto& it : containers) {
-                        if (it.first && !it.second.empty() && (!it.first->IsValid() || !group.regions.contains(it.first))) {
-                            logger::info("Container group '{}' has containers in external region '{}', merging into default group", i.first, it.first->name);
-                            d.insert(it.second.begin(), it.second.end());
-                            it.second.clear();
-                        }
+    // Points the entries added last time at what should be there now, adding or blanking out entries when the count changed. Loot always
+    // gets entries of its own, so rewriting them never touches the count of something the container or list already had
+    PlacedLoot PlaceLoot(RE::TESForm* form, const PlacedLoot& before, const PlacedLoot& after, LootState& state) {
+        auto empty = state.empty;
+        PlacedLoot ret;
+        std::vector<std::pair<RE::TESBoundObject*, std::uint16_t>> adds;
+
+        if (auto container = form->As<RE::TESContainer>()) {
+            // Matched up by object from the end, where added entries go, so an entry the container had for the same object is left alone
+            std::vector<RE::ContainerObject*> slots(before.size());
+            std::vector<bool> used(container->numContainerObjects);
+            for (size_t i = before.size(); i-- > 0;) {
+                for (std::uint32_t j = container->numContainerObjects; j-- > 0;) {
+                    auto obj = container->containerObjects[j];
+                    if (!used[j] && obj && obj->obj == before[i].first) {
+                        used[j] = true;
+                        slots[i] = obj;
+                        break;
                     }
-                };
+                }
+            }
 
-                Merge(group.large);
-                Merge(group.small);
-                Merge(group.weapon);
+            for (size_t i = 0; i < std::max(slots.size(), after.size()); i++) {
+                auto slot = i < slots.size() ? slots[i] : nullptr;
+                auto place = i < after.size() ? after[i] : PlacedLoot::value_type{empty, 1};
+                if (slot) {
+                    slot->obj = place.first;
+                    slot->count = place.second;
+                    ret.push_back(place);
+                } else if (i < after.size())
+                    adds.push_back(place);
             }
 
-            auto Build = [&](ELootType lootType, const std::string& groupName, std::map<Region*, LootContainerGroup::ContainerChanceMap>& regionContainers) {
-                for (auto& it : regionContainers) {
-                    if (!it.second.empty()) {
-                        auto list = BuildContainerGroupLoot(lootType, group, it.second, it.first);
-#if RUN_DISTRIBUTION_TESTS > 0
-                        if (list) {
-                            auto name = std::format("[{}] {} - {}", (int)lootType, groupName.c_str(), it.first->name.c_str());
-                            g_TestList[name] = list;
-                        }
-#else
-                        // Reference params to make warnings go away
-                        list;
-                        groupName;
-#endif
+            // Not through AddObjectToContainer, which would merge into an entry the container has for the same object
+            if (!adds.empty()) {
+                auto n = container->numContainerObjects;
+                auto objects = RE::calloc<RE::ContainerObject*>(n + adds.size());
+                std::copy_n(container->containerObjects, n, objects);
+                for (size_t i = 0; i < adds.size(); i++) {
+                    objects[n + i] = new RE::ContainerObject(adds[i].first, adds[i].second);
+                    ret.push_back(adds[i]);
+                }
+
+                if (container->containerObjects) state.retiredObjects.push_back(container->containerObjects);
+                container->containerObjects = objects;
+                container->numContainerObjects = n + (std::uint32_t)adds.size();
+            }
+        } else if (auto llist = form->As<RE::TESLevItem>()) {
+            std::vector<int> slots(before.size(), -1);
+            std::vector<bool> used(llist->numEntries);
+            for (size_t i = before.size(); i-- > 0;) {
+                for (int j = llist->numEntries; j-- > 0;) {
+                    if (!used[j] && llist->entries[j].form == before[i].first) {
+                        used[j] = true;
+                        slots[i] = j;
+                        break;
                     }
                 }
-            };
+            }
+
+            for (size_t i = 0; i < std::max(slots.size(), after.size()); i++) {
+                auto slot = i < slots.size() ? slots[i] : -1;
+                auto place = i < after.size() ? after[i] : PlacedLoot::value_type{empty, 1};
+                if (slot >= 0) {
+                    llist->entries[slot].form = place.first;
+                    llist->entries[slot].count = place.second;
+                    ret.push_back(place);
+                } else if (i < after.size())
+                    adds.push_back(place);
+            }
 
-            Build(eLoot_Set, i.first, group.large);
-            Build(eLoot_Armor, i.first, group.small);
-            Build(eLoot_Weapon, i.first, group.weapon);
+            if (!adds.empty() && llist->numEntries < kLLMaxSize) {
+                auto n = std::min<size_t>(adds.size(), kLLMaxSize - llist->numEntries);
+
+                RE::SimpleArray<RE::LEVELED_OBJECT> entries;
+                entries.resize(llist->numEntries + n);
+                std::copy_n(llist->entries.begin(), llist->numEntries, entries.begin());
+                for (size_t i = 0; i < n; i++) {
+                    auto& e = entries[llist->numEntries + i];
+                    e.count = adds[i].second;
+                    e.form = adds[i].first;
+                    e.level = 1;
+                    e.itemExtra = nullptr;
+                    ret.push_back(adds[i]);
+                }
+
+                SwapLeveledEntries(llist, std::move(entries), state);
+            }
         }
+
+        return ret;
     }
-}
 
-void SampleItemDistribution(std::vector<RE::TESBoundObject*>& items, RE::TESForm* form, int level, int count) {
-    if (!form) return;
-    if (auto list = form->As<RE::TESLevItem>()) {
-        if (!list->numEntries) return;
-        if (((int)(RNG() % 100)) < list->chanceNone) return;
+    void ApplyLootEnchantment(const LootGraph& graph, const LootAttachment& attachment, RE::TESContainer* container) {
+        if (attachment.enchFrom != LootAttachment::kOwnEnch) {
+            auto source = static_cast<RE::TESForm*>(graph.targets[attachment.enchFrom].form);
+            g_Data.distContainers[container] = g_Data.distContainers[source->As<RE::TESContainer>()];
+            return;
+        }
 
-        if (list->llFlags & RE::TESLeveledList::kUseAll) {
-            for (int i = 0; i < list->numEntries; i++) SampleItemDistribution(items, list->entries[i].form, level, list->entries[i].count);
-        } else {
-            int lower = 0;
-            int upper = 0;
-            for (upper = 0; upper < list->numEntries && level >= list->entries[upper].level; upper++);
-            if (!upper) return;
-
-            if (!(list->llFlags & RE::TESLeveledList::kCalculateFromAllLevelsLTOrEqPCLevel)) {
-                lower = upper - 1;
-                const auto same = list->entries[lower].level;
-                if (list->entries[0].level == same) {
-                    lower = 0;
-                } else {
-                    do lower--;
-                    while (list->entries[lower].level == same);
-                    lower++;
-                }
+        EnchantProbability enchEntry{attachment.ench.rate, attachment.ench.power};
+        EnchantProbability enchBase{attachment.enchBase.rate, attachment.enchBase.power};
+
+        // Adding
+        auto& ench = g_Data.distContainers[container];
+
+        // Record the enchantment rates
+        // This is a mess because we need to store defaults, but we can also have multiple entries
+        // Only proper way to ensure a specific enchantment setup is having all container references have the same enchantment rates
+        if (!enchEntry.IsDefault()) {
+            if (ench.IsDefault() || ench == enchBase) {
+                ench = enchEntry;
+                ench.enchPower *= enchBase.enchPower;
+                ench.enchRate *= enchBase.enchRate;
+            } else {  // potentially conflicting entries, just take the more favorable of the two
+                ench.enchRate = std::max(ench.enchRate, enchEntry.enchRate * enchBase.enchRate);
+                ench.enchPower = std::max(ench.enchPower, enchEntry.enchPower * enchBase.enchPower);
+            }
+        } else if (!enchBase.IsDefault()) {
+            if (ench.IsDefault()) ench = enchBase;
+            // Else it is either enchBase, or it's been modified by something else - just leave it alone
+        }
+    }
+
+    // Creates the forms for a planned graph. Lists that come out the same as in the last graph materialized keep their form, lists that
+    // are gone get reused for new ones, and the entries added to containers last time are pointed at the new lists
+    MaterializeStats MaterializeLootGraph(const LootGraph& graph, LootState& state) {
+        MaterializeStats stats;
+        auto& old = state.graph;
+
+        // Nodes are in order, so children are always matched before their parents
+        std::vector<RE::TESLevItem*> lists(graph.nodes.size());
+        std::vector<std::optional<LootRef>> oldRefs(graph.nodes.size());
+        std::vector<bool> kept(old.nodes.size());
+
+        auto OldRef = [&](LootRef ref) -> std::optional<LootRef> {
+            switch (ref.kind) {
+                case LootRef::kItem:
+                    if (auto item = old.FindItem(graph.items[ref.index].form)) return item;
+                    return std::nullopt;
+                case LootRef::kNode:
+                    return oldRefs[ref.index];
+                default:
+                    return ref;
             }
+        };
 
-            if (list->llFlags & RE::TESLeveledList::kCalculateForEachItemInCount) {
-                while (count--) {
-                    const int i = lower + (RNG() % (upper - lower));
-                    SampleItemDistribution(items, list->entries[i].form, level, list->entries[i].count);
+        for (size_t i = 0; i < graph.nodes.size(); i++) {
+            auto node = graph.nodes[i];
+
+            bool bMatched = true;
+            for (auto& entry : node.entries) {
+                auto ref = OldRef(entry.ref);
+                if (!ref) {
+                    bMatched = false;
+                    break;
                 }
+                entry.ref = *ref;
+            }
+            if (!bMatched) continue;
+
+            if (auto prev = old.FindNode(node)) {
+                oldRefs[i] = prev;
+                lists[i] = state.lists[prev.index];
+                kept[prev.index] = true;
+                stats.kept++;
+            }
+        }
+
+        for (size_t i = 0; i < old.nodes.size(); i++) {
+            if (!kept[i]) state.spare.push_back(state.lists[i]);
+        }
+
+        for (size_t i = 0; i < graph.nodes.size(); i++) {
+            if (lists[i]) continue;
+
+            if (!state.spare.empty()) {
+                lists[i] = state.spare.back();
+                state.spare.pop_back();
+                stats.recycled++;
             } else {
-                const int i = lower + (RNG() % (upper - lower));
-                SampleItemDistribution(items, list->entries[i].form, level, count * list->entries[i].count);
+                lists[i] = CreateLeveledList(graph.nodes[i].purpose);
+                stats.created++;
             }
+
+            WriteLeveledList(graph, lists, graph.nodes[i], lists[i], state);
         }
-    } else if (auto item = form->As<RE::TESBoundObject>())
-        items.push_back(item);
-}
 
-void QuickArmorRebalance::SetupLootLists() {
-    if (g_Config.fDropRates <= 0.0f) {
-        logger::info("Skipping loot additions because drop rate is 0 or below");
-        return;
-    }
+        for (auto list : state.spare) {
+            if (list->numEntries) SwapLeveledEntries(list, {}, state);
+        }
 
-    logger::info("Processing loot additions");
+        std::unordered_map<RE::TESForm*, PlacedLoot> placed;
+        std::vector<RE::TESForm*> targets;
+        for (auto& attachment : graph.attachments) {
+            auto form = static_cast<RE::TESForm*>(graph.targets[attachment.target].form);
+            auto& place = placed[form];
+            if (place.empty()) targets.push_back(form);
+            place.push_back({ResolveLootRef(graph, lists, attachment.ref), attachment.count});
+        }
+
+        // Targets that lost all their loot still need their old entries blanked
+        for (auto& i : state.placed) {
+            if (!placed.contains(i.first)) targets.push_back(i.first);
+        }
+        std::sort(targets.begin() + placed.size(), targets.end(), [](auto a, auto b) { return a->GetFormID() < b->GetFormID(); });
+
+        static const PlacedLoot kNothingPlaced;
+        auto Placed = [](const std::unordered_map<RE::TESForm*, PlacedLoot>& map, RE::TESForm* form) -> const PlacedLoot& {
+            auto ret = MapFind(map, form);
+            return ret ? *ret : kNothingPlaced;
+        };
+
+        bool bNeedEmpty = false;
+        for (auto i : targets) bNeedEmpty |= Placed(state.placed, i).size() > Placed(placed, i).size();
+        if (bNeedEmpty && !state.empty) state.empty = CreateLeveledList("Removed Entries");
+
+        std::unordered_map<RE::TESForm*, PlacedLoot> placedNow;
+        for (auto i : targets) {
+            auto now = PlaceLoot(i, Placed(state.placed, i), Placed(placed, i), state);
+            if (!now.empty()) placedNow[i] = std::move(now);
+        }
+        state.placed = std::move(placedNow);
+
+        // Enchantment rates are worked out from scratch, starting from what containers had before any loot was added
+        for (auto& i : state.enchBefore) {
+            if (i.second)
+                g_Data.distContainers[i.first] = *i.second;
+            else
+                g_Data.distContainers.erase(i.first);
+        }
+
+        for (auto& attachment : graph.attachments) {
+            auto container = static_cast<RE::TESForm*>(graph.targets[attachment.target].form)->As<RE::TESContainer>();
+            if (!container) continue;
 
-    for (const auto& i : g_Data.loot->mapItemDist) {
-        auto& data = i.second;
-        for (auto c : data.profile->containerGroups) {
-            auto group = c->bLeveled ? data.group : nullptr;
-            auto& contents = c->contents[data.region][group][data.rarity];
-
-            if (data.piece) {
-                if (auto armor = data.piece->As<RE::TESObjectARMO>())
-                    contents.pieces.push_back(armor);
-                else if (auto weap = data.piece->As<RE::TESObjectWEAP>())
-                    contents.weapons.push_back(weap);
+            if (!state.enchBefore.contains(container)) {
+                auto ench = MapFind(g_Data.distContainers, container);
+                state.enchBefore[container] = ench ? std::optional(*ench) : std::nullopt;
             }
-            if (!data.set.empty()) contents.sets.push_back(&data.set);
+
+            ApplyLootEnchantment(graph, attachment, container);
+        }
+
+        state.graph = graph;
+        state.lists = std::move(lists);
+        return stats;
+    }
+
+    void ExportLootGraph(const LootGraph& graph) {
+        auto logsFolder = SKSE::log::log_directory();
+        if (!logsFolder) return;
+
+        auto path = *logsFolder / std::format("{} LootGraph.json", PLUGIN_NAME);
+        std::ofstream file(path);
+        if (!file) {
+            logger::warn("Could not open file to write {}", path.generic_string());
+            return;
         }
+
+        graph.WriteJSON(file);
+        logger::info("Loot graph written to {}", path.generic_string());
+
+        auto metrics = ComputeLootNodeMetrics(graph);
+
+        auto pathDOT = *logsFolder / std::format("{} LootGraph.dot", PLUGIN_NAME);
+        if (std::ofstream dot(pathDOT); dot)
+            WriteLootGraphDOT(graph, metrics, dot);
+        else
+            logger::warn("Could not open file to write {}", pathDOT.generic_string());
+
+        auto pathMetrics = *logsFolder / std::format("{} LootGraphMetrics.json", PLUGIN_NAME);
+        if (std::ofstream json(pathMetrics); json)
+            WriteLootGraphAdjacency(graph, metrics, json);
+        else
+            logger::warn("Could not open file to write {}", pathMetrics.generic_string());
+
+        auto summary = SummarizeLootGraph(graph, metrics);
+        logger::info("Loot graph: {} lists with {} entries over {} items, {} shared, max depth {}, max entries {}, max fan out {}, max reachable items {}", summary.nodes,
+                     summary.entries, summary.items, summary.shared, summary.maxDepth, summary.maxEntries, summary.maxFanOut, summary.maxReachableItems);
+    }
+
+    // Expected item counts for every container and level, worked out from the graph instead of rolling the lists
+    void ExportLootTables(const LootGraph& graph) {
+        auto logsFolder = SKSE::log::log_directory();
+        if (!logsFolder) return;
+
+        ScopedTimer timer("Export loot tables");
+        LootExpectation expectation(graph);
+
+        auto pathCSV = *logsFolder / std::format("{} LootTables.csv", PLUGIN_NAME);
+        if (std::ofstream file(pathCSV); file)
+            WriteLootTablesCSV(expectation, file);
+        else
+            logger::warn("Could not open file to write {}", pathCSV.generic_string());
+
+        auto pathJSON = *logsFolder / std::format("{} LootTables.json", PLUGIN_NAME);
+        if (std::ofstream file(pathJSON); file)
+            WriteLootTablesJSON(expectation, file);
+        else
+            logger::warn("Could not open file to write {}", pathJSON.generic_string());
+
+        logger::info("Loot tables written to {}", pathCSV.parent_path().generic_string());
     }
 
-    // Merge global items into regional item lists
-    for (auto& i : QuickArmorRebalance::g_Data.loot->containerGroups) {
-        auto& group = i.second;
-        auto& defaultRegion = group.contents[nullptr];
+    // Fills the container groups' contents from the item distribution
+    void DistributeLootItems() {
+        for (auto& i : g_Data.loot->containerGroups) i.second.contents.clear();
+
+        for (const auto& i : g_Data.loot->mapItemDist) {
+            auto& data = i.second;
+            for (auto c : data.profile->containerGroups) {
+                auto group = c->bLeveled ? data.group : nullptr;
+                auto& contents = c->contents[data.region][group][data.rarity];
+
+                if (data.piece) {
+                    if (auto armor = data.piece->As<RE::TESObjectARMO>())
+                        contents.pieces.push_back(armor);
+                    else if (auto weap = data.piece->As<RE::TESObjectWEAP>())
+                        contents.weapons.push_back(weap);
+                }
+                if (!data.set.empty()) contents.sets.push_back(&data.set);
+            }
+        }
+
+        // Merge global items into regional item lists
+        for (auto& i : g_Data.loot->containerGroups) {
+            auto& group = i.second;
+            auto& defaultRegion = group.contents[nullptr];
 
-        for (auto& regionContents : group.contents) {
-            if (!regionContents.first) continue;
+            for (auto& regionContents : group.contents) {
+                if (!regionContents.first) continue;
 
-            for (auto& tier : regionContents.second) {
-                for (int rarity = 0; rarity < 3; rarity++) {
-                    auto& items = tier.second[rarity];
+                for (auto& tier : regionContents.second) {
+                    for (int rarity = 0; rarity < 3; rarity++) {
+                        auto& items = tier.second[rarity];
 
-                    auto Merge = [&](auto& a, auto& b) { a.insert(a.end(), b.begin(), b.end()); };
+                        auto Merge = [&](auto& a, auto& b) { a.insert(a.end(), b.begin(), b.end()); };
 
-                    if (!items.pieces.empty()) Merge(items.pieces, defaultRegion[tier.first][rarity].pieces);
-                    if (!items.sets.empty()) Merge(items.sets, defaultRegion[tier.first][rarity].sets);
-                    if (!items.weapons.empty()) Merge(items.weapons, defaultRegion[tier.first][rarity].weapons);
+                        if (!items.pieces.empty()) Merge(items.pieces, defaultRegion[tier.first][rarity].pieces);
+                        if (!items.sets.empty()) Merge(items.sets, defaultRegion[tier.first][rarity].sets);
+                        if (!items.weapons.empty()) Merge(items.weapons, defaultRegion[tier.first][rarity].weapons);
+                    }
                 }
             }
         }
     }
 
-#ifdef TEST_FOR_DUPLICATE_LISTS
-    auto IdenticalLists = [](RE::TESLevItem* a, RE::TESLevItem* b) -> bool {
-        if (a->numEntries != b->numEntries) return false;
-        for (int i = 0; i < a->numEntries; i++) {
-            if (a->entries[i].form != b->entries[i].form) return false;
+    // Creates and fills in the forms for a planned graph, on the main thread
+    void ApplyLootLists(const LootGraph& graph) {
+        MaterializeStats stats;
+        {
+            ScopedTimer timer("Materialize container loot lists");
+            stats = MaterializeLootGraph(graph, g_LootState);
         }
-        return true;
-    };
+        UpdateDistEnchantmentTable();
+
+        std::uint32_t nDeduplicated = 0;
+        for (auto& i : graph.deduplicated) nDeduplicated += i.second;
+        Profiler::Get()->Count("Leveled lists deduplicated", nDeduplicated);
+
+        logger::info("Done processing loot, {} lists created, {} reused and {} unchanged from the last build, {} duplicates shared", stats.created, stats.recycled,
+                     stats.kept, nDeduplicated);
 
-    int nCopies = 0;
-    for (int i = 0; i < g_createdLists.size(); i++) {
-        for (int j = i + 1; j < g_createdLists.size(); j++) {
-            if (IdenticalLists(g_createdLists[i], g_createdLists[j])) {
-                logger::info("Duplicate list found");
-                nCopies++;
+        for (auto& i : g_nLLTypes) {
+            logger::info("   {} lists for {} ({} deduplicated)", i.second, i.first, MapFindOr(graph.deduplicated, i.first, 0u));
+        }
+        for (auto& i : graph.deduplicated) {
+            if (!g_nLLTypes.contains(i.first)) logger::info("   0 lists for {} ({} deduplicated)", i.first, i.second);
+        }
+        if (graph.approximated) logger::info("{} weighted lists rounded, largest change in odds {:.3f}%", graph.approximated, 100.0 * graph.maxApproximationError);
+
+#ifdef TEST_FOR_DUPLICATE_LISTS
+        auto IdenticalLists = [](RE::TESLevItem* a, RE::TESLevItem* b) -> bool {
+            if (a->numEntries != b->numEntries) return false;
+            for (int i = 0; i < a->numEntries; i++) {
+                if (a->entries[i].form != b->entries[i].form) return false;
+            }
+            return true;
+        };
+
+        int nCopies = 0;
+        for (int i = 0; i < g_createdLists.size(); i++) {
+            for (int j = i + 1; j < g_createdLists.size(); j++) {
+                if (IdenticalLists(g_createdLists[i], g_createdLists[j])) {
+                    logger::info("Duplicate list found");
+                    nCopies++;
+                }
             }
         }
-    }
-    logger::info("{} duplicate lists", nCopies);
+        logger::info("{} duplicate lists", nCopies);
 #endif
 
-    logger::trace("Building loot lists");
-    // BuildSetLists();
-    BuildContainerLootLists();
-    logger::info("Done processing loot, {} lists created", g_nLListsCreated);
+#if RUN_DISTRIBUTION_TESTS > 0
+        if (auto logsFolder = SKSE::log::log_directory()) {
+            logger::info("Running Distribution tests");
+
+            LootSimulationParams params;
+            params.rolls = RUN_DISTRIBUTION_TESTS;
+            for (int level = 1; level <= 51; level += 5) params.levels.push_back(level);
+
+            auto result = SimulateLoot(graph, params);
+            logger::info("Simulated {} rolls at {:.0f} rolls/s", result.rolls, result.RollsPerSecond());
 
-    for (auto& i : g_nLLTypes) {
-        logger::info("   {} lists for {}", i.second, i.first);
+            LootExpectation expectation(graph);
+            std::ofstream file(*logsFolder / std::format("{} LootSimulation.txt", PLUGIN_NAME));
+            WriteLootSimulationReport(graph, result, &expectation, file);
+        }
+#endif
+
+        g_nLLTypes.clear();
     }
 
-#if RUN_DISTRIBUTION_TESTS > 0
+    // Plans on the calling thread. The forms are changed on the main thread, right away while loading and through a task in game, where
+    // this runs on the UI thread and the game is reading the same containers and lists
+    void BuildLootLists(bool bInGame, const LootFeeds* changed = nullptr) {
+        logger::trace("Building loot lists");
+        LootGraph graph;
+        {
+            ScopedTimer timer("Plan container loot lists");
+            graph = PlanContainerLootLists(g_LootState.plans, changed);
+        }
 
-    logger::info("Running Distribution tests");
-
-    for (auto& i : g_TestList) {
-        for (int level = 1; level <= 51; level += 5) {
-            logger::info("{} - Level {}", i.first, level);
-            for (int n = 0; n < RUN_DISTRIBUTION_TESTS; n++) {
-                logger::info("   Test {}:", n + 1);
-                std::vector<RE::TESBoundObject*> items;
-                SampleItemDistribution(items, i.second, level, 1);
-                if (items.empty()) {
-                    logger::info("      Empty!");
-                } else {
-                    for (auto item : items) {
-                        logger::info("      {}", item->GetName());
-                    }
-                }
+        {
+            ScopedTimer timer("Flatten container loot lists");
+
+            LootBudget budget;
+            budget.maxDepth = g_Config.lootMaxDepth;
+            budget.maxRollEntries = g_Config.lootMaxRollEntries;
+
+            auto before = LootGroupCosts(graph);
+            auto flatten = FlattenLootGraph(graph, budget);
+            auto after = LootGroupCosts(graph);
+
+            Profiler::Get()->Count("Leveled lists flattened", flatten.flattened);
+            if (budget.maxDepth || budget.maxRollEntries)
+                logger::info("{} lists flattened to fit a nesting depth of {} and {} entries per roll (0 is unlimited), {} loot roots still over", flatten.flattened,
+                             budget.maxDepth, budget.maxRollEntries, flatten.overBudget);
+
+            // Worst case per roll for each container group, both come from the same roots in the same order
+            for (std::size_t i = 0; i < after.size() && i < before.size(); i++) {
+                logger::info("   {}: depth {} (was {}), up to {} entries per roll (was {})", after[i].first, after[i].second.depth, before[i].second.depth,
+                             after[i].second.entries, before[i].second.entries);
             }
         }
+
+        Profiler::Get()->Count("Loot graph nodes", graph.nodes.size());
+        Profiler::Get()->Count("Loot graph attachments", graph.attachments.size());
+
+        if (g_Config.bExportLootGraph) ExportLootGraph(graph);
+        if (g_Config.bExportLootTables) ExportLootTables(graph);
+
+        if (bInGame)
+            SKSE::GetTaskInterface()->AddTask([graph = std::move(graph)]() { ApplyLootLists(graph); });
+        else
+            ApplyLootLists(graph);
     }
+}
 
-#endif
+void QuickArmorRebalance::SetupLootLists() {
+    if (g_Config.fDropRates <= 0.0f) {
+        logger::info("Skipping loot additions because drop rate is 0 or below");
+        return;
+    }
+
+    logger::info("Processing loot additions");
+
+    DistributeLootItems();
+    g_LootState.dist = g_Data.loot->mapItemDist;
+
+    BuildLootLists(false);
+    g_LootState.bBuilt = true;
+}
+
+void QuickArmorRebalance::RebuildLootLists() {
+    if (!g_Data.loot || !g_LootState.bBuilt) return;
+
+    auto& dist = g_Data.loot->mapItemDist;
+
+    auto Same = [](const ItemDistData& a, const ItemDistData& b) {
+        return a.profile == b.profile && a.group == b.group && a.region == b.region && a.rarity == b.rarity && a.piece == b.piece && a.set == b.set;
+    };
 
-    g_nLLTypes.clear();
+    std::vector<RE::TESBoundObject*> changed;
+    for (auto& i : g_LootState.dist) {
+        auto now = MapFind(dist, i.first);
+        if (!now || !Same(*now, i.second)) changed.push_back(i.first);
+    }
+    for (auto& i : dist) {
+        if (!g_LootState.dist.contains(i.first)) changed.push_back(i.first);
+    }
+
+    if (changed.empty()) return;
+
+    ScopedTimer timer("Rebuild loot lists");
+    logger::info("Rebuilding loot lists for {} changed items", changed.size());
+
+    // The buckets each item was in before and is in now, in every container group its profile feeds
+    LootFeeds feeds;
+    auto AddFeeds = [&](const ItemDistData* data) {
+        if (!data || !data->profile) return;
+        for (auto c : data->profile->containerGroups) feeds.Insert(LootFeed(c, data->region, c->bLeveled ? data->group : nullptr));
+    };
+    for (auto item : changed) {
+        AddFeeds(MapFind(g_LootState.dist, item));
+        AddFeeds(MapFind(dist, item));
+    }
+
+    DistributeLootItems();
+    g_LootState.dist = dist;
+
+    // Only roots reading those buckets are planned again, materializing then reuses the forms and entries of lists that came out the same
+    BuildLootLists(true, &feeds);
 }
+
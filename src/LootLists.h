@@ -13,4 +13,7 @@ namespace QuickArmorRebalance {
     
 
     void SetupLootLists();
+    // Rebuilds the loot lists in place after item distribution changes made in game. Only plans again the loot the changed items feed,
+    // and only rewrites the lists that changed. Plans on the calling thread and changes the forms in a task on the main thread
+    void RebuildLootLists();
 }
\ No newline at end of file
@@ -0,0 +1,257 @@
+#include "LootSimulation.h"
+
+#include "FlatMap.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <iomanip>
+#include <numeric>
+#include <ostream>
+
+namespace {
+    using namespace QuickArmorRebalance;
+
+    constexpr std::uint32_t kRollsPerChunk = 1024;
+    constexpr std::uint32_t kNoSlot = ~0u;
+
+    using CountDistribution = LootSimulationResult::CountDistribution;
+
+    // One roll's count of each item, indexed by item, and which items it touched so only those are reset for the next roll
+    class Roller {
+    public:
+        Roller(const LootGraph& graph, int level, Random& rng) : graph(graph), level(level), rng(rng), counts(graph.items.size()) {}
+
+        void Resolve(LootRef ref, std::uint32_t count, int depth) {
+            if (ref.IsItem()) {
+                if (!counts[ref.index]) touched.push_back(ref.index);
+                counts[ref.index] += count;
+                return;
+            }
+            if (!ref.IsNode()) return;
+
+            maxDepth = std::max(maxDepth, depth + 1);
+
+            auto& list = graph.nodes[ref.index];
+            auto& entries = list.entries;
+            if (entries.empty()) return;
+            if (rng.Below(100) < list.chanceNone) return;
+
+            // Entries are in level order, same as the game keeps them
+            std::size_t lower = 0, upper = 0;
+            while (upper < entries.size() && level >= entries[upper].level) upper++;
+            if (!upper) return;
+
+            if (list.flags & LootGraph::kUseAll) {
+                for (std::size_t i = 0; i < upper; i++) Resolve(entries[i].ref, count * entries[i].count, depth + 1);
+                return;
+            }
+
+            if (!(list.flags & LootGraph::kCalculateFromAllLevelsLTOrEqPCLevel)) {
+                lower = upper - 1;
+                while (lower > 0 && entries[lower - 1].level == entries[upper - 1].level) lower--;
+            }
+
+            auto range = (std::uint32_t)(upper - lower);
+            if (list.flags & LootGraph::kCalculateForEachItemInCount) {
+                while (count--) {
+                    auto& entry = entries[lower + rng.Below(range)];
+                    Resolve(entry.ref, entry.count, depth + 1);
+                }
+            } else {
+                auto& entry = entries[lower + rng.Below(range)];
+                Resolve(entry.ref, count * entry.count, depth + 1);
+            }
+        }
+
+        void Reset() {
+            for (auto item : touched) counts[item] = 0;
+            touched.clear();
+            maxDepth = 0;
+        }
+
+        std::vector<std::uint32_t> counts;
+        std::vector<std::uint32_t> touched;
+        int maxDepth = 0;
+
+    private:
+        const LootGraph& graph;
+        int level;
+        Random& rng;
+    };
+
+    // Rolls that gave none of the item aren't counted as they happen, they're what's left of the total
+    struct ItemCounts {
+        std::uint32_t item;
+        std::uint64_t total = 0;
+        CountDistribution rolls{};
+    };
+
+    struct SimTask {
+        std::uint32_t table;
+        std::uint32_t rolls;
+
+        std::vector<ItemCounts> items;  // Only the items that came up
+        std::vector<std::uint64_t> depths;
+    };
+}
+
+QuickArmorRebalance::LootSimulationResult QuickArmorRebalance::SimulateLoot(const LootGraph& graph, const LootSimulationParams& params) {
+    LootSimulationResult result;
+
+    std::vector<std::vector<const LootAttachment*>> targetAttachments(graph.targets.size());
+    for (auto& attachment : graph.attachments) targetAttachments[attachment.target].push_back(&attachment);
+
+    std::vector<SimTask> tasks;
+    for (std::uint32_t target = 0; target < graph.targets.size(); target++) {
+        if (targetAttachments[target].empty()) continue;
+
+        for (auto level : params.levels) {
+            auto table = (std::uint32_t)result.tables.size();
+            result.tables.push_back({target, level, {}});
+
+            for (std::uint32_t rolls = 0; rolls < params.rolls; rolls += kRollsPerChunk) tasks.push_back({table, std::min(kRollsPerChunk, params.rolls - rolls), {}, {}});
+        }
+    }
+
+    std::vector<std::size_t> taskIds(tasks.size());
+    std::iota(taskIds.begin(), taskIds.end(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::for_each(std::execution::par, taskIds.begin(), taskIds.end(), [&](std::size_t n) {
+        auto& task = tasks[n];
+        auto& table = result.tables[task.table];
+
+        Random rng(MixHash(params.seed ^ MixHash(n + 1)));
+        Roller roller(graph, table.level, rng);
+        std::vector<std::uint32_t> slots(graph.items.size(), kNoSlot);  // Each item's place in task.items
+
+        for (std::uint32_t i = 0; i < task.rolls; i++) {
+            for (auto attachment : targetAttachments[table.target]) roller.Resolve(attachment->ref, attachment->count, 0);
+
+            for (auto item : roller.touched) {
+                auto& slot = slots[item];
+                if (slot == kNoSlot) {
+                    slot = (std::uint32_t)task.items.size();
+                    task.items.push_back({item});
+                }
+
+                auto count = roller.counts[item];
+                auto& counts = task.items[slot];
+                counts.total += count;
+                counts.rolls[std::min(count, LootSimulationResult::kCountBuckets - 1)]++;
+            }
+
+            if (task.depths.size() <= (std::size_t)roller.maxDepth) task.depths.resize(roller.maxDepth + 1);
+            task.depths[roller.maxDepth]++;
+            roller.Reset();
+        }
+    });
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Counts are integers, so merging in any order gives the same totals
+    std::vector<std::vector<ItemCounts>> totals(result.tables.size());
+    for (auto& task : tasks) {
+        auto& table = totals[task.table];
+        for (auto& item : task.items) {
+            auto it = std::lower_bound(table.begin(), table.end(), item.item, [](const ItemCounts& i, std::uint32_t item) { return i.item < item; });
+            if (it == table.end() || it->item != item.item) it = table.insert(it, {item.item});
+
+            it->total += item.total;
+            for (std::uint32_t i = 0; i < LootSimulationResult::kCountBuckets; i++) it->rolls[i] += item.rolls[i];
+        }
+
+        if (result.depths.size() < task.depths.size()) result.depths.resize(task.depths.size());
+        for (std::size_t i = 0; i < task.depths.size(); i++) result.depths[i] += task.depths[i];
+
+        result.rolls += task.rolls;
+    }
+
+    for (std::size_t i = 0; i < result.tables.size(); i++) {
+        auto& table = result.tables[i];
+        for (auto& item : totals[i]) {
+            table.average.push_back({item.item, (double)item.total / params.rolls});
+
+            auto& counts = table.counts.emplace_back(item.rolls);
+            counts[0] = params.rolls - std::accumulate(counts.begin() + 1, counts.end(), (std::uint64_t)0);
+        }
+    }
+
+    return result;
+}
+
+void QuickArmorRebalance::WriteLootSimulationReport(const LootGraph& graph, const LootSimulationResult& result, LootExpectation* expectation, std::ostream& os) {
+    os << std::fixed << std::setprecision(0);
+    os << "Simulated " << result.rolls << " rolls in " << result.seconds * 1000.0 << "ms (" << result.RollsPerSecond() << " rolls/s)\n\n";
+
+    os << std::setprecision(2);
+    os << "Deepest list nesting per roll:\n";
+    for (std::size_t i = 0; i < result.depths.size(); i++) {
+        if (result.depths[i]) os << "   " << i << ": " << result.depths[i] << " (" << 100.0 * result.depths[i] / std::max<std::uint64_t>(result.rolls, 1) << "%)\n";
+    }
+
+    double worst = 0.0;
+
+    os << std::setprecision(4);
+    const LootTarget* last = nullptr;
+    for (auto& table : result.tables) {
+        auto& target = graph.targets[table.target];
+        if (&target != last) os << "\n" << target.name << " [" << std::hex << std::uppercase << target.id << std::dec << "]\n";
+        last = &target;
+
+        os << "   Level " << table.level << ":\n";
+
+        LootCounts expected;
+        if (expectation) expected = expectation->ExpectedForTarget(table.target, table.level);
+
+        // Walk both sorted lists together so items that never came up still show against their expected count
+        auto itSim = table.average.begin();
+        auto itExp = expected.begin();
+        while (itSim != table.average.end() || itExp != expected.end()) {
+            std::uint32_t item;
+            double sim = 0.0, exp = 0.0;
+            const CountDistribution* counts = nullptr;
+            if (itExp == expected.end() || (itSim != table.average.end() && itSim->first < itExp->first)) {
+                item = itSim->first;
+                counts = &table.counts[itSim - table.average.begin()];
+                sim = (itSim++)->second;
+            } else if (itSim == table.average.end() || itExp->first < itSim->first) {
+                item = itExp->first;
+                exp = (itExp++)->second;
+            } else {
+                item = itSim->first;
+                counts = &table.counts[itSim - table.average.begin()];
+                sim = (itSim++)->second;
+                exp = (itExp++)->second;
+            }
+
+            os << "      " << graph.items[item].name << ": " << sim;
+            if (expectation) {
+                os << " (expected " << exp << ")";
+                worst = std::max(worst, std::abs(sim - exp));
+            }
+
+            // Share of rolls giving each number of copies, the last one meaning that many or more
+            if (counts) {
+                auto rolls = (double)std::max<std::uint64_t>(std::accumulate(counts->begin(), counts->end(), (std::uint64_t)0), 1);
+
+                os << std::setprecision(2) << " [";
+                bool bFirst = true;
+                for (std::uint32_t i = 0; i < LootSimulationResult::kCountBuckets; i++) {
+                    if (!(*counts)[i]) continue;
+
+                    os << (bFirst ? "" : ", ") << i << (i + 1 == LootSimulationResult::kCountBuckets ? "+" : "") << ": " << 100.0 * (*counts)[i] / rolls << "%";
+                    bFirst = false;
+                }
+                os << "]" << std::setprecision(4);
+            }
+            os << "\n";
+        }
+    }
+
+    if (expectation) os << "\nLargest difference from expected: " << worst << "\n";
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+#include "LootAnalysis.h"
+#include "LootGraph.h"
+
+/*////////////////////////////////////////////////////////////////////
+    Loot simulation
+
+    Rolls the containers in a loot graph the way the game resolves
+    leveled lists, spread over all cores. The rolls are split into fixed
+    chunks that each get their own random stream seeded from the run
+    seed and the chunk, so the same seed gives the same results however
+    many threads run it. Besides the average count of each item, keeps
+    how often a roll gave none, one, two and so on of it. Only depends
+    on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    struct LootSimulationParams {
+        std::uint64_t seed = 0;
+        std::uint32_t rolls = 10000;  // Per target and level
+        std::vector<int> levels;
+    };
+
+    struct LootSimulationResult {
+        static constexpr std::uint32_t kCountBuckets = 8;
+
+        // Rolls giving 0, 1, ... copies of an item, the last bucket counting kCountBuckets - 1 or more
+        using CountDistribution = std::array<std::uint64_t, kCountBuckets>;
+
+        struct Table {
+            std::uint32_t target = 0;
+            int level = 0;
+            LootCounts average;                       // Items per roll, by item index
+            std::vector<CountDistribution> counts;  // For the items in average, in the same order
+        };
+
+        std::vector<Table> tables;
+        std::vector<std::uint64_t> depths;  // Number of rolls by the deepest list nesting they reached
+        std::uint64_t rolls = 0;
+        double seconds = 0.0;
+
+        double RollsPerSecond() const { return seconds > 0.0 ? rolls / seconds : 0.0; }
+    };
+
+    LootSimulationResult SimulateLoot(const LootGraph& graph, const LootSimulationParams& params);
+
+    // Compares each item against its exact expected count when expectation is given
+    void WriteLootSimulationReport(const LootGraph& graph, const LootSimulationResult& result, LootExpectation* expectation, std::ostream& os);
+}
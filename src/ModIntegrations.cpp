@@ -207,8 +207,11 @@ void QuickArmorRebalance::ExportAllToDAV() {
 
 namespace {
     void ImportDAVFile(std::filesystem::path path) {
-        Document doc;
-        if (!ReadJSONFile(path, doc)) return;
+        JSONFile file;
+        file.path = path;
+        if (!ReadJSONFileInSitu(file)) return;
+
+        auto& doc = file.doc;
 
         if (!doc.IsObject() || !doc.HasMember("variants")) return;
 
@@ -1,6 +1,8 @@
 #include "ModelArmorSlotFix.h"
 
 #include "Data.h"
+#include "ModelPaths.h"
+#include "PublishedTable.h"
 
 /*////////////////////////////////////////////////////////////////////
     When changing armor slots, there's 3 places that need to be changed
@@ -15,12 +17,20 @@
 
     There is almost certainly a better way to do this, but this is lightweight enough
     that I don't feel the need to go digging deep into Skyrims code to find it
+
+    The hook runs for every skinned nif loaded, so it only ever reads from a
+    prebuilt table and never allocates. Tables are swapped out whole when
+    the slots change (see PublishedTable.h)
 *//////////////////////////////////////////////////////////////////////
 
 
 namespace {
     using namespace QuickArmorRebalance;
 
+    using ModelSlotTable = ModelPathTable<ArmorSlots>;
+
+    PublishedTable<ModelSlotTable> g_ModelSlotTable;
+
     struct BSDismemberSkinInstance_LoadBinary_Hook {
         static constexpr auto id = RE::VTABLE_BSDismemberSkinInstance[0];
         static constexpr auto offset = REL::Offset(0x18);
@@ -28,15 +38,14 @@ namespace {
         static void thunk(RE::BSDismemberSkinInstance* skin, RE::NiStream& a_stream) {
             func(skin, a_stream);
 
+            PublishedTable<ModelSlotTable>::Reader reader(g_ModelSlotTable);
+            auto table = reader.Get();
+            if (!table) return;
+
             constexpr std::string_view strPrefix{"data\\MESHES\\"};
             if (!strncmp(a_stream.inputFilePath, strPrefix.data(), strPrefix.length())) {
-                std::string modelPath(a_stream.inputFilePath + strPrefix.length());
-                ToLower(modelPath);
-
-                auto hash = std::hash<std::string>{}(modelPath);
-                auto it = g_Data.remapFileArmorSlots.find(hash);
-                if (it != g_Data.remapFileArmorSlots.end()) {
-                    auto slots = it->second;
+                if (auto pSlots = table->Find(a_stream.inputFilePath + strPrefix.length())) {
+                    auto slots = *pSlots;
                     auto missing = slots;
                     ArmorSlots availible = 0;
 
@@ -78,6 +87,15 @@ namespace {
 
 }
 
+void QuickArmorRebalance::UpdateModelArmorSlotTable() {
+    std::vector<std::pair<std::string_view, ArmorSlots>> entries;
+    entries.reserve(g_Data.remapFileArmorSlots.size());
+    for (auto& i : g_Data.remapFileArmorSlots) entries.emplace_back(g_Data.modelPaths.Get(i.first), i.second);
+
+    auto table = std::make_unique<ModelSlotTable>(entries);
+    g_ModelSlotTable.Publish(table->Size() ? std::move(table) : nullptr);
+}
+
 void QuickArmorRebalance::InstallModelArmorSlotFixHooks() {
     HookVirtualFunction<BSDismemberSkinInstance_LoadBinary_Hook>();
 }
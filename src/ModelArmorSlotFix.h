@@ -2,4 +2,5 @@
 
 namespace QuickArmorRebalance {
     void InstallModelArmorSlotFixHooks();
+    void UpdateModelArmorSlotTable();  // Call after remapFileArmorSlots changes
 }
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Model path lookups
+
+    Model paths get looked up from inside the nif loading code, so these
+    work directly on the raw C strings the game hands over without
+    building or lowercasing a copy first. Case folding is ASCII only,
+    which is all model paths use in practice, and either slash matches.
+
+    The path hash is fixed rather than std::hash so it's the same across
+    builds and can be saved. Only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    inline char FoldPathChar(char c) {
+        if (c >= 'A' && c <= 'Z') return c + ('a' - 'A');
+        return c == '/' ? '\\' : c;
+    }
+
+    // Case insensitive FNV-1a, streamed over the string as it's read
+    inline std::uint64_t HashModelPath(const char* str) {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (; *str; str++) {
+            hash ^= (std::uint8_t)FoldPathChar(*str);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    inline std::uint64_t HashModelPath(std::string_view str) {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (auto c : str) {
+            hash ^= (std::uint8_t)FoldPathChar(c);
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    inline bool ModelPathEquals(const char* a, std::string_view b) {
+        for (auto c : b) {
+            if (!*a || FoldPathChar(*a++) != FoldPathChar(c)) return false;
+        }
+        return !*a;
+    }
+
+    inline std::string NormalizeModelPath(std::string_view path) {
+        std::string str(path);
+        for (auto& c : str) c = FoldPathChar(c);
+        return str;
+    }
+
+    // Calls fn(normalizedPath, hash) for the path and, for weight variant models, its _0/_1 twin since the game loads either
+    template <class Fn>
+    void ForEachModelPathVariant(std::string_view path, Fn&& fn) {
+        auto str = NormalizeModelPath(path);
+        fn(std::string_view(str), HashModelPath(std::string_view(str)));
+
+        if (str.length() > 6) {
+            auto pChar = str.data() + str.length() - 6;  //'_X.nif'
+            if (*pChar++ == '_' && (*pChar == '0' || *pChar == '1')) {
+                *pChar = *pChar == '0' ? '1' : '0';
+                fn(std::string_view(str), HashModelPath(std::string_view(str)));
+            }
+        }
+    }
+
+    // Stores each normalized model path once, keyed by its hash
+    class ModelPathInterner {
+    public:
+        // Interns the path and its weight variant twin, calling fn(hash) for each
+        template <class Fn>
+        void InternVariants(std::string_view path, Fn&& fn) {
+            ForEachModelPathVariant(path, [&](std::string_view str, std::uint64_t hash) {
+                paths.try_emplace(hash, str);
+                fn(hash);
+            });
+        }
+
+        std::string_view Get(std::uint64_t hash) const {
+            auto it = paths.find(hash);
+            return it != paths.end() ? std::string_view(it->second) : std::string_view();
+        }
+
+        std::size_t Size() const { return paths.size(); }
+
+    private:
+        std::unordered_map<std::uint64_t, std::string> paths;
+    };
+
+    // Read only open addressing table of model paths, built once then swapped out whole when the paths change.
+    // Hits are confirmed with a full path compare so a hash collision can't remap the wrong model
+    template <class Value>
+    class ModelPathTable {
+    public:
+        template <class Range>
+        explicit ModelPathTable(const Range& entries) {
+            std::size_t n = 0, poolSize = 0;
+            for (auto& i : entries) {
+                n++;
+                poolSize += std::string_view(i.first).size();
+            }
+
+            std::size_t size = 16;
+            while (size < n * 2) size *= 2;
+            slots.resize(size);
+            mask = size - 1;
+
+            pool.reserve(poolSize);
+            for (auto& i : entries) Insert(std::string_view(i.first), i.second);
+        }
+
+        const Value* Find(const char* path) const { return Find(path, HashModelPath(path)); }
+
+        const Value* Find(const char* path, std::uint64_t hash) const {
+            for (auto i = hash & mask;; i = (i + 1) & mask) {
+                auto& slot = slots[i];
+                if (!slot.length) return nullptr;
+                if (slot.hash == hash && ModelPathEquals(path, std::string_view(pool).substr(slot.offset, slot.length))) return &slot.value;
+            }
+        }
+
+        std::size_t Size() const { return count; }
+
+    private:
+        void Insert(std::string_view path, const Value& value) {
+            if (path.empty()) return;
+
+            auto hash = HashModelPath(path);
+            for (auto i = hash & mask;; i = (i + 1) & mask) {
+                auto& slot = slots[i];
+                if (!slot.length) {
+                    slot = {hash, (std::uint32_t)pool.size(), (std::uint32_t)path.size(), value};
+                    pool.append(path);
+                    count++;
+                    return;
+                }
+
+                if (slot.hash == hash && slot.length == path.size()) {
+                    auto prev = std::string_view(pool).substr(slot.offset, slot.length);
+                    if (std::equal(prev.begin(), prev.end(), path.begin(), [](char a, char b) { return FoldPathChar(a) == FoldPathChar(b); })) {
+                        slot.value = value;
+                        return;
+                    }
+                }
+            }
+        }
+
+        struct Slot {
+            std::uint64_t hash = 0;
+            std::uint32_t offset = 0;
+            std::uint32_t length = 0;  // 0 for empty slots
+            Value value{};
+        };
+
+        std::vector<Slot> slots;
+        std::string pool;
+        std::size_t count = 0;
+        std::size_t mask = 0;
+    };
+}
@@ -0,0 +1,86 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+
+namespace {
+    void WriteJSONString(std::ostream& os, const char* str) {
+        os << '"';
+        for (auto p = str; *p; p++) {
+            auto c = (unsigned char)*p;
+            if (c == '"' || c == '\\')
+                os << '\\' << (char)c;
+            else if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                os << escaped;
+            } else
+                os << (char)c;
+        }
+        os << '"';
+    }
+
+    template <class... Args>
+    void Append(std::string& str, const char* fmt, Args... args) {
+        char line[256];
+        std::snprintf(line, sizeof(line), fmt, args...);
+        str += line;
+    }
+}
+
+std::string QuickArmorRebalance::Profiler::Summary() const {
+    std::lock_guard guard(lock);
+
+    long long total = 0;
+    for (auto& i : spans)
+        if (!i.depth && !i.thread && i.end >= 0) total += i.end - i.start;
+
+    std::string str;
+    Append(str, "%-48s %10s %7s\n", "Phase", "Time (ms)", "%");
+    for (auto& i : spans) {
+        if (i.end < 0) continue;
+        auto dur = i.end - i.start;
+        auto name = std::string(2 * i.depth, ' ') + i.name;
+        if (i.thread) name += " [" + std::to_string(i.thread) + "]";
+        Append(str, "%-48s %10.2f %6.1f%%\n", name.c_str(), 0.001 * dur, total ? 100.0 * dur / total : 0.0);
+    }
+
+    if (!counters.empty()) {
+        str += "\n";
+        for (auto& i : counters) Append(str, "%-48s %10lld\n", i.first.c_str(), i.second);
+    }
+
+    return str;
+}
+
+void QuickArmorRebalance::WriteProfilerTrace(const Profiler& profiler, const char* category, std::ostream& os) {
+    auto spans = profiler.GetSpans();
+    auto counters = profiler.GetCounters();
+
+    os << "{\"traceEvents\": [";
+    bool bFirst = true;
+
+    long long last = 0;
+    for (auto& i : spans) {
+        if (i.end < 0) continue;
+        last = std::max(last, i.end);
+
+        os << (bFirst ? "\n" : ",\n") << "{\"name\": ";
+        WriteJSONString(os, i.name);
+        os << ", \"cat\": ";
+        WriteJSONString(os, category);
+        os << ", \"ph\": \"X\", \"ts\": " << i.start << ", \"dur\": " << i.end - i.start << ", \"pid\": 1, \"tid\": " << i.thread << "}";
+        bFirst = false;
+    }
+
+    // Counters only have final totals, so they show up as a single sample at the end of the trace
+    for (auto& i : counters) {
+        os << (bFirst ? "\n" : ",\n") << "{\"name\": ";
+        WriteJSONString(os, i.first.c_str());
+        os << ", \"ph\": \"C\", \"ts\": " << last << ", \"pid\": 1, \"args\": {\"value\": " << i.second << "}}";
+        bFirst = false;
+    }
+
+    os << "\n], \"displayTimeUnit\": \"ms\"}\n";
+}
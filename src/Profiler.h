@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Startup profiler
+
+    Records nested timed spans and named counters so load times can be
+    broken down by phase, and formats them as a summary table or a
+    Chrome trace. Only depends on the standard library, so it also
+    builds on its own (see tools/ProfilerCheck.cpp). Where the reports
+    get written is up to the plugin
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    class Profiler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Span {
+            const char* name;
+            int depth;
+            unsigned int thread;
+            long long start;  // Microseconds since the profiler was created/reset
+            long long end;
+        };
+
+        static Profiler* Get() {
+            static Profiler singleton;
+            return &singleton;
+        }
+
+        size_t Begin(const char* name) {
+            std::lock_guard guard(lock);
+            spans.push_back({name, Depth()++, ThreadIndex(), Now(), -1});
+            return spans.size() - 1;
+        }
+
+        void End(size_t span) {
+            std::lock_guard guard(lock);
+            if (span >= spans.size()) return;
+            spans[span].end = Now();
+            Depth()--;
+        }
+
+        void Count(const char* name, long long n = 1) {
+            std::lock_guard guard(lock);
+            counters[name] += n;
+        }
+
+        long long GetCount(const char* name) const {
+            std::lock_guard guard(lock);
+            auto it = counters.find(name);
+            return it != counters.end() ? it->second : 0;
+        }
+
+        void Reset() {
+            std::lock_guard guard(lock);
+            spans.clear();
+            counters.clear();
+            threads.clear();
+            origin = Clock::now();
+        }
+
+        std::vector<Span> GetSpans() const {
+            std::lock_guard guard(lock);
+            return spans;
+        }
+
+        std::map<std::string, long long> GetCounters() const {
+            std::lock_guard guard(lock);
+            return counters;
+        }
+
+        // Text table of all spans in start order, indented by nesting depth
+        std::string Summary() const;
+
+    private:
+        Profiler() = default;
+
+        long long Now() const { return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - origin).count(); }
+
+        static int& Depth() {
+            thread_local int depth = 0;
+            return depth;
+        }
+
+        // Small stable per-thread ids, the first thread to record anything is 0
+        unsigned int ThreadIndex() {
+            auto id = std::this_thread::get_id();
+            auto it = threads.find(id);
+            if (it != threads.end()) return it->second;
+
+            auto n = (unsigned int)threads.size();
+            threads[id] = n;
+            return n;
+        }
+
+        mutable std::mutex lock;
+        Clock::time_point origin = Clock::now();
+        std::vector<Span> spans;
+        std::map<std::string, long long> counters;
+        std::map<std::thread::id, unsigned int> threads;
+    };
+
+    class ScopedTimer {
+    public:
+        ScopedTimer(const char* name) : span(Profiler::Get()->Begin(name)) {}
+        ~ScopedTimer() { Profiler::Get()->End(span); }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        size_t span;
+    };
+
+    // Chrome trace_event JSON (chrome://tracing, Perfetto) of the spans and counters recorded so far
+    void WriteProfilerTrace(const Profiler& profiler, const char* category, std::ostream& os);
+}
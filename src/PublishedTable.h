@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Published table
+
+    A read only table hooks look things up in while another thread may
+    swap it for a new one. Readers take a pointer with no lock and no
+    allocation. Swapped out tables are kept until a later swap sees no
+    reader, since one may have loaded the pointer just before the swap.
+    Only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    template <class Table>
+    class PublishedTable {
+    public:
+        // Held from before getting the table until done with it
+        class Reader {
+        public:
+            explicit Reader(const PublishedTable& published) : published(published) { published.readers.fetch_add(1); }
+            ~Reader() { published.readers.fetch_sub(1); }
+
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            const Table* Get() const { return published.current.load(); }
+
+        private:
+            const PublishedTable& published;
+        };
+
+        // From one thread at a time. A null table leaves readers with nothing to look up
+        void Publish(std::unique_ptr<Table> table) {
+            current.store(table.get());
+            if (owned) retired.push_back(std::move(owned));
+            owned = std::move(table);
+
+            // Both sequentially consistent with the reader's, so if no reader is registered now then any that registers later loads the
+            // pointer stored above
+            if (!readers.load()) retired.clear();
+        }
+
+        std::size_t Retired() const { return retired.size(); }
+
+    private:
+        std::atomic<const Table*> current = nullptr;
+        mutable std::atomic<int> readers = 0;
+
+        std::unique_ptr<Table> owned;
+        std::vector<std::unique_ptr<Table>> retired;
+    };
+}
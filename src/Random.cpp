@@ -0,0 +1,66 @@
+#include "Random.h"
+
+#include <atomic>
+#include <initializer_list>
+
+namespace {
+    using namespace QuickArmorRebalance;
+
+    constexpr std::uint64_t kGolden = 0x9e3779b97f4a7c15ull;
+
+    std::uint64_t Mix(std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    std::uint64_t SplitMix64(std::uint64_t& state) { return Mix(state += kGolden); }
+
+    std::atomic<std::uint64_t> g_seed{0};
+    std::atomic<std::uint32_t> g_seedGeneration{1};
+    std::atomic<std::uint64_t> g_threadCount{0};
+
+    struct ThreadState {
+        Random random;
+        std::uint32_t generation = 0;  // Seed generation the generator was last seeded from
+        std::uint64_t index = 0;
+        Random* scoped = nullptr;
+    };
+
+    thread_local ThreadState t_random;
+}
+
+void QuickArmorRebalance::Random::Seed(std::uint64_t seed) {
+    for (auto& i : s) i = SplitMix64(seed);
+}
+
+void QuickArmorRebalance::SeedRandom(std::uint64_t seed) {
+    g_seed.store(seed, std::memory_order_relaxed);
+    g_seedGeneration.fetch_add(1, std::memory_order_release);
+}
+
+std::uint64_t QuickArmorRebalance::GetRandomSeed() { return g_seed.load(std::memory_order_relaxed); }
+
+QuickArmorRebalance::Random& QuickArmorRebalance::ThreadRandom() {
+    auto& state = t_random;
+    if (state.scoped) return *state.scoped;
+
+    auto generation = g_seedGeneration.load(std::memory_order_acquire);
+    if (state.generation != generation) {
+        // Each thread keeps the index it was first given, so reseeding gives it a fresh stream that still differs from the others
+        if (!state.generation) state.index = g_threadCount.fetch_add(1, std::memory_order_relaxed);
+        state.random = StreamRandom(0x7468726561640000ull, state.index);  // "thread"
+        state.generation = generation;
+    }
+    return state.random;
+}
+
+QuickArmorRebalance::Random QuickArmorRebalance::StreamRandom(std::uint64_t key1, std::uint64_t key2, std::uint64_t key3) {
+    auto hash = Mix(g_seed.load(std::memory_order_relaxed) + kGolden);
+    for (auto key : {key1, key2, key3}) hash = Mix((hash ^ key) + kGolden);
+    return Random(hash);
+}
+
+QuickArmorRebalance::RandomScope::RandomScope(Random& random) : previous(t_random.scoped) { t_random.scoped = &random; }
+
+QuickArmorRebalance::RandomScope::~RandomScope() { t_random.scoped = previous; }
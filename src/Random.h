@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+/*////////////////////////////////////////////////////////////////////
+    Random numbers
+
+    xoshiro256** generators: one per thread for anything that just needs
+    randomness, and deterministic streams derived from the run seed and
+    whatever identifies a roll (a container reference and the game day,
+    say), so a roll from a log can be replayed. Every thread seeds its
+    own generator from the run seed on first use, nothing is shared or
+    locked after that. Only depends on the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    class Random {
+    public:
+        // Usable with the <random> distributions
+        using result_type = std::uint64_t;
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return ~0ull; }
+
+        explicit Random(std::uint64_t seed = 0) { Seed(seed); }
+
+        // Expands the seed with SplitMix64, so nearby seeds still give unrelated streams
+        void Seed(std::uint64_t seed);
+
+        result_type operator()() {
+            auto result = Rotl(s[1] * 5, 7) * 9;
+            auto t = s[1] << 17;
+
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = Rotl(s[3], 45);
+
+            return result;
+        }
+
+        // In [0, 1)
+        double Uniform() { return (double)((*this)() >> 11) * 0x1.0p-53; }
+        float UniformF() { return (float)((*this)() >> 40) * 0x1.0p-24f; }
+
+        // In [0, n), without modulo bias worth noticing for any n that fits
+        std::uint32_t Below(std::uint32_t n) { return (std::uint32_t)((((*this)() >> 32) * n) >> 32); }
+
+    private:
+        static std::uint64_t Rotl(std::uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+        std::uint64_t s[4];
+    };
+
+    // Seed every thread's generator is derived from. Threads pick up a new seed on their next roll
+    void SeedRandom(std::uint64_t seed);
+    std::uint64_t GetRandomSeed();
+
+    // The calling thread's generator, or the stream a RandomScope on this thread put in place
+    Random& ThreadRandom();
+
+    // Same run seed and keys always give the same stream
+    Random StreamRandom(std::uint64_t key1, std::uint64_t key2 = 0, std::uint64_t key3 = 0);
+
+    // Sends ThreadRandom to the given generator on this thread until it goes out of scope, so everything rolled inside comes from one
+    // reproducible stream without having to pass it down
+    class RandomScope {
+    public:
+        explicit RandomScope(Random& random);
+        ~RandomScope();
+
+        RandomScope(const RandomScope&) = delete;
+        RandomScope& operator=(const RandomScope&) = delete;
+
+    private:
+        Random* previous;
+    };
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include "FlatMap.h"
+
+/*////////////////////////////////////////////////////////////////////
+    Recipe index
+
+    Every recipe for each item, grouped by bench kind, in one flat
+    table. Templated on the item and recipe types so it doesn't need the
+    game's forms (see tools/RecipeIndexBenchmark.cpp). Only depends on
+    the standard library
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    enum ERecipeKind { eRecipe_Temper, eRecipe_Craft, eRecipe_Smelt, eRecipe_KindCount };
+
+    // Smelting recipes are keyed by the item smelted rather than the result. Changes apply to the first recipe of a kind, which is the
+    // one Find returns
+    template <class Item, class Recipe>
+    class BasicRecipeIndex {
+    public:
+        using Recipes = std::vector<Recipe*>;
+
+        void Add(ERecipeKind kind, Item* item, Recipe* recipe) { index[item].kinds[kind].push_back(recipe); }
+
+        Recipe* Find(ERecipeKind kind, Item* item) const {
+            auto recipes = index.Find(item);
+            return recipes && !recipes->kinds[kind].empty() ? recipes->kinds[kind].front() : nullptr;
+        }
+
+        const Recipes& All(ERecipeKind kind, Item* item) const {
+            static const Recipes empty;
+            auto recipes = index.Find(item);
+            return recipes ? recipes->kinds[kind] : empty;
+        }
+
+        // Gives tar all of src's recipes of a kind, if it doesn't have any of its own
+        void Share(ERecipeKind kind, Item* src, Item* tar) {
+            if (Find(kind, tar)) return;
+            if (auto recipes = index.Find(src); recipes && !recipes->kinds[kind].empty()) {
+                auto copy = recipes->kinds[kind];  // Adding may grow the table
+                index[tar].kinds[kind] = std::move(copy);
+            }
+        }
+
+        void Reserve(std::size_t n) { index.Reserve(n); }
+        std::size_t Size() const { return index.Size(); }
+
+    private:
+        struct ItemRecipes {
+            Recipes kinds[eRecipe_KindCount];
+        };
+
+        FlatMap<Item*, ItemRecipes> index;
+    };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*////////////////////////////////////////////////////////////////////
+    Parallel filter and bucket
+
+    Splits a list into fixed size shards, filters and buckets each shard
+    by key on worker threads, then merges the shards back in order. The
+    result is the same as doing it serially regardless of scheduling.
+    Only depends on the standard library, so it can be run against plain
+    stand-ins for the form arrays
+*//////////////////////////////////////////////////////////////////////
+
+namespace QuickArmorRebalance {
+    // Buckets in order of the first item seen with each key
+    template <class Key, class Item>
+    using KeyedBuckets = std::vector<std::pair<Key, std::vector<Item>>>;
+
+    template <class Key, class Item, class Filter, class KeyOf>
+    KeyedBuckets<Key, Item> ShardedBucketBy(const std::vector<Item>& items, Filter&& filter, KeyOf&& keyOf, std::size_t shardSize = 2048) {
+        auto nShards = (items.size() + shardSize - 1) / shardSize;
+
+        std::vector<KeyedBuckets<Key, Item>> shards(nShards);
+        std::vector<std::size_t> shardIds(nShards);
+        std::iota(shardIds.begin(), shardIds.end(), 0);
+
+        std::for_each(std::execution::par, shardIds.begin(), shardIds.end(), [&](std::size_t n) {
+            auto& local = shards[n];
+            auto end = std::min(items.size(), (n + 1) * shardSize);
+            std::size_t last = 0;
+
+            for (auto i = n * shardSize; i < end; i++) {
+                const auto& item = items[i];
+                if (!filter(item)) continue;
+
+                Key key = keyOf(item);
+
+                // Items sharing a key are almost always next to each other, so the last bucket used is nearly always the one
+                if (local.empty() || local[last].first != key) {
+                    auto it = std::find_if(local.begin(), local.end(), [&](const auto& b) { return b.first == key; });
+                    if (it == local.end()) it = local.emplace(local.end(), key, std::vector<Item>{});
+                    last = it - local.begin();
+                }
+
+                local[last].second.push_back(item);
+            }
+        });
+
+        KeyedBuckets<Key, Item> merged;
+        std::unordered_map<Key, std::size_t> index;
+        for (auto& shard : shards) {
+            for (auto& b : shard) {
+                auto [it, bNew] = index.try_emplace(b.first, merged.size());
+                if (bNew)
+                    merged.push_back(std::move(b));
+                else {
+                    auto& dest = merged[it->second].second;
+                    dest.insert(dest.end(), b.second.begin(), b.second.end());
+                }
+            }
+        }
+
+        for (auto& b : merged) std::sort(b.second.begin(), b.second.end());
+        return merged;
+    }
+}
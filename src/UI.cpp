@@ -900,10 +900,10 @@ struct RecipeConditionals {
     bool bRefreshed = false;
 
     void AddFromItem(RE::TESBoundObject* item, Conditionals PurposeConditionals::* which) {
-        if (auto cond = MapFindOrNull(g_Data.temperRecipe, item)) {
+        if (auto cond = g_Data.recipes.Find(eRecipe_Temper, item)) {
             (temper.*which).AddFrom(cond);
         }
-        if (auto cond = MapFindOrNull(g_Data.craftRecipe, item)) {
+        if (auto cond = g_Data.recipes.Find(eRecipe_Craft, item)) {
             (craft.*which).AddFrom(cond);
         }
     }
@@ -9,12 +9,37 @@
 #include "ArmorSetBuilder.h"
 #include "Enchantments.h"
 #include "ModIntegrations.h"
+#include "Profiler.h"
+#include "Random.h"
 
-namespace QuickArmorRebalance {
-    std::mt19937 RNG;
+#include <fstream>
 
+namespace QuickArmorRebalance {
     void OnDataLoaded();
+    void LoadData();
     bool BindPapyrusFunctions(RE::BSScript::IVirtualMachine* vm);
+
+    // Trace and summary of the startup profile, next to the log
+    void WriteProfilerReport() {
+        auto logsFolder = SKSE::log::log_directory();
+        if (!logsFolder) return;
+
+        auto profiler = Profiler::Get();
+
+        auto pathTrace = *logsFolder / std::format("{} Profile.json", PLUGIN_NAME);
+        if (std::ofstream file(pathTrace, std::ios::binary); file)
+            WriteProfilerTrace(*profiler, PLUGIN_NAME, file);
+        else
+            logger::warn("Could not open file to write {}: {}", pathTrace.generic_string(), std::strerror(errno));
+
+        auto pathSummary = *logsFolder / std::format("{} Profile.txt", PLUGIN_NAME);
+        std::ofstream file(pathSummary);
+        file << profiler->Summary();
+
+        for (auto& i : profiler->GetSpans()) {
+            if (!i.depth && !i.thread && i.end >= 0) logger::info("{} took {:.2f}ms", i.name, 0.001 * (i.end - i.start));
+        }
+    }
     
     SKSEPluginLoad(const SKSE::LoadInterface* skse) {
         SKSE::Init(skse);
@@ -34,36 +59,64 @@ namespace QuickArmorRebalance {
             }
         });
 
-        RNG.seed((unsigned int)std::time(0));
+        SeedRandom((std::uint64_t)std::time(0));
 
         return true;
     }
 
     void OnDataLoaded() {
+        {
+            ScopedTimer timer("OnDataLoaded");
+            LoadData();
+        }
+
+        WriteProfilerReport();
+    }
+
+    void LoadData() {
         g_Data.loot = std::make_unique<decltype(g_Data.loot)::element_type>();
 
         logger::trace("Data loaded - loading files");
 
         logger::trace("Loading configuration files");
-        if (!g_Config.Load()) {
-            logger::error("Failed to load configuration files, aborting");
-            return;
+        {
+            ScopedTimer timerPhase("Load configuration");
+            if (!g_Config.Load()) {
+                logger::error("Failed to load configuration files, aborting");
+                return;
+            }
         }
 
+        if (g_Config.randomSeed) SeedRandom((std::uint64_t)g_Config.randomSeed);
+        logger::info("Random seed {}", GetRandomSeed());
+
         logger::trace("Processing Skyrim data");
-        ProcessData();
+        {
+            ScopedTimer timerPhase("Process data");
+            ProcessData();
+        }
 
         logger::trace("Loading changes");
-        LoadChangesFromFiles();
+        {
+            ScopedTimer timerPhase("Load changes");
+            LoadChangesFromFiles();
+            UpdateModelArmorSlotTable();
+        }
 
-        ImportFromBOS();
+        {
+            ScopedTimer timerPhase("Import from BOS");
+            ImportFromBOS();
+        }
 
         logger::trace("Setting up loot");
-        SetupLootLists();
+        {
+            ScopedTimer timerPhase("Setup loot lists");
+            SetupLootLists();
+        }
 
         std::erase_if(g_Config.mapPrefVariants, [](auto& v) { return !v.second.hash; });
 
-        g_Data.loot.release();
+        ScopedTimer timerPhase("Install hooks");
 
         InstallConsoleCommands();
 
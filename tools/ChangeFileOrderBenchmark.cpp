@@ -0,0 +1,219 @@
+/*////////////////////////////////////////////////////////////////////
+    Change file ordering benchmark
+
+    Writes a folder of made-up change files, 1000 by default, one per
+    plugin with a load order position each (some of them light plugins),
+    where many files change the same items so the result depends on the
+    order they're applied in. Then times the way LoadChangesFromFolder
+    used to work (read, parse and apply each file in directory listing
+    order) against the way it works now (sort by load order, parse all
+    of them on worker threads, apply one at a time), and checks that the
+    new way always ends in the same state as applying serially in load
+    order, however the directory listing is shuffled. Files are parsed
+    with rapidjson and the same flags as in game. Doesn't need the game
+    or CommonLib, only rapidjson's headers:
+
+        g++ -std=c++20 -O2 -Isrc -I<rapidjson>/include tools/ChangeFileOrderBenchmark.cpp -o changeorder -ltbb
+
+        changeorder [files] [items per file] [runs]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rapidjson/document.h"
+
+using namespace rapidjson;
+
+namespace {
+    // Stand-in for the RE::TESFile fields the sort uses
+    struct Mod {
+        std::string name;
+        std::uint8_t compileIndex;
+        std::uint16_t smallFileCompileIndex;
+    };
+
+    struct ChangeFile {
+        const Mod* mod;
+        std::filesystem::path path;
+        std::shared_ptr<Document> doc;  // Documents can't be copied, and the file list is copied for every run
+        bool bRead = false;
+    };
+
+    // Item name to field to value, the last file to set a field wins like it does with the forms
+    using FormState = std::map<std::string, std::map<std::string, std::string>>;
+
+    bool Read(ChangeFile& file) {
+        std::ifstream in(file.path, std::ios::binary);
+        if (!in) return false;
+
+        std::string text(std::istreambuf_iterator<char>(in), {});
+        file.doc = std::make_shared<Document>();
+        file.doc->Parse<kParseCommentsFlag | kParseTrailingCommasFlag>(text.data(), text.size());
+        return !file.doc->HasParseError() && file.doc->IsObject();
+    }
+
+    void Apply(FormState& state, const ChangeFile& file) {
+        for (auto& item : file.doc->GetObj()) {
+            if (!item.value.IsObject()) continue;
+
+            auto& fields = state[item.name.GetString()];
+            for (auto& field : item.value.GetObj()) {
+                fields[field.name.GetString()] = field.value.IsString() ? field.value.GetString() : field.value.IsNumber() ? std::to_string(field.value.GetDouble()) : "";
+            }
+            fields["last"] = file.mod->name;
+        }
+    }
+
+    void SortByLoadOrder(std::vector<ChangeFile>& files) {
+        std::stable_sort(files.begin(), files.end(), [](const ChangeFile& a, const ChangeFile& b) {
+            if (a.mod->compileIndex != b.mod->compileIndex) return a.mod->compileIndex < b.mod->compileIndex;
+            return a.mod->smallFileCompileIndex < b.mod->smallFileCompileIndex;
+        });
+    }
+
+    // Old LoadChangesFromFolder: each file read, parsed and applied as the listing comes
+    FormState LoadSerial(std::vector<ChangeFile> files) {
+        FormState state;
+        for (auto& file : files) {
+            if (Read(file)) Apply(state, file);
+        }
+        return state;
+    }
+
+    template <class F>
+    double Time(F&& f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Current LoadChangesFromFolder, adds the time spent parsing and applying to the totals
+    FormState LoadParallel(std::vector<ChangeFile> files, double& parseTime, double& applyTime) {
+        SortByLoadOrder(files);
+        parseTime += Time([&] { std::for_each(std::execution::par, files.begin(), files.end(), [](ChangeFile& file) { file.bRead = Read(file); }); });
+
+        FormState state;
+        applyTime += Time([&] {
+            for (auto& file : files) {
+                if (file.bRead) Apply(state, file);
+            }
+        });
+        return state;
+    }
+
+    std::vector<Mod> MakeMods(int count, std::mt19937& rng) {
+        std::vector<Mod> mods;
+        int full = 0, light = 0;
+        for (int i = 0; i < count; i++) {
+            auto& mod = mods.emplace_back();
+            char name[32];
+            std::snprintf(name, sizeof(name), "Mod%04d.esp", i);
+            mod.name = name;
+
+            // About a third are light plugins, which all share load order slot FE
+            if (rng() % 3 == 0 || full >= 0xfd) {
+                mod.compileIndex = 0xfe;
+                mod.smallFileCompileIndex = (std::uint16_t)light++;
+            } else {
+                mod.compileIndex = (std::uint8_t)++full;
+                mod.smallFileCompileIndex = 0;
+            }
+        }
+
+        // Load order isn't the order they were named in
+        std::vector<int> order(count);
+        for (int i = 0; i < count; i++) order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+        std::vector<Mod> shuffled;
+        for (auto i : order) shuffled.push_back(mods[i]);
+        return shuffled;
+    }
+
+    bool WriteFiles(const std::filesystem::path& dir, const std::vector<Mod>& mods, int itemsPerFile, std::mt19937& rng, std::vector<ChangeFile>& files) {
+        const char* sets[] = {"Iron", "Steel", "Leather", "Elven", "Glass", "Ebony", "Daedric", "Dragonplate"};
+        auto items = (int)mods.size() * itemsPerFile / 4;  // Every item gets changed by about four files
+
+        for (auto& mod : mods) {
+            auto& file = files.emplace_back();
+            file.mod = &mod;
+            file.path = dir / (mod.name + ".json");
+
+            std::ofstream out(file.path, std::ios::binary);
+            out << "{\n";
+            for (int i = 0; i < itemsPerFile; i++) {
+                out << (i ? ",\n" : "") << "    \"Item" << rng() % items << "\": {\"armorSet\": \"" << sets[rng() % std::size(sets)] << "\", \"rating\": " << rng() % 100
+                    << ", \"loot\": \"Profile" << rng() % 16 << "\", \"keywords\": [\"ArmorLight\", \"ArmorCuirass\"]}";
+            }
+            out << "\n}\n";
+            if (!out) {
+                std::cerr << "Could not write " << file.path.generic_string() << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? std::max(1, std::atoi(argv[1])) : 1000;
+    int itemsPerFile = argc > 2 ? std::max(1, std::atoi(argv[2])) : 40;
+    int runs = argc > 3 ? std::max(1, std::atoi(argv[3])) : 5;
+
+    std::mt19937 rng(1000);
+    auto mods = MakeMods(count, rng);
+
+    auto dir = std::filesystem::temp_directory_path() / "qar-change-order";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    std::vector<ChangeFile> files;
+    if (!WriteFiles(dir, mods, itemsPerFile, rng, files)) return 1;
+
+    // The result everything has to match: applied one at a time in load order
+    auto sorted = files;
+    SortByLoadOrder(sorted);
+    auto expected = LoadSerial(sorted);
+
+    double serialTime = 0.0, parallelTime = 0.0, parseTime = 0.0, applyTime = 0.0;
+    int serialMismatches = 0;
+    for (int run = 0; run < runs; run++) {
+        auto listing = files;
+        std::shuffle(listing.begin(), listing.end(), rng);
+
+        FormState serial, parallel;
+        serialTime += Time([&] { serial = LoadSerial(listing); });
+        parallelTime += Time([&] { parallel = LoadParallel(listing, parseTime, applyTime); });
+
+        if (parallel != expected) {
+            std::cerr << "Run " << run << ": parallel load doesn't match applying in load order\n";
+            std::filesystem::remove_all(dir);
+            return 1;
+        }
+        serialMismatches += serial != expected;
+    }
+
+    std::filesystem::remove_all(dir);
+
+    std::printf("%d change files, %d items each, %zu items changed, %d runs, %u hardware threads\n", count, itemsPerFile, expected.size(), runs,
+                std::thread::hardware_concurrency());
+    std::printf("%-40s %10.1f ms\n", "Serial, directory order", serialTime / runs);
+    std::printf("%-40s %10.1f ms  (%.2fx)\n", "Parallel parse, apply in load order", parallelTime / runs, serialTime / parallelTime);
+    std::printf("%-40s %10.1f ms\n", "  Parse", parseTime / runs);
+    std::printf("%-40s %10.1f ms\n", "  Apply", applyTime / runs);
+    std::printf("Parallel matched load order in every run, directory order didn't in %d of %d\n", serialMismatches, runs);
+    return 0;
+}
@@ -0,0 +1,339 @@
+/*////////////////////////////////////////////////////////////////////
+    Config merge check
+
+    Config::Load parses every config file on worker threads and only
+    then applies them one after another in _stricmp order of their file
+    names, using SortConfigFiles and MergeConfigFiles from ConfigMerge.h.
+    This runs the same two over a file list and checks that this gives
+    the same merged config as reading and applying them one at a time in
+    that order: each run it shuffles the file list (directory order isn't
+    guaranteed), sorts it, parses it in parallel, merges it and compares
+    the result with the serial merge, byte for byte. Without a directory
+    it makes up a set of files whose names only sort right when compared
+    case-insensitively, and checks they're applied in the order spelled
+    out here, so a change to the shared ordering fails.
+
+    Applying a file stands in for Config::LoadFile, which needs the game:
+    objects merge member by member, arrays append and later scalars win,
+    so any file applied out of order changes the result. --golden compares the merged config
+    with one saved earlier (or saves it, with --update). Files are
+    parsed with rapidjson and the same flags as in game. Doesn't need
+    the game or CommonLib, only rapidjson's headers:
+
+        g++ -std=c++20 -O2 -Isrc -I<rapidjson>/include tools/ConfigMergeCheck.cpp -o configmerge -ltbb
+
+        configmerge [config directory] [--runs N] [--golden merged.json [--update]]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ConfigMerge.h"
+#include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
+
+using namespace QuickArmorRebalance;
+using namespace rapidjson;
+
+namespace {
+    struct ConfigFile {
+        std::string name;
+        std::string text;
+        std::shared_ptr<Document> doc;  // Documents can't be copied, and the file list is copied for every run
+        std::string error;
+        bool bRead = false;
+    };
+
+    void SortFiles(std::vector<ConfigFile>& files) {
+        SortConfigFiles(files, [](const ConfigFile& file) { return std::string_view(file.name); });
+    }
+
+    void Parse(ConfigFile& file) {
+        file.doc = std::make_shared<Document>();
+        file.error.clear();
+        file.doc->Parse<kParseCommentsFlag | kParseTrailingCommasFlag>(file.text.data(), file.text.size());
+
+        if (file.doc->HasParseError())
+            file.error = std::string(GetParseError_En(file.doc->GetParseError())) + " at offset " + std::to_string(file.doc->GetErrorOffset());
+        else if (!file.doc->IsObject())
+            file.error = "not an object";
+        file.bRead = file.error.empty();
+    }
+
+    void Merge(Value& into, const Value& from, MemoryPoolAllocator<>& al) {
+        if (into.IsObject() && from.IsObject()) {
+            for (auto& i : from.GetObj()) {
+                auto it = into.FindMember(i.name.GetString());
+                if (it != into.MemberEnd())
+                    Merge(it->value, i.value, al);
+                else
+                    into.AddMember(Value(i.name, al).Move(), Value(i.value, al).Move(), al);
+            }
+        } else if (into.IsArray() && from.IsArray()) {
+            for (auto& i : from.GetArray()) into.PushBack(Value(i, al).Move(), al);
+        } else
+            into.CopyFrom(from, al);
+    }
+
+    void WriteString(std::string& out, const std::string& str) {
+        out += '"';
+        for (auto c : str) {
+            if (c == '"' || c == '\\')
+                (out += '\\') += c;
+            else if ((unsigned char)c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+                out += escaped;
+            } else
+                out += c;
+        }
+        out += '"';
+    }
+
+    void Write(std::string& out, const Value& v, int depth = 0) {
+        auto Indent = [&](int n) { out.append(n * 4, ' '); };
+
+        switch (v.GetType()) {
+            case kNullType:
+                out += "null";
+                break;
+            case kFalseType:
+            case kTrueType:
+                out += v.GetBool() ? "true" : "false";
+                break;
+            case kNumberType: {
+                char num[32];
+                std::snprintf(num, sizeof(num), "%.17g", v.GetDouble());
+                out += num;
+                break;
+            }
+            case kStringType:
+                WriteString(out, std::string(v.GetString(), v.GetStringLength()));
+                break;
+            case kArrayType:
+                out += "[";
+                for (SizeType i = 0; i < v.Size(); i++) {
+                    out += i ? ",\n" : "\n";
+                    Indent(depth + 1);
+                    Write(out, v[i], depth + 1);
+                }
+                if (v.Size()) {
+                    out += "\n";
+                    Indent(depth);
+                }
+                out += "]";
+                break;
+            case kObjectType: {
+                out += "{";
+                bool bFirst = true;
+                for (auto& i : v.GetObj()) {
+                    out += bFirst ? "\n" : ",\n";
+                    bFirst = false;
+                    Indent(depth + 1);
+                    WriteString(out, std::string(i.name.GetString(), i.name.GetStringLength()));
+                    out += ": ";
+                    Write(out, i.value, depth + 1);
+                }
+                if (!bFirst) {
+                    out += "\n";
+                    Indent(depth);
+                }
+                out += "}";
+                break;
+            }
+        }
+    }
+
+    std::string ToText(const Value& v) {
+        std::string out;
+        Write(out, v);
+        out += "\n";
+        return out;
+    }
+
+    std::string MergeFiles(const std::vector<ConfigFile>& files) {
+        Document merged;
+        merged.SetObject();
+        MergeConfigFiles(files, [&](const ConfigFile& file) {
+            if (file.bRead) Merge(merged, *file.doc, merged.GetAllocator());
+            return file.bRead;
+        });
+        return ToText(merged);
+    }
+
+    bool ReadText(const std::filesystem::path& path, std::string& text) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        text.assign(std::istreambuf_iterator<char>(in), {});
+        return true;
+    }
+
+    bool LoadDirectory(const std::filesystem::path& path, std::vector<ConfigFile>& files) {
+        if (!std::filesystem::is_directory(path)) {
+            std::cerr << path.generic_string() << " is not a directory\n";
+            return false;
+        }
+
+        for (auto& entry : std::filesystem::directory_iterator(path)) {
+            if (!entry.is_regular_file() || CompareConfigFileNames(entry.path().extension().generic_string(), ".json")) continue;
+
+            auto& file = files.emplace_back();
+            file.name = entry.path().filename().generic_string();
+            if (!ReadText(entry.path(), file.text)) {
+                std::cerr << "Could not open " << entry.path().generic_string() << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Names that come out in a different order when compared case-sensitively, all touching the same sections
+    void MakeFiles(std::vector<ConfigFile>& files) {
+        const char* names[] = {"QAR_Base.json", "qar_armor.json", "Qar_Weapons.json", "_Overrides.json", "zz_patch.json", "ZZ_Patch2.json", "a10.json", "A2.json",
+                               "b-loot.json", "B_Loot.json"};
+
+        int n = 0;
+        for (auto name : names) {
+            auto& file = files.emplace_back();
+            file.name = name;
+
+            // Every file overrides the same scalars and appends to the same arrays, so the merge shows the order
+            char text[512];
+            std::snprintf(text, sizeof(text),
+                          "{\n"
+                          "    // %s\n"
+                          "    \"settings\": {\"last\": \"%s\", \"n\": %d, \"file%d\": true,},\n"
+                          "    \"armorSets\": [{\"name\": \"Set %d\", \"level\": %d}],\n"
+                          "    \"loot\": {\"profiles\": {\"Profile %d\": [\"%s\"]}, \"order\": [%d],},\n"
+                          "}\n",
+                          name, name, n, n, n, n * 3, n % 3, name, n);
+            file.text = text;
+            n++;
+        }
+
+        // Ones that don't parse, which both ways have to skip
+        auto& bad = files.emplace_back();
+        bad.name = "broken.json";
+        bad.text = "{\"settings\": {\"last\": \"broken\"";
+
+        auto& unclosed = files.emplace_back();
+        unclosed.name = "Unclosed.json";
+        unclosed.text = "{\"settings\": {\"last\": \"unclosed\"}} /* comment left open";
+    }
+}
+
+int main(int argc, char** argv) {
+    std::vector<ConfigFile> files;
+    std::string golden;
+    bool bUpdate = false, bLoaded = false;
+    int runs = 20;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+            runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--golden" && i + 1 < argc)
+            golden = argv[++i];
+        else if (arg == "--update")
+            bUpdate = true;
+        else if (!arg.starts_with("--") && !bLoaded) {
+            if (!LoadDirectory(argv[i], files)) return 1;
+            bLoaded = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [config directory] [--runs N] [--golden merged.json [--update]]\n";
+            return 2;
+        }
+    }
+
+    if (!bLoaded) MakeFiles(files);
+    if (files.empty()) {
+        std::cerr << "No config files found\n";
+        return 1;
+    }
+
+    // Serial: one file at a time, parsed right before it's applied
+    auto serialFiles = files;
+    SortFiles(serialFiles);
+    for (auto& file : serialFiles) Parse(file);
+    auto expected = MergeFiles(serialFiles);
+
+    for (auto& file : serialFiles) {
+        if (!file.bRead) std::cerr << "warning: " << file.name << " skipped" << (file.error.empty() ? "" : ": ") << file.error << "\n";
+    }
+
+    std::mt19937 rng(12345);
+    for (int run = 0; run < runs; run++) {
+        auto parallelFiles = files;
+        std::shuffle(parallelFiles.begin(), parallelFiles.end(), rng);
+        SortFiles(parallelFiles);
+        std::for_each(std::execution::par, parallelFiles.begin(), parallelFiles.end(), Parse);
+
+        auto merged = MergeFiles(parallelFiles);
+        if (merged != expected) {
+            std::cerr << "Run " << run << ": parallel merge differs from the serial one\n";
+            for (std::size_t i = 0; i < parallelFiles.size(); i++) std::cerr << "  " << parallelFiles[i].name << " / " << serialFiles[i].name << "\n";
+            return 1;
+        }
+    }
+
+    // What Config::Load has always done with these names, written out rather than worked out with the code being checked
+    if (!bLoaded) {
+        const char* order[] = {"_Overrides.json", "a10.json", "A2.json", "b-loot.json", "B_Loot.json", "broken.json",
+                               "qar_armor.json", "QAR_Base.json", "Qar_Weapons.json", "Unclosed.json", "zz_patch.json", "ZZ_Patch2.json"};
+
+        std::vector<std::string> applied, skipped;
+        MergeConfigFiles(serialFiles, [&](const ConfigFile& file) {
+            applied.push_back(file.name);
+            if (!file.bRead) skipped.push_back(file.name);
+            return file.bRead;
+        });
+
+        if (skipped != std::vector<std::string>{"broken.json", "Unclosed.json"}) {
+            std::cerr << "Expected broken.json and Unclosed.json to be skipped, skipped:";
+            for (auto& name : skipped) std::cerr << " " << name;
+            std::cerr << "\n";
+            return 1;
+        }
+
+        if (!std::equal(applied.begin(), applied.end(), std::begin(order), std::end(order))) {
+            std::cerr << "Files applied in the wrong order:";
+            for (auto& name : applied) std::cerr << " " << name;
+            std::cerr << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << files.size() << " files, " << runs << " parallel merges match the serial merge\n";
+    std::cout << "Order:";
+    for (auto& file : serialFiles) std::cout << " " << file.name;
+    std::cout << "\n";
+
+    if (!golden.empty()) {
+        std::string saved;
+        if (bUpdate || !ReadText(golden, saved)) {
+            std::ofstream out(golden, std::ios::binary);
+            if (!(out << expected)) {
+                std::cerr << "Could not write " << golden << "\n";
+                return 1;
+            }
+            std::cout << "Saved merged config to " << golden << "\n";
+        } else if (saved != expected) {
+            std::cerr << "Merged config differs from " << golden << "\n";
+            return 1;
+        } else
+            std::cout << "Merged config matches " << golden << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*////////////////////////////////////////////////////////////////////
+    Enchantment pick benchmark
+
+    Compares picks per second of the old PickEnchant approach (filter
+    the pool into a fresh vector on every roll, then scan it) with the
+    alias tables it uses now, on a stand-in enchantment model that has
+    the same shape as the real pools: per enchantment minimum levels,
+    armor-only and weapon-only entries and worn restriction keyword
+    lists. Also reports how far apart the two pick distributions are.
+    Standard library only:
+
+        g++ -std=c++20 -O2 -Isrc tools/EnchantPickBenchmark.cpp -o enchbench
+
+        enchbench [enchantments per pool] [picks]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "AliasTable.h"
+#include "FlatMap.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    struct Enchantment {
+        bool bArmor;      // Constant effect on self, otherwise fire and forget on touch
+        int restriction;  // Worn restriction list, -1 for none
+    };
+
+    struct Ranks {
+        int levelMin;
+    };
+
+    struct Item {
+        bool bArmor;
+        std::uint64_t keywords;  // Bit set for each restriction list it has a keyword from
+    };
+
+    struct Model {
+        std::vector<Enchantment> enchs;
+        std::map<int, Ranks> ranks;  // Like g_Config.mapEnchantments, looked up per candidate
+        std::map<int, float> pool;   // Like EnchantmentPool::enchs
+        std::vector<Item> items;
+    };
+
+    Model MakeModel(int nEnchs, int nRestrictions, std::mt19937& rng) {
+        Model model;
+        for (int i = 0; i < nEnchs; i++) {
+            bool bArmor = rng() % 3 != 0;
+            int restriction = bArmor && rng() % 2 ? (int)(rng() % nRestrictions) : -1;
+            model.enchs.push_back({bArmor, restriction});
+            model.ranks[i] = {1 + (int)(rng() % 40)};
+            model.pool[i] = (float)(1 + rng() % 20);
+        }
+        for (int i = 0; i < 64; i++) model.items.push_back({rng() % 4 != 0, rng() & ((1ull << nRestrictions) - 1)});
+        return model;
+    }
+
+    float Uniform(std::mt19937& rng) { return (float)((double)rng() / (double)rng.max()); }
+
+    // What PickEnchant did per roll before the tables
+    int PickScan(Model& model, const Item& item, int level, std::mt19937& rng) {
+        std::vector<std::pair<int, float>> weights;
+        weights.reserve(model.pool.size());
+
+        for (auto& i : model.pool) {
+            auto& ranks = model.ranks[i.first];
+            if (level < ranks.levelMin) continue;
+
+            auto& e = model.enchs[i.first];
+            if (e.bArmor != item.bArmor) continue;
+            if (e.restriction >= 0 && !(item.keywords & (1ull << e.restriction))) continue;
+
+            weights.emplace_back(i.first, i.second);
+        }
+        if (weights.empty()) return -1;
+
+        float total = 0.0f;
+        for (auto& i : weights) total += i.second;
+
+        auto pick = total * Uniform(rng);
+        for (auto& i : weights) {
+            pick -= i.second;
+            if (pick <= 0) return i.first;
+        }
+        return -1;
+    }
+
+    struct Key {
+        std::uint32_t bucket = 0;
+        std::uint64_t keywords = 0;
+        bool bArmor = false;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        std::uint64_t operator()(const Key& key) const { return MixHash(key.keywords ^ MixHash(((std::uint64_t)key.bucket << 1) | key.bArmor)); }
+    };
+
+    // Same as the EnchantSampler in Enchantments.cpp, minus the form types and locking
+    class TablePicker {
+    public:
+        explicit TablePicker(const Model& model) : model(model) {
+            for (auto& i : model.ranks) levels.push_back(i.second.levelMin);
+            std::sort(levels.begin(), levels.end());
+            levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+        }
+
+        int Pick(const Item& item, int level, std::mt19937& rng) {
+            auto it = std::upper_bound(levels.begin(), levels.end(), level);
+            if (it == levels.begin()) return -1;
+
+            Key key{(std::uint32_t)(it - levels.begin() - 1), item.bArmor ? item.keywords : 0, item.bArmor};
+            auto [table, bNew] = tables.TryEmplace(key);
+            if (bNew) *table = Build(key);
+            if (table->Empty()) return -1;
+
+            return table->Pick((double)rng() / ((double)rng.max() + 1.0));
+        }
+
+    private:
+        AliasTable<int> Build(const Key& key) const {
+            std::vector<std::pair<int, double>> weighted;
+            for (auto& i : model.pool) {
+                auto& e = model.enchs[i.first];
+                if (model.ranks.at(i.first).levelMin > levels[key.bucket]) continue;
+                if (e.bArmor != key.bArmor) continue;
+                if (e.restriction >= 0 && !(key.keywords & (1ull << e.restriction))) continue;
+                weighted.push_back({i.first, i.second});
+            }
+            return AliasTable<int>(weighted);
+        }
+
+        const Model& model;
+        std::vector<int> levels;
+        FlatMap<Key, AliasTable<int>, KeyHash> tables;
+    };
+
+    template <class Fn>
+    double PicksPerSecond(long long picks, Fn&& fn) {
+        auto start = std::chrono::steady_clock::now();
+        for (long long i = 0; i < picks; i++) fn(i);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return picks / elapsed.count();
+    }
+}
+
+int main(int argc, char** argv) {
+    int nEnchs = argc > 1 ? std::atoi(argv[1]) : 60;
+    long long picks = argc > 2 ? std::atoll(argv[2]) : 2000000;
+    constexpr int kRestrictions = 6;
+
+    std::mt19937 rng(1234);
+    auto model = MakeModel(nEnchs, kRestrictions, rng);
+    TablePicker tables(model);
+
+    auto Level = [](long long i) { return 1 + (int)(i % 50); };
+    auto& items = model.items;
+
+    std::map<int, long long> countsScan, countsTable;
+    long long sink = 0;
+
+    std::mt19937 rngScan(42), rngTable(42);
+    auto scan = PicksPerSecond(picks, [&](long long i) {
+        auto pick = PickScan(model, items[i % items.size()], Level(i), rngScan);
+        sink += pick;
+        countsScan[pick]++;
+    });
+    auto table = PicksPerSecond(picks, [&](long long i) {
+        auto pick = tables.Pick(items[i % items.size()], Level(i), rngTable);
+        sink += pick;
+        countsTable[pick]++;
+    });
+
+    // Same rolls through both, so the pick distributions should only differ by sampling noise
+    double distance = 0.0;
+    for (auto& i : countsScan) distance += std::abs((double)i.second - (double)countsTable[i.first]);
+    for (auto& i : countsTable) {
+        if (!countsScan.contains(i.first)) distance += (double)i.second;
+    }
+
+    std::cout << nEnchs << " enchantments, " << picks << " picks\n";
+    std::cout << "filter and scan: " << (long long)scan << " picks/s\n";
+    std::cout << "alias tables:    " << (long long)table << " picks/s (" << table / scan << "x)\n";
+    std::cout << "total variation distance between the two: " << distance / (2.0 * picks) << "\n";
+    return sink == 42 ? 1 : 0;  // Keeps the picks from being optimized out
+}
@@ -0,0 +1,209 @@
+/*////////////////////////////////////////////////////////////////////
+    Enchantment rank order check
+
+    Compares SortEnchantRanks with the EnchCmp sort and duplicate removal
+    FinalizeEnchantmentConfig used before, over random rank sets:
+
+    - When every rank has the same effects, EnchCmp was a proper order
+      and the two have to agree, except that the old duplicate removal
+      left copies behind in runs of three or more
+    - When ranks have different effects, EnchCmp isn't a strict weak
+      order, so its result depended on the order the ranks were loaded
+      in. The new order has to come out the same for every load order
+
+    Exits nonzero if the new sort disagrees where it has to agree, isn't
+    ordered, keeps a duplicate or depends on load order. Standard
+    library only:
+
+        g++ -std=c++20 -O2 -Isrc tools/EnchantRankSortCheck.cpp -o ranksortcheck
+
+        ranksortcheck [rank sets] [seed]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "EnchantRankSort.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    // Stand-ins for EffectSetting, Effect and EnchantmentItem
+    struct BaseEffect {
+        int id;
+    };
+
+    struct Effect {
+        BaseEffect* baseEffect;
+        float magnitude;
+    };
+
+    struct Rank {
+        std::vector<Effect> effects;
+    };
+
+    // As it was in Enchantments.cpp
+    float EnchCmp(const Rank* a, const Rank* b) {
+        for (auto& effect : a->effects) {
+            bool bFound = false;
+            for (auto& effect2 : b->effects) {
+                if (effect.baseEffect == effect2.baseEffect) {
+                    float cmp = effect.magnitude - effect2.magnitude;
+                    if (cmp != 0.0f) return cmp;
+                    bFound = true;
+                    break;
+                }
+            }
+
+            if (!bFound) return 1;
+        }
+
+        return 0.0f;
+    }
+
+    void OldSort(std::vector<Rank*>& ranks) {
+        std::sort(ranks.begin(), ranks.end(), [](auto a, auto b) { return EnchCmp(a, b) < 0.0f; });
+
+        for (auto it = ranks.begin(); it != ranks.end(); it++) {
+            auto itNext = it + 1;
+            if (itNext != ranks.end()) {
+                if (!EnchCmp(*it, *itNext)) {
+                    ranks.erase(itNext);
+                }
+            }
+        }
+    }
+
+    void NewSort(std::vector<Rank*>& ranks) {
+        SortEnchantRanks(ranks, [](Rank* rank, auto&& fn) {
+            for (auto& effect : rank->effects) fn((std::uint32_t)effect.baseEffect->id, effect.magnitude);
+        });
+    }
+
+    // Magnitudes by effect id, so rank sets can be compared whichever objects were kept
+    using Signature = std::vector<std::vector<std::pair<int, float>>>;
+
+    Signature Sign(const std::vector<Rank*>& ranks) {
+        Signature sig;
+        for (auto rank : ranks) {
+            auto& row = sig.emplace_back();
+            for (auto& effect : rank->effects) row.emplace_back(effect.baseEffect->id, effect.magnitude);
+        }
+        return sig;
+    }
+
+    // A few ranks of one enchantment, magnitudes from a small set so duplicates and ties come up
+    std::vector<Rank*> MakeRanks(std::deque<Rank>& store, BaseEffect* effects, bool bSameEffects, std::mt19937& rng) {
+        std::vector<Rank*> ranks;
+        auto n = 2 + rng() % 9;
+        for (std::uint32_t i = 0; i < n; i++) {
+            auto& rank = store.emplace_back();
+            for (int e = 0; e < 3; e++) {
+                if (!bSameEffects && e && rng() % 2) continue;  // Sometimes the secondary effects are missing
+                if (bSameEffects && e == 2) break;
+                rank.effects.push_back({&effects[e], (float)(rng() % 4) * 5.0f});
+            }
+            ranks.push_back(&rank);
+        }
+        return ranks;
+    }
+}
+
+int main(int argc, char** argv) {
+    int sets = argc > 1 ? std::max(1, std::atoi(argv[1])) : 20000;
+    std::mt19937 rng(argc > 2 ? (unsigned)std::strtoul(argv[2], nullptr, 10) : 24);
+
+    BaseEffect effects[3] = {{0}, {1}, {2}};
+
+    int sameSets = 0, sameMismatches = 0, oldLeftDuplicates = 0;
+    int mixedSets = 0, oldOrderDependent = 0, newOrderDependent = 0, newUnordered = 0, newDuplicates = 0;
+
+    for (int set = 0; set < sets; set++) {
+        std::deque<Rank> store;
+        bool bSame = set % 2 == 0;
+        auto ranks = MakeRanks(store, effects, bSame, rng);
+
+        auto sorted = ranks;
+        NewSort(sorted);
+
+        // Ordered and without duplicates, as rows over the effects by the earliest place any rank lists them, then by ID
+        auto rows = [&](const std::vector<Rank*>& list) {
+            std::vector<std::pair<std::size_t, int>> columns;
+            for (auto rank : ranks) {
+                for (std::size_t pos = 0; pos < rank->effects.size(); pos++) {
+                    auto id = rank->effects[pos].baseEffect->id;
+                    auto it = std::find_if(columns.begin(), columns.end(), [=](auto& c) { return c.second == id; });
+                    if (it == columns.end())
+                        columns.emplace_back(pos, id);
+                    else
+                        it->first = std::min(it->first, pos);
+                }
+            }
+            std::sort(columns.begin(), columns.end());
+
+            std::vector<std::vector<float>> out;
+            for (auto rank : list) {
+                auto& row = out.emplace_back(columns.size(), -1.0f);
+                for (auto& e : rank->effects) {
+                    auto id = e.baseEffect->id;
+                    row[std::find_if(columns.begin(), columns.end(), [=](auto& c) { return c.second == id; }) - columns.begin()] = e.magnitude;
+                }
+            }
+            return out;
+        };
+        auto newRows = rows(sorted);
+        for (std::size_t i = 1; i < newRows.size(); i++) {
+            newUnordered += newRows[i] < newRows[i - 1];
+            newDuplicates += newRows[i] == newRows[i - 1];
+        }
+
+        if (bSame) {
+            sameSets++;
+
+            auto old = ranks;
+            OldSort(old);
+            auto oldSig = Sign(old);
+            auto fullSig = oldSig;
+            fullSig.erase(std::unique(fullSig.begin(), fullSig.end()), fullSig.end());
+            oldLeftDuplicates += fullSig.size() != oldSig.size();
+
+            if (fullSig != Sign(sorted)) {
+                if (!sameMismatches) std::printf("First mismatch in rank set %d\n", set);
+                sameMismatches++;
+            }
+        } else {
+            mixedSets++;
+
+            // Same ranks loaded in other orders
+            auto oldFirst = ranks;
+            OldSort(oldFirst);
+            bool bOldDiffers = false, bNewDiffers = false;
+            for (int shuffle = 0; shuffle < 8; shuffle++) {
+                auto shuffled = ranks;
+                std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+                auto old = shuffled;
+                OldSort(old);
+                bOldDiffers |= Sign(old) != Sign(oldFirst);
+
+                NewSort(shuffled);
+                bNewDiffers |= Sign(shuffled) != Sign(sorted);
+            }
+            oldOrderDependent += bOldDiffers;
+            newOrderDependent += bNewDiffers;
+        }
+    }
+
+    std::printf("Ranks with the same effects: %d sets, %d differ from the old sort, the old one left duplicates in %d\n", sameSets, sameMismatches,
+                oldLeftDuplicates);
+    std::printf("Ranks with different effects: %d sets, old order depends on load order in %d, new in %d\n", mixedSets, oldOrderDependent, newOrderDependent);
+    std::printf("New sort: %d out of order, %d duplicates kept\n", newUnordered, newDuplicates);
+
+    bool bOk = !sameMismatches && !newOrderDependent && !newUnordered && !newDuplicates;
+    std::printf(bOk ? "OK\n" : "FAILED\n");
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+/*////////////////////////////////////////////////////////////////////
+    Offline enchantment simulator
+
+    Loads the enchantment sections of the QuickArmorRebalance config
+    files and rolls millions of one kind of item through the same math
+    the container hooks use, reporting per container level how many
+    come out enchanted, the ranks, the weapon charge and the share of
+    each enchantment pool, plus how many rolls per second it managed.
+    Config files are parsed with rapidjson and the same flags as in game.
+    Doesn't need the game or CommonLib, only rapidjson's headers:
+
+        g++ -std=c++20 -O2 -Isrc -I<rapidjson>/include tools/EnchantSimTool.cpp src/EnchantSimulation.cpp src/Random.cpp -o enchsim -ltbb
+
+        enchsim [options] <config.json or config directory>...
+
+    Options, all optional:
+        --kind armor|weapon|staff  --item-level N  --rate R  --power P
+        --pool NAME  --unique NAME  --unique-chance C  --staff-group NAME
+        --container-rate R  --container-power P  --enchant-rate PERCENT
+        --levels 1,10,20  --rolls N  --seed N
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "EnchantSimulation.h"
+#include "rapidjson/error/en.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    std::string Lower(std::string str) {
+        for (auto& c : str) c = (char)std::tolower((unsigned char)c);
+        return str;
+    }
+
+    bool LoadFile(EnchantSimModel& model, const std::filesystem::path& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Could not open " << path.generic_string() << "\n";
+            return false;
+        }
+
+        std::string text(std::istreambuf_iterator<char>(in), {});
+        rapidjson::Document doc;
+        doc.Parse<rapidjson::kParseCommentsFlag | rapidjson::kParseTrailingCommasFlag>(text.data(), text.size());
+        if (doc.HasParseError()) {
+            std::cerr << path.generic_string() << ": " << rapidjson::GetParseError_En(doc.GetParseError()) << " at offset " << doc.GetErrorOffset() << "\n";
+            return false;
+        }
+
+        model.Load(doc, path.filename().generic_string());
+        return true;
+    }
+
+    // A directory loads every .json in it, sorted by name like the game does
+    bool Load(EnchantSimModel& model, const std::filesystem::path& path) {
+        if (!std::filesystem::is_directory(path)) return LoadFile(model, path);
+
+        std::vector<std::filesystem::path> files;
+        for (auto& entry : std::filesystem::directory_iterator(path)) {
+            if (entry.is_regular_file() && Lower(entry.path().extension().generic_string()) == ".json") files.push_back(entry.path());
+        }
+        std::sort(files.begin(), files.end(), [](auto& a, auto& b) { return Lower(a.filename().generic_string()) < Lower(b.filename().generic_string()); });
+
+        for (auto& file : files) {
+            if (!LoadFile(model, file)) return false;
+        }
+        return true;
+    }
+
+    std::vector<int> ParseLevels(const std::string& text) {
+        std::vector<int> levels;
+        std::stringstream ss(text);
+        for (std::string level; std::getline(ss, level, ',');) {
+            if (!level.empty()) levels.push_back(std::atoi(level.c_str()));
+        }
+        return levels;
+    }
+}
+
+int main(int argc, char** argv) {
+    EnchantSimModel model;
+    EnchantSimulationParams params;
+    params.levels = {1, 5, 10, 15, 20, 30, 40, 50};
+
+    std::string pool, uniquePool, staffGroup, kind = "armor";
+    float enchantRate = -1.0f;
+    bool bLoaded = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (!arg.starts_with("--")) {
+            if (!Load(model, argv[i])) return 1;
+            bLoaded = true;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return 2;
+        }
+        const char* value = argv[++i];
+
+        if (arg == "--kind")
+            kind = value;
+        else if (arg == "--item-level")
+            params.item.level = std::atoi(value);
+        else if (arg == "--rate")
+            params.item.rate = (float)std::atof(value);
+        else if (arg == "--power")
+            params.item.power = (float)std::atof(value);
+        else if (arg == "--pool")
+            pool = value;
+        else if (arg == "--unique")
+            uniquePool = value;
+        else if (arg == "--unique-chance")
+            params.item.uniquePoolChance = (float)std::atof(value);
+        else if (arg == "--staff-group")
+            staffGroup = value;
+        else if (arg == "--container-rate")
+            params.containerRate = (float)std::atof(value);
+        else if (arg == "--container-power")
+            params.containerPower = (float)std::atof(value);
+        else if (arg == "--enchant-rate")
+            enchantRate = (float)std::atof(value);
+        else if (arg == "--levels")
+            params.levels = ParseLevels(value);
+        else if (arg == "--rolls")
+            params.rolls = (std::uint32_t)std::strtoul(value, nullptr, 10);
+        else if (arg == "--seed")
+            params.seed = std::strtoull(value, nullptr, 10);
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if (!bLoaded) {
+        std::cerr << "Usage: " << argv[0] << " [options] <config.json or config directory>...\n";
+        return 2;
+    }
+
+    model.Finalize();
+    if (enchantRate >= 0.0f) model.settings.rates = enchantRate;
+
+    for (auto& warning : model.warnings) std::cerr << "warning: " << warning << "\n";
+
+    if (kind == "armor")
+        params.item.kind = EnchantSimKind::kArmor;
+    else if (kind == "weapon")
+        params.item.kind = EnchantSimKind::kWeapon;
+    else if (kind == "staff")
+        params.item.kind = EnchantSimKind::kStaff;
+    else {
+        std::cerr << "Unknown kind " << kind << "\n";
+        return 2;
+    }
+
+    if (model.pools.empty()) {
+        std::cerr << "No enchantment pools found\n";
+        return 1;
+    }
+
+    auto Find = [](int index, const std::string& name, const char* what) {
+        if (index < 0 && !name.empty()) std::cerr << "No " << what << " named " << name << "\n";
+        return index >= 0 || name.empty();
+    };
+    params.item.pool = model.FindPool(pool);
+    params.item.uniquePool = model.FindPool(uniquePool);
+    params.item.staffGroup = model.FindStaffGroup(staffGroup);
+    if (!Find(params.item.pool, pool, "pool") || !Find(params.item.uniquePool, uniquePool, "pool") || !Find(params.item.staffGroup, staffGroup, "staff group"))
+        return 1;
+
+    auto result = SimulateEnchantments(model, params);
+    WriteEnchantSimulationReport(model, params, result, std::cout);
+    return 0;
+}
@@ -0,0 +1,192 @@
+/*////////////////////////////////////////////////////////////////////
+    JSON parse benchmark
+
+    Times the three ways a config or change file can be read with
+    rapidjson, the same flags the plugin uses: streamed through
+    FileReadStream and copied into the document (what ReadJSONFile
+    does, and what every file used to go through), read in one go and
+    parsed with copies, and read in one go and parsed in-situ (what
+    ReadJSONFileInSitu does). Reports the time per file, how much the
+    document's allocator took, and checks all three parse to the same
+    document. Given a directory, such as a game's QuickArmorRebalance
+    config or changes folder, it runs over every .json file in it and
+    reports the totals, which is what startup pays. Without a file it
+    writes a change file sized like a big mod's. Needs only rapidjson,
+    which is header-only (from vcpkg or a checkout):
+
+        g++ -std=c++20 -O2 -I<rapidjson>/include tools/JsonParseBenchmark.cpp -o jsonbench
+
+        jsonbench [file.json | directory] [runs]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "rapidjson/document.h"
+#include "rapidjson/filereadstream.h"
+
+using namespace rapidjson;
+
+namespace {
+    constexpr unsigned kFlags = kParseCommentsFlag | kParseTrailingCommasFlag;
+
+    struct Result {
+        double ms = 0.0;
+        std::size_t allocated = 0;
+        bool bOk = true;
+    };
+
+    // Whole file plus a terminator, the way ReadJSONFileInSitu reads it
+    bool ReadBuffer(const std::filesystem::path& path, std::vector<char>& buffer) {
+        auto fp = std::fopen(path.generic_string().c_str(), "rb");
+        if (!fp) return false;
+
+        std::error_code ec;
+        auto size = std::filesystem::file_size(path, ec);
+        buffer.resize(ec ? 1 : (std::size_t)size + 1);
+        auto nRead = std::fread(buffer.data(), 1, buffer.size() - 1, fp);
+        std::fclose(fp);
+        buffer[nRead] = '\0';
+        return true;
+    }
+
+    bool ParseStream(const std::filesystem::path& path, Document& doc) {
+        auto fp = std::fopen(path.generic_string().c_str(), "rb");
+        if (!fp) return false;
+
+        char readBuffer[1 << 16];
+        FileReadStream is(fp, readBuffer, sizeof(readBuffer));
+        doc.ParseStream<kFlags>(is);
+        std::fclose(fp);
+        return !doc.HasParseError();
+    }
+
+    bool ParseCopy(const std::filesystem::path& path, Document& doc) {
+        std::vector<char> buffer;
+        if (!ReadBuffer(path, buffer)) return false;
+        doc.Parse<kFlags>(buffer.data());
+        return !doc.HasParseError();
+    }
+
+    // The buffer has to outlive the document, as in JSONFile
+    bool ParseInSitu(const std::filesystem::path& path, Document& doc, std::vector<char>& buffer) {
+        if (!ReadBuffer(path, buffer)) return false;
+        doc.ParseInsitu<kFlags>(buffer.data());
+        return !doc.HasParseError();
+    }
+
+    template <class F>
+    Result Run(int runs, const Document& expected, F&& parse) {
+        Result result;
+        for (int i = 0; i < runs; i++) {
+            Document doc;
+            std::vector<char> buffer;
+
+            auto start = std::chrono::steady_clock::now();
+            bool bParsed = parse(doc, buffer);
+            result.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            result.bOk = result.bOk && bParsed && doc == expected;
+            result.allocated = doc.GetAllocator().Size();
+        }
+        result.ms /= runs;
+        return result;
+    }
+
+    struct Totals {
+        Result stream, copy, insitu;
+    };
+
+    void Add(Result& total, const Result& r) {
+        total.ms += r.ms;
+        total.allocated += r.allocated;
+        total.bOk = total.bOk && r.bOk;
+    }
+
+    bool RunFile(const std::filesystem::path& path, int runs, Totals& totals) {
+        Document expected;
+        if (!ParseStream(path, expected)) {
+            std::cerr << "Could not parse " << path.generic_string() << "\n";
+            return false;
+        }
+
+        Add(totals.stream, Run(runs, expected, [&](Document& doc, std::vector<char>&) { return ParseStream(path, doc); }));
+        Add(totals.copy, Run(runs, expected, [&](Document& doc, std::vector<char>&) { return ParseCopy(path, doc); }));
+        Add(totals.insitu, Run(runs, expected, [&](Document& doc, std::vector<char>& buffer) { return ParseInSitu(path, doc, buffer); }));
+        return true;
+    }
+
+    // A change file of a few thousand items with the usual mix of names, numbers and keyword lists
+    bool WriteSample(const std::filesystem::path& path) {
+        const char* sets[] = {"Iron", "Steel", "Leather", "Elven", "Glass", "Ebony", "Daedric", "Dragonplate"};
+        std::mt19937 rng(4);
+
+        std::ofstream out(path, std::ios::binary);
+        out << "{\n    // Generated by jsonbench\n    \"items\": {\n";
+        for (int i = 0; i < 4000; i++) {
+            out << (i ? ",\n" : "") << "        \"0x" << std::hex << 0x800 + i << std::dec << "\": {\"name\": \"" << sets[rng() % std::size(sets)] << " Armor Piece " << i
+                << "\", \"armorSet\": \"" << sets[rng() % std::size(sets)] << "\", \"rating\": " << rng() % 100 << ", \"weight\": " << (rng() % 500) / 10.0
+                << ", \"keywords\": [\"ArmorLight\", \"ArmorCuirass\", \"VendorItemArmor\",], \"loot\": {\"profile\": \"Treasure - Universal\", \"pieces\": true}}";
+        }
+        out << "\n    },\n}\n";
+        return (bool)out;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::filesystem::path path;
+    bool bSample = argc < 2;
+    if (bSample) {
+        path = std::filesystem::temp_directory_path() / "qar-jsonbench.json";
+        if (!WriteSample(path)) {
+            std::cerr << "Could not write " << path.generic_string() << "\n";
+            return 1;
+        }
+    } else
+        path = argv[1];
+    int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 50;
+
+    // Files that don't parse are left out, the plugin skips them too
+    Totals totals;
+    std::uintmax_t size = 0;
+    int nFiles = 0;
+    std::error_code ec;
+    if (std::filesystem::is_directory(path)) {
+        for (auto& entry : std::filesystem::directory_iterator(path)) {
+            if (!entry.is_regular_file() || entry.path().extension() != ".json") continue;
+            if (RunFile(entry.path(), runs, totals)) {
+                size += entry.file_size(ec);
+                nFiles++;
+            }
+        }
+    } else if (RunFile(path, runs, totals)) {
+        size = std::filesystem::file_size(path, ec);
+        nFiles = 1;
+    }
+    if (bSample) std::filesystem::remove(path, ec);
+
+    if (!nFiles) {
+        std::cerr << "Nothing to parse in " << path.generic_string() << "\n";
+        return 1;
+    }
+
+    auto& [stream, copy, insitu] = totals;
+    std::printf("%s, %d file%s, %.1f KB, %d runs\n", path.filename().generic_string().c_str(), nFiles, nFiles == 1 ? "" : "s", size / 1024.0, runs);
+    std::printf("%-28s %10s %10s %16s\n", "", nFiles == 1 ? "ms/file" : "ms/all", "speedup", "allocator (KB)");
+    auto Print = [&](const char* name, const Result& r) {
+        std::printf("%-28s %10.3f %9.2fx %16.1f%s\n", name, r.ms, stream.ms / r.ms, r.allocated / 1024.0, r.bOk ? "" : "  MISMATCH");
+    };
+    Print("Streamed, copying", stream);
+    Print("Read once, copying", copy);
+    Print("Read once, in-situ", insitu);
+
+    return stream.bOk && copy.bOk && insitu.bOk ? 0 : 1;
+}
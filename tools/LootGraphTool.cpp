@@ -0,0 +1,68 @@
+/*////////////////////////////////////////////////////////////////////
+    Offline loot graph inspector
+
+    Reads the "QuickArmorRebalance LootGraph.json" written in game with
+    exportlootgraph enabled, prints the size and shape summary, and can
+    write the DOT and metrics JSON files from it. Doesn't need the game
+    or CommonLib, only rapidjson's headers (from vcpkg or a checkout),
+    so it builds on its own on any platform:
+
+        g++ -std=c++20 -O2 -Isrc -I<rapidjson>/include tools/LootGraphTool.cpp src/LootGraph.cpp src/LootGraphExport.cpp src/LootBudget.cpp -o lootgraph
+
+        lootgraph <LootGraph.json> [--dot out.dot] [--metrics out.json]
+*//////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "LootGraphExport.h"
+
+using namespace QuickArmorRebalance;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <LootGraph.json> [--dot out.dot] [--metrics out.json]\n";
+        return 2;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Could not open " << argv[1] << "\n";
+        return 1;
+    }
+
+    LootGraph graph;
+    std::string error;
+    if (!ReadLootGraphJSON(in, graph, error)) {
+        std::cerr << argv[1] << ": " << error << "\n";
+        return 1;
+    }
+
+    auto metrics = ComputeLootNodeMetrics(graph);
+
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string_view option = argv[i];
+        std::ofstream out(argv[i + 1]);
+        if (!out) {
+            std::cerr << "Could not open " << argv[i + 1] << "\n";
+            return 1;
+        }
+
+        if (option == "--dot")
+            WriteLootGraphDOT(graph, metrics, out);
+        else if (option == "--metrics")
+            WriteLootGraphAdjacency(graph, metrics, out);
+        else {
+            std::cerr << "Unknown option " << option << "\n";
+            return 2;
+        }
+    }
+
+    auto summary = SummarizeLootGraph(graph, metrics);
+    std::cout << "lists " << summary.nodes << "\nentries " << summary.entries << "\nitems " << summary.items << "\ntargets " << summary.targets << "\nshared "
+              << summary.shared << "\nmax depth " << summary.maxDepth << "\nmax entries " << summary.maxEntries << "\nmax fan out " << summary.maxFanOut
+              << "\nmax reachable items " << summary.maxReachableItems << "\n";
+    return 0;
+}
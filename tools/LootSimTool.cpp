@@ -0,0 +1,101 @@
+/*////////////////////////////////////////////////////////////////////
+    Offline loot simulator
+
+    Reads the "QuickArmorRebalance LootGraph.json" written in game with
+    exportlootgraph enabled and rolls every container in it the way the
+    game resolves leveled lists, on all cores, then prints the same
+    report the in-game distribution test writes: average items per roll
+    for each container and level, next to the exact expected counts, and
+    the share of rolls that gave each number of copies.
+    Doesn't need the game or CommonLib, only rapidjson's headers:
+
+        g++ -std=c++20 -O2 -Isrc -I<rapidjson>/include tools/LootSimTool.cpp src/LootSimulation.cpp src/LootAnalysis.cpp src/LootGraph.cpp src/LootGraphExport.cpp src/LootBudget.cpp src/Random.cpp -o lootsim -ltbb
+
+        lootsim <LootGraph.json> [--rolls N] [--seed N] [--levels 1,6,11] [--out report.txt] [--no-exact]
+*//////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "LootAnalysis.h"
+#include "LootGraphExport.h"
+#include "LootSimulation.h"
+
+using namespace QuickArmorRebalance;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <LootGraph.json> [--rolls N] [--seed N] [--levels 1,6,11] [--out report.txt] [--no-exact]\n";
+        return 2;
+    }
+
+    // Same defaults as the in-game distribution test
+    LootSimulationParams params;
+    for (int level = 1; level <= 51; level += 5) params.levels.push_back(level);
+
+    std::string out;
+    bool bExact = true;
+
+    for (int i = 2; i < argc; i++) {
+        std::string_view option = argv[i];
+        if (option == "--no-exact") {
+            bExact = false;
+            continue;
+        }
+
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << option << "\n";
+            return 2;
+        }
+        const char* value = argv[++i];
+
+        if (option == "--rolls")
+            params.rolls = (std::uint32_t)std::strtoul(value, nullptr, 10);
+        else if (option == "--seed")
+            params.seed = std::strtoull(value, nullptr, 10);
+        else if (option == "--levels") {
+            params.levels.clear();
+            std::stringstream ss(value);
+            for (std::string level; std::getline(ss, level, ',');) {
+                if (!level.empty()) params.levels.push_back(std::atoi(level.c_str()));
+            }
+        } else if (option == "--out")
+            out = value;
+        else {
+            std::cerr << "Unknown option " << option << "\n";
+            return 2;
+        }
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+        std::cerr << "Could not open " << argv[1] << "\n";
+        return 1;
+    }
+
+    LootGraph graph;
+    std::string error;
+    if (!ReadLootGraphJSON(in, graph, error)) {
+        std::cerr << argv[1] << ": " << error << "\n";
+        return 1;
+    }
+
+    auto result = SimulateLoot(graph, params);
+    LootExpectation expectation(graph);
+
+    std::ofstream file;
+    if (!out.empty()) {
+        file.open(out);
+        if (!file) {
+            std::cerr << "Could not open " << out << "\n";
+            return 1;
+        }
+    }
+
+    WriteLootSimulationReport(graph, result, bExact ? &expectation : nullptr, out.empty() ? std::cout : file);
+    return 0;
+}
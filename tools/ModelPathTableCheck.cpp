@@ -0,0 +1,230 @@
+/*////////////////////////////////////////////////////////////////////
+    Model path table check
+
+    Checks ModelPathTable and the PublishedTable swap the nif load hook
+    reads it through:
+
+    - Case and slash folded hashing, and lookups of every path spelled
+      with other case and slashes
+    - A hash match on a different path (a collision, forced by passing
+      another path's hash) is turned down by the full compare, including
+      prefixes and extensions of a stored path
+    - Misses, empty paths, later duplicates replacing earlier ones, and
+      probing through runs of slots on tables much larger than 16
+    - Publishing: swapped out tables are freed once no reader is
+      registered and kept while one is, and reader threads looking up
+      paths while tables are swapped always see a whole table. Build
+      with -fsanitize=address to have a table freed early show up
+
+    Exits nonzero on any failure. Standard library only:
+
+        g++ -std=c++20 -O2 -pthread -Isrc tools/ModelPathTableCheck.cpp -o modelpathcheck
+
+        modelpathcheck [paths] [swaps]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ModelPaths.h"
+#include "PublishedTable.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    int failures = 0;
+
+    void Check(bool bOk, const char* what) {
+        std::printf("%-62s %s\n", what, bOk ? "ok" : "FAILED");
+        failures += !bOk;
+    }
+
+    std::vector<std::string> MakePaths(int n, std::mt19937& rng) {
+        const char* folders[] = {"Armor\\Iron\\", "armor\\steel\\", "Clothes/Farm/", "MyMod\\Sets\\Plate\\", "weapons\\"};
+        const char* parts[] = {"Cuirass", "Boots", "Gauntlets", "Helmet", "Shield", "Greaves"};
+
+        std::vector<std::string> paths;
+        for (int i = 0; i < n; i++) {
+            auto path = std::string(folders[rng() % 5]) + parts[rng() % 6] + std::to_string(i) + (rng() % 2 ? "_0.nif" : "_1.NIF");
+            paths.push_back(path);
+        }
+        return paths;
+    }
+
+    // Same path with the case of every letter and the direction of every slash picked at random
+    std::string Respell(const std::string& path, std::mt19937& rng) {
+        auto str = path;
+        for (auto& c : str) {
+            if (c >= 'a' && c <= 'z' && rng() % 2)
+                c -= 'a' - 'A';
+            else if (c >= 'A' && c <= 'Z' && rng() % 2)
+                c += 'a' - 'A';
+            else if ((c == '\\' || c == '/') && rng() % 2)
+                c = c == '\\' ? '/' : '\\';
+        }
+        return str;
+    }
+
+    void CheckHashing(const std::vector<std::string>& paths, std::mt19937& rng) {
+        bool bSame = true, bDifferent = true;
+        for (auto& path : paths) {
+            auto respelled = Respell(path, rng);
+            bSame &= HashModelPath(path.c_str()) == HashModelPath(respelled.c_str());
+            bSame &= HashModelPath(std::string_view(path)) == HashModelPath(path.c_str());
+            bSame &= NormalizeModelPath(path) == NormalizeModelPath(respelled);
+            bSame &= ModelPathEquals(respelled.c_str(), path);
+        }
+
+        // Fixed values, so saved hashes stay valid across builds
+        bSame &= HashModelPath("") == 0xcbf29ce484222325ull;
+        bSame &= HashModelPath("Armor/Iron/Cuirass_1.nif") == HashModelPath("armor\\iron\\cuirass_1.nif");
+
+        std::vector<std::uint64_t> hashes;
+        for (auto& path : paths) hashes.push_back(HashModelPath(path.c_str()));
+        std::sort(hashes.begin(), hashes.end());
+        bDifferent = std::adjacent_find(hashes.begin(), hashes.end()) == hashes.end();
+
+        Check(bSame, "Hashes and compares ignore case and slash direction");
+        Check(bDifferent, "Different paths hash differently");
+    }
+
+    void CheckLookups(const std::vector<std::string>& paths, std::mt19937& rng) {
+        std::vector<std::pair<std::string, int>> entries;
+        for (std::size_t i = 0; i < paths.size(); i++) entries.emplace_back(paths[i], (int)i);
+        entries.emplace_back("", -1);                         // Ignored
+        entries.emplace_back(Respell(paths[0], rng), 12345);  // Replaces the first one
+
+        ModelPathTable<int> table(entries);
+        Check(table.Size() == paths.size(), "Empty paths skipped, duplicates stored once");
+
+        bool bHits = true;
+        for (std::size_t i = 0; i < paths.size(); i++) {
+            auto found = table.Find(Respell(paths[i], rng).c_str());
+            bHits &= found && *found == (i ? (int)i : 12345);
+        }
+        Check(bHits, "Every path is found however it's spelled");
+
+        bool bMisses = !table.Find("") && !table.Find("armor\\iron\\cuirass.nif") && !table.Find("x");
+        for (auto& path : paths) {
+            bMisses &= !table.Find((path + "x").c_str());
+            bMisses &= !table.Find(path.substr(0, path.size() - 1).c_str());
+            bMisses &= !table.Find(("data\\meshes\\" + path).c_str());
+        }
+        Check(bMisses, "Paths that aren't stored miss");
+
+        // Every stored path's hash offered with a different path, as a real 64 bit collision would
+        bool bRejected = true;
+        for (std::size_t i = 0; i < paths.size(); i++) {
+            auto hash = HashModelPath(paths[i].c_str());
+            auto& other = paths[(i + 1) % paths.size()];
+            bRejected &= !table.Find(other.c_str(), hash);
+            bRejected &= !table.Find((paths[i] + "_").c_str(), hash);
+            bRejected &= !table.Find(paths[i].substr(0, paths[i].size() / 2).c_str(), hash);
+            bRejected &= table.Find(paths[i].c_str(), hash) != nullptr;
+        }
+        Check(bRejected, "Hash collisions are turned down by the full compare");
+
+        ModelPathTable<int> empty(std::vector<std::pair<std::string, int>>{});
+        Check(!empty.Size() && !empty.Find(paths[0].c_str()), "Empty table finds nothing");
+    }
+
+    // Every entry of a published table holds the table's generation, so a reader seeing a mix or freed memory shows up
+    using Table = ModelPathTable<int>;
+
+    std::unique_ptr<Table> MakeGeneration(const std::vector<std::string>& paths, int generation) {
+        std::vector<std::pair<std::string_view, int>> entries;
+        for (auto& path : paths) entries.emplace_back(path, generation);
+        return std::make_unique<Table>(entries);
+    }
+
+    void CheckPublishing(const std::vector<std::string>& paths, int swaps) {
+        {
+            PublishedTable<Table> published;
+            Check(!PublishedTable<Table>::Reader(published).Get(), "Nothing to read before the first publish");
+
+            published.Publish(MakeGeneration(paths, 1));
+            published.Publish(MakeGeneration(paths, 2));
+            bool bFreed = published.Retired() == 0;
+
+            bool bKept;
+            {
+                PublishedTable<Table>::Reader reader(published);
+                auto table = reader.Get();
+                published.Publish(MakeGeneration(paths, 3));
+                published.Publish(nullptr);
+                bKept = published.Retired() == 2 && *table->Find(paths[0].c_str()) == 2;
+            }
+
+            published.Publish(MakeGeneration(paths, 4));
+            bFreed &= published.Retired() == 0;
+
+            Check(bKept, "Swapped out tables are kept while a reader is registered");
+            Check(bFreed, "and freed by the next swap once none is");
+        }
+
+        PublishedTable<Table> published;
+        published.Publish(MakeGeneration(paths, 0));
+
+        std::atomic<bool> bDone = false;
+        std::atomic<int> torn = 0;
+        std::atomic<std::uint64_t> reads = 0;
+
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 3; t++) {
+            readers.emplace_back([&, t] {
+                std::mt19937 rng(t);
+                std::uint64_t n = 0;
+                while (!bDone.load()) {
+                    PublishedTable<Table>::Reader reader(published);
+                    auto table = reader.Get();
+                    if (!table) continue;
+
+                    auto first = table->Find(paths[rng() % paths.size()].c_str());
+                    for (int i = 0; i < 16; i++) {
+                        auto found = table->Find(paths[rng() % paths.size()].c_str());
+                        if (!found || !first || *found != *first) torn++;
+                    }
+                    n++;
+                }
+                reads += n;
+            });
+        }
+
+        std::size_t maxRetired = 0;
+        for (int i = 1; i <= swaps; i++) {
+            published.Publish(i % 50 ? MakeGeneration(paths, i) : nullptr);
+            maxRetired = std::max(maxRetired, published.Retired());
+            if (i % 8 == 0) std::this_thread::yield();
+        }
+
+        bDone = true;
+        for (auto& i : readers) i.join();
+
+        published.Publish(nullptr);
+        std::printf("  %d swaps, %llu reads, at most %zu tables waiting to be freed\n", swaps, (unsigned long long)reads.load(), maxRetired);
+        Check(!torn, "Readers always see one whole table while tables are swapped");
+        Check(!published.Retired(), "Everything retired is freed once the readers stop");
+    }
+}
+
+int main(int argc, char** argv) {
+    int nPaths = argc > 1 ? std::max(2, std::atoi(argv[1])) : 5000;
+    int swaps = argc > 2 ? std::max(1, std::atoi(argv[2])) : 2000;
+
+    std::mt19937 rng(8);
+    auto paths = MakePaths(nPaths, rng);
+
+    CheckHashing(paths, rng);
+    CheckLookups(paths, rng);
+    CheckPublishing(std::vector<std::string>(paths.begin(), paths.begin() + std::min(nPaths, 200)), swaps);
+
+    std::printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+/*////////////////////////////////////////////////////////////////////
+    Profiler check
+
+    Builds the profiler core on its own, without the game or CommonLib,
+    records nested spans on a few threads along with some counters, and
+    checks the summary table and that the Chrome trace parses back with
+    every span and counter in it, read with rapidjson the way the plugin
+    reads JSON. Exits nonzero on the first failure:
+
+        g++ -std=c++20 -O2 -Isrc -I<rapidjson>/include tools/ProfilerCheck.cpp src/Profiler.cpp -o profilercheck
+*//////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Profiler.h"
+#include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    int failures = 0;
+
+    void Check(bool b, const char* what) {
+        if (b) return;
+        std::cerr << "FAILED: " << what << "\n";
+        failures++;
+    }
+
+    const rapidjson::Value* Member(const rapidjson::Value& value, const char* key) {
+        if (!value.IsObject()) return nullptr;
+        auto it = value.FindMember(key);
+        return it != value.MemberEnd() ? &it->value : nullptr;
+    }
+
+    bool IsString(const rapidjson::Value* value, std::string_view str) { return value && value->IsString() && value->GetString() == str; }
+
+    void Work() {
+        volatile unsigned int n = 0;
+        for (int i = 0; i < 100000; i++) n = n + i;
+    }
+}
+
+int main() {
+    auto profiler = Profiler::Get();
+    profiler->Reset();
+
+    {
+        ScopedTimer outer("Load \"quoted\"\\path");
+        {
+            ScopedTimer inner("Parse");
+            Work();
+            profiler->Count("Files", 3);
+        }
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 3; t++) {
+            threads.emplace_back([profiler] {
+                ScopedTimer timer("Worker");
+                {
+                    ScopedTimer nested("Worker step");
+                    Work();
+                }
+                profiler->Count("Items");
+            });
+        }
+        for (auto& t : threads) t.join();
+    }
+    {
+        ScopedTimer second("Second phase");
+        Work();
+    }
+
+    auto spans = profiler->GetSpans();
+    Check(spans.size() == 9, "span count");
+    Check(profiler->GetCount("Files") == 3 && profiler->GetCount("Items") == 3, "counters");
+    Check(profiler->GetCount("Missing") == 0, "missing counter");
+
+    int workers = 0;
+    for (auto& i : spans) {
+        Check(i.end >= i.start, "span finished");
+        if (std::string(i.name) == "Parse") Check(i.depth == 1 && i.thread == 0, "nested depth on the main thread");
+        if (std::string(i.name) == "Worker") {
+            Check(i.depth == 0 && i.thread != 0, "worker threads start at depth 0");
+            workers++;
+        }
+        if (std::string(i.name) == "Worker step") Check(i.depth == 1, "nested depth on a worker");
+    }
+    Check(workers == 3, "worker spans");
+
+    auto summary = profiler->Summary();
+    Check(summary.starts_with("Phase"), "summary header");
+    Check(summary.find("\n  Parse ") != std::string::npos, "summary indents nested spans");
+    Check(summary.find("Worker [") != std::string::npos, "summary marks worker threads");
+    Check(summary.find("Files") != std::string::npos && summary.find("Items") != std::string::npos, "summary counters");
+
+    std::stringstream trace;
+    WriteProfilerTrace(*profiler, "Check", trace);
+
+    auto text = trace.str();
+    rapidjson::Document root;
+    root.Parse<rapidjson::kParseCommentsFlag | rapidjson::kParseTrailingCommasFlag>(text.data(), text.size());
+    if (root.HasParseError()) {
+        std::cerr << "Trace doesn't parse: " << rapidjson::GetParseError_En(root.GetParseError()) << " at offset " << root.GetErrorOffset() << "\n" << text;
+        return 1;
+    }
+
+    auto events = Member(root, "traceEvents");
+    Check(events && events->IsArray() && events->Size() == spans.size() + 2, "trace event count");
+    if (events && events->IsArray()) {
+        bool bQuoted = false;
+        int counters = 0;
+        for (auto& i : events->GetArray()) {
+            auto name = Member(i, "name");
+            auto ph = Member(i, "ph");
+            Check(name && name->IsString() && ph && ph->IsString(), "trace event fields");
+            if (!name || !name->IsString() || !ph || !ph->IsString()) continue;
+
+            if (IsString(name, "Load \"quoted\"\\path")) bQuoted = true;
+            if (IsString(ph, "X")) {
+                auto dur = Member(i, "dur");
+                Check(dur && dur->IsNumber() && dur->GetDouble() >= 0, "trace span duration");
+                Check(IsString(Member(i, "cat"), "Check"), "trace category");
+            } else if (IsString(ph, "C")) {
+                auto args = Member(i, "args");
+                auto value = args ? Member(*args, "value") : nullptr;
+                Check(value && value->IsNumber() && value->GetDouble() == 3, "trace counter value");
+                counters++;
+            }
+        }
+        Check(bQuoted, "trace escapes names");
+        Check(counters == 2, "trace counters");
+    }
+
+    if (failures) return 1;
+
+    std::cout << summary << "\nOK\n";
+    return 0;
+}
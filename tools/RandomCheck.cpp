@@ -0,0 +1,299 @@
+/*////////////////////////////////////////////////////////////////////
+    Random number check
+
+    Statistical and behavioral checks for Random.h:
+
+    - Uniform, UniformF and Below(n) for several n, chi-square against
+      an even spread and range checks
+    - Bit balance, every output bit set about half the time
+    - StreamRandom gives the same stream for the same seed and keys, and
+      a different one when any of them changes
+    - ThreadRandom on different threads gives streams that don't repeat
+      each other or correlate, and reseeding gives every thread a new one
+    - RandomScope sends ThreadRandom to its stream and nested scopes put
+      back what was there before
+
+    Limits are about five standard deviations, so a correct generator
+    passes on any seed. Exits nonzero on any failure. Standard library
+    only:
+
+        g++ -std=c++20 -O2 -pthread -Isrc tools/RandomCheck.cpp src/Random.cpp -o randomcheck
+
+        randomcheck [samples] [seed]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Random.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    int failures = 0;
+
+    void Check(bool bOk, const char* what) {
+        std::printf("%-58s %s\n", what, bOk ? "ok" : "FAILED");
+        failures += !bOk;
+    }
+
+    // Chi-square of the counts against an even spread, and whether it's within five standard deviations of its mean
+    bool EvenSpread(const std::vector<std::uint64_t>& counts, std::uint64_t samples, double& chi2) {
+        double expected = (double)samples / counts.size();
+        chi2 = 0.0;
+        for (auto c : counts) chi2 += (c - expected) * (c - expected) / expected;
+
+        double df = (double)counts.size() - 1;
+        return std::abs(chi2 - df) <= 5.0 * std::sqrt(2.0 * df);
+    }
+
+    void CheckUniform(std::uint64_t samples, std::uint64_t seed) {
+        Random random(seed);
+
+        constexpr int kBins = 1000;
+        std::vector<std::uint64_t> counts(kBins);
+        bool bRange = true;
+        for (std::uint64_t i = 0; i < samples; i++) {
+            auto u = random.Uniform();
+            bRange &= u >= 0.0 && u < 1.0;
+            counts[std::min(kBins - 1, (int)(u * kBins))]++;
+        }
+
+        double chi2;
+        bool bEven = EvenSpread(counts, samples, chi2);
+        std::printf("  Uniform: chi-square %.1f over %d bins\n", chi2, kBins - 1);
+        Check(bRange, "Uniform stays in [0, 1)");
+        Check(bEven, "Uniform is evenly spread");
+
+        std::fill(counts.begin(), counts.end(), 0);
+        bRange = true;
+        for (std::uint64_t i = 0; i < samples; i++) {
+            auto u = random.UniformF();
+            bRange &= u >= 0.0f && u < 1.0f;
+            counts[std::min(kBins - 1, (int)(u * kBins))]++;
+        }
+
+        bEven = EvenSpread(counts, samples, chi2);
+        std::printf("  UniformF: chi-square %.1f over %d bins\n", chi2, kBins - 1);
+        Check(bRange, "UniformF stays in [0, 1)");
+        Check(bEven, "UniformF is evenly spread");
+    }
+
+    void CheckBelow(std::uint64_t samples, std::uint64_t seed) {
+        Random random(seed + 1);
+
+        bool bRange = true, bEven = true;
+        for (std::uint32_t n : {1u, 2u, 3u, 7u, 10u, 100u, 255u, 1000u}) {
+            std::vector<std::uint64_t> counts(n);
+            for (std::uint64_t i = 0; i < samples; i++) {
+                auto v = random.Below(n);
+                if (v >= n) {
+                    bRange = false;
+                    continue;
+                }
+                counts[v]++;
+            }
+
+            if (n == 1) continue;
+
+            double chi2;
+            bool b = EvenSpread(counts, samples, chi2);
+            std::printf("  Below(%u): chi-square %.1f over %u bins\n", n, chi2, n - 1);
+            bEven &= b;
+        }
+
+        // Too many values to count each, so spread over bins by value. The top bin is short by n % kBins values, so it's left out
+        constexpr std::uint32_t kBins = 1000;
+        for (std::uint32_t n : {1u << 20, 3000000019u}) {
+            std::vector<std::uint64_t> counts(kBins);
+            auto width = n / kBins;
+            std::uint64_t counted = 0;
+            for (std::uint64_t i = 0; i < samples; i++) {
+                auto v = random.Below(n);
+                if (v >= n) {
+                    bRange = false;
+                    continue;
+                }
+                if (v / width < kBins) {
+                    counts[v / width]++;
+                    counted++;
+                }
+            }
+
+            double chi2;
+            bool b = EvenSpread(counts, counted, chi2);
+            std::printf("  Below(%u): chi-square %.1f over %u bins\n", n, chi2, kBins - 1);
+            bEven &= b;
+        }
+
+        Check(bRange, "Below(n) stays in [0, n)");
+        Check(bEven, "Below(n) is evenly spread");
+    }
+
+    void CheckBits(std::uint64_t samples, std::uint64_t seed) {
+        Random random(seed + 2);
+
+        std::uint64_t ones[64] = {};
+        for (std::uint64_t i = 0; i < samples; i++) {
+            auto v = random();
+            for (int b = 0; b < 64; b++) ones[b] += (v >> b) & 1;
+        }
+
+        double worst = 0.0;
+        for (auto n : ones) worst = std::max(worst, std::abs((double)n - samples / 2.0) / (std::sqrt((double)samples) / 2.0));
+        std::printf("  Worst bit is %.2f standard deviations from half\n", worst);
+        Check(worst <= 5.0, "Every output bit is balanced");
+    }
+
+    std::vector<std::uint64_t> Take(Random random, int n) {
+        std::vector<std::uint64_t> ret(n);
+        for (auto& i : ret) i = random();
+        return ret;
+    }
+
+    void CheckStreams(std::uint64_t seed) {
+        SeedRandom(seed);
+        auto a = Take(StreamRandom(0x1234, 56, 1), 1000);
+        auto b = Take(StreamRandom(0x1234, 56, 1), 1000);
+        Check(a == b, "StreamRandom repeats for the same seed and keys");
+
+        bool bDiffers = true;
+        for (auto keys : {std::vector<std::uint64_t>{0x1235, 56, 1}, {0x1234, 57, 1}, {0x1234, 56, 0}, {56, 0x1234, 1}}) {
+            bDiffers &= Take(StreamRandom(keys[0], keys[1], keys[2]), 1000) != a;
+        }
+        Check(bDiffers, "StreamRandom differs when any key changes");
+
+        SeedRandom(seed + 1);
+        bool bReseeded = Take(StreamRandom(0x1234, 56, 1), 1000) != a;
+        SeedRandom(seed);
+        bool bBack = Take(StreamRandom(0x1234, 56, 1), 1000) == a;
+        Check(bReseeded && bBack, "StreamRandom follows the run seed");
+
+        // Nearby keys, like consecutive form IDs or days, shouldn't give related streams
+        std::set<std::uint64_t> firsts;
+        for (std::uint64_t key = 0; key < 100000; key++) firsts.insert(StreamRandom(0x14000, key)());
+        Check(firsts.size() == 100000, "Consecutive keys give different streams");
+    }
+
+    // Pearson correlation of the two streams as uniforms
+    double Correlation(const std::vector<std::uint64_t>& a, const std::vector<std::uint64_t>& b) {
+        auto U = [](std::uint64_t v) { return (double)(v >> 11) * 0x1.0p-53; };
+
+        double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+        auto n = (double)a.size();
+        for (std::size_t i = 0; i < a.size(); i++) {
+            auto x = U(a[i]), y = U(b[i]);
+            sa += x, sb += y, saa += x * x, sbb += y * y, sab += x * y;
+        }
+        return (sab - sa * sb / n) / std::sqrt((saa - sa * sa / n) * (sbb - sb * sb / n));
+    }
+
+    void CheckThreads(std::uint64_t seed) {
+        constexpr int kThreads = 8;
+        constexpr int kDraws = 100000;
+
+        SeedRandom(seed);
+
+        auto Collect = [&] {
+            std::vector<std::vector<std::uint64_t>> streams(kThreads);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < kThreads; t++) {
+                threads.emplace_back([&streams, t] {
+                    auto& random = ThreadRandom();
+                    streams[t].resize(kDraws);
+                    for (auto& i : streams[t]) i = random();
+                });
+            }
+            for (auto& i : threads) i.join();
+            return streams;
+        };
+
+        auto streams = Collect();
+
+        // Any value showing up in two streams would mean they overlap, with 64 bit outputs that's never chance
+        std::set<std::uint64_t> seen;
+        bool bDistinct = true;
+        for (auto& stream : streams) {
+            for (auto v : stream) bDistinct &= seen.insert(v).second;
+        }
+        Check(bDistinct, "Thread streams never repeat each other");
+
+        double worst = 0.0;
+        for (int i = 0; i < kThreads; i++) {
+            for (int j = i + 1; j < kThreads; j++) worst = std::max(worst, std::abs(Correlation(streams[i], streams[j])));
+        }
+        std::printf("  Largest correlation between threads %.5f (limit %.5f)\n", worst, 5.0 / std::sqrt((double)kDraws));
+        Check(worst <= 5.0 / std::sqrt((double)kDraws), "Thread streams are uncorrelated");
+
+        // This thread's generator picks the new seed up on its next roll, the same as any other thread's
+        auto& mine = ThreadRandom();
+        auto before = Take(mine, 100);
+        SeedRandom(seed + 1);
+        auto after = Take(ThreadRandom(), 100);
+        bool bNew = before != after && &ThreadRandom() == &mine;
+
+        auto reseeded = Collect();
+        for (int t = 0; t < kThreads; t++) bNew &= reseeded[t] != streams[t];
+        Check(bNew, "Reseeding gives every thread a new stream");
+    }
+
+    void CheckScopes(std::uint64_t seed) {
+        SeedRandom(seed);
+        auto own = &ThreadRandom();
+
+        Random outer = StreamRandom(1), inner = StreamRandom(2);
+        auto outerExpected = Take(StreamRandom(1), 3);
+
+        bool bOk = true;
+        {
+            RandomScope scope(outer);
+            bOk &= &ThreadRandom() == &outer;
+            auto first = ThreadRandom()();
+            {
+                RandomScope nested(inner);
+                bOk &= &ThreadRandom() == &inner;
+                ThreadRandom()();
+            }
+            bOk &= &ThreadRandom() == &outer;
+
+            // The nested scope didn't draw from the outer stream
+            auto second = ThreadRandom()();
+            bOk &= first == outerExpected[0] && second == outerExpected[1];
+
+            // Scopes on other threads don't leak into this one
+            std::thread([&] {
+                Random other = StreamRandom(3);
+                RandomScope otherScope(other);
+                bOk &= &ThreadRandom() == &other;
+            }).join();
+            bOk &= &ThreadRandom() == &outer;
+        }
+        bOk &= &ThreadRandom() == own;
+
+        std::thread([&] { bOk &= &ThreadRandom() != &outer && &ThreadRandom() != &inner; }).join();
+
+        Check(bOk, "RandomScope nests and restores ThreadRandom");
+    }
+}
+
+int main(int argc, char** argv) {
+    std::uint64_t samples = argc > 1 ? std::max(1000ull, std::strtoull(argv[1], nullptr, 10)) : 10000000ull;
+    std::uint64_t seed = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 23;
+
+    std::printf("%llu samples, seed %llu\n", (unsigned long long)samples, (unsigned long long)seed);
+
+    CheckUniform(samples, seed);
+    CheckBelow(samples / 4, seed);
+    CheckBits(samples / 4, seed);
+    CheckStreams(seed);
+    CheckThreads(seed);
+    CheckScopes(seed);
+
+    std::printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/*////////////////////////////////////////////////////////////////////
+    Recipe index benchmark
+
+    Builds made-up recipes over a load order's worth of items (some with
+    several recipes for the same bench, smelting keyed by the item
+    smelted) and compares the recipe lookups ProcessData and
+    ApplyChanges do against the three std::maps they used to go through:
+    building the tables, the secondary recipe fallback, and the item and
+    source lookups of every change, hits and misses. Runs at several
+    sizes, 1k to 320k recipes unless given, to show how building and
+    lookups scale. Checks both give the same recipe for every query.
+    Standard library only:
+
+        g++ -std=c++20 -O2 -Isrc tools/RecipeIndexBenchmark.cpp -o recipebench
+
+        recipebench [recipe counts...]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "RecipeIndex.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    // Stand-ins for TESBoundObject and BGSConstructibleObject, only their addresses matter
+    struct Item {
+        int id;
+    };
+
+    struct Recipe {
+        ERecipeKind kind;
+        Item* key;
+    };
+
+    // What ProcessData used to build, first recipe wins
+    struct OldRecipes {
+        std::map<Item*, Recipe*> maps[eRecipe_KindCount];
+
+        void Add(ERecipeKind kind, Item* item, Recipe* recipe) { maps[kind].insert({item, recipe}); }
+
+        Recipe* Find(ERecipeKind kind, Item* item) const {
+            auto it = maps[kind].find(item);
+            return it != maps[kind].end() ? it->second : nullptr;
+        }
+
+        void Share(ERecipeKind kind, Item* src, Item* tar) {
+            auto& map = maps[kind];
+            if (map.find(tar) != map.end()) return;
+            auto it = map.find(src);
+            if (it != map.end()) map.insert({tar, it->second});
+        }
+    };
+
+    template <class F>
+    double Time(F&& f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    struct Result {
+        int nItems = 0;
+        double oldBuild = 0, newBuild = 0;
+        double oldLookup = 0, newLookup = 0;  // ns per lookup
+        double hitRate = 0;
+        int mismatches = 0;
+    };
+
+    Result Run(int nRecipes, int passes) {
+        Result res;
+        std::mt19937 rng(7);
+
+        // Items are allocated one at a time like forms, so they're scattered rather than one array
+        auto nItems = res.nItems = std::max(1, nRecipes * 3 / 5);
+        std::vector<std::unique_ptr<Item>> itemStore;
+        std::vector<Item*> items;
+        for (int i = 0; i < nItems; i++) items.push_back(itemStore.emplace_back(std::make_unique<Item>(Item{i})).get());
+
+        // Mostly temper and craft pairs, some smelting, a few items with more than one recipe for a bench
+        std::vector<Recipe> recipes(nRecipes);
+        for (auto& r : recipes) {
+            auto roll = rng() % 10;
+            r.kind = roll < 5 ? eRecipe_Temper : roll < 9 ? eRecipe_Craft : eRecipe_Smelt;
+            r.key = items[rng() % items.size()];
+        }
+
+        // The changes: an item and the item its recipes are copied from, a third of them without recipes of their own
+        std::vector<std::pair<Item*, Item*>> changes;
+        for (int i = 0; i < nItems; i++) changes.emplace_back(items[rng() % items.size()], items[rng() % items.size()]);
+
+        // Secondary recipes: each item without one gets its match's
+        std::vector<std::pair<Item*, Item*>> fallbacks;
+        for (int i = 0; i < nItems / 4; i++) fallbacks.emplace_back(items[rng() % items.size()], items[rng() % items.size()]);
+
+        OldRecipes old;
+        BasicRecipeIndex<Item, Recipe> index;
+
+        res.oldBuild = Time([&] {
+            for (auto& r : recipes) old.Add(r.kind, r.key, &r);
+            for (auto& f : fallbacks) {
+                old.Share(eRecipe_Temper, f.first, f.second);
+                old.Share(eRecipe_Craft, f.first, f.second);
+            }
+        });
+        res.newBuild = Time([&] {
+            index.Reserve(recipes.size());
+            for (auto& r : recipes) index.Add(r.kind, r.key, &r);
+            for (auto& f : fallbacks) {
+                index.Share(eRecipe_Temper, f.first, f.second);
+                index.Share(eRecipe_Craft, f.first, f.second);
+            }
+        });
+
+        // Same queries ApplyChanges makes per change: the item and its source, for each kind
+        std::size_t oldHits = 0, newHits = 0;
+        auto oldLookup = Time([&] {
+            for (int pass = 0; pass < passes; pass++) {
+                for (auto& c : changes) {
+                    for (int kind = 0; kind < eRecipe_KindCount; kind++) {
+                        oldHits += old.Find((ERecipeKind)kind, c.first) != nullptr;
+                        oldHits += old.Find((ERecipeKind)kind, c.second) != nullptr;
+                    }
+                }
+            }
+        });
+        auto newLookup = Time([&] {
+            for (int pass = 0; pass < passes; pass++) {
+                for (auto& c : changes) {
+                    for (int kind = 0; kind < eRecipe_KindCount; kind++) {
+                        newHits += index.Find((ERecipeKind)kind, c.first) != nullptr;
+                        newHits += index.Find((ERecipeKind)kind, c.second) != nullptr;
+                    }
+                }
+            }
+        });
+
+        for (auto item : items) {
+            for (int kind = 0; kind < eRecipe_KindCount; kind++) res.mismatches += old.Find((ERecipeKind)kind, item) != index.Find((ERecipeKind)kind, item);
+        }
+        if (oldHits != newHits) res.mismatches++;
+
+        auto lookups = (double)passes * changes.size() * (int)eRecipe_KindCount * 2;
+        res.oldLookup = 1e6 * oldLookup / lookups;
+        res.newLookup = 1e6 * newLookup / lookups;
+        res.hitRate = newHits / lookups;
+        return res;
+    }
+}
+
+int main(int argc, char** argv) {
+    // Sizes from a light load order up to far past a heavy one, so how the build scales shows and not just one point
+    std::vector<int> sizes;
+    for (int i = 1; i < argc && std::atoi(argv[i]) > 0; i++) sizes.push_back(std::atoi(argv[i]));
+    if (sizes.empty()) sizes = {1000, 5000, 20000, 80000, 320000};
+
+    // Roughly the same number of lookups at every size
+    constexpr double kLookups = 2.4e7;
+
+    std::printf("%9s %8s %11s %11s %8s %12s %13s %8s %6s\n", "recipes", "items", "map build", "index build", "build x", "map ns/look", "index ns/look",
+                "look x", "hits");
+    int mismatches = 0;
+    for (auto n : sizes) {
+        auto passes = std::max(1, (int)(kLookups / (n * 3 / 5 * (int)eRecipe_KindCount * 2)));
+        auto r = Run(n, passes);
+        mismatches += r.mismatches;
+        std::printf("%9d %8d %9.2fms %9.2fms %7.2fx %12.1f %13.1f %7.2fx %5.0f%%\n", n, r.nItems, r.oldBuild, r.newBuild, r.oldBuild / r.newBuild, r.oldLookup,
+                    r.newLookup, r.oldLookup / r.newLookup, 100.0 * r.hitRate);
+    }
+
+    if (mismatches) {
+        std::printf("MISMATCH: %d items give a different recipe\n", mismatches);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*////////////////////////////////////////////////////////////////////
+    Sharded bucket check
+
+    Runs ShardedBucketBy the way ProcessData does, over stand-ins for the
+    armor, weapon and ammo form arrays (each form allocated on its own,
+    pointing at the plugin that added it, items of a plugin mostly next
+    to each other but spread over the three arrays), and compares it with
+    a plain serial filter and bucket: same buckets in the same order of
+    first appearance, and the same items in each, sorted. Repeats at
+    several shard sizes, including ones that split a plugin's items
+    across many shards, and times both. Exits nonzero on any difference.
+    Standard library only, the parallel algorithms need TBB with g++:
+
+        g++ -std=c++20 -O2 -Isrc tools/ShardedBucketCheck.cpp -ltbb -o bucketcheck
+
+        bucketcheck [items] [runs per shard size]
+*//////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "ShardedBucket.h"
+
+using namespace QuickArmorRebalance;
+
+namespace {
+    // Stand-ins for TESFile and TESBoundObject
+    struct File {
+        int index;
+    };
+
+    struct Form {
+        File* file;
+        bool bPlayable;
+        bool bTemplated;  // Filtered out like items with a template or no name
+    };
+
+    bool IsValid(const Form* form) { return form->bPlayable && !form->bTemplated; }
+    File* FileOf(const Form* form) { return form->file; }
+
+    // What ProcessData did before: one pass over the forms, a bucket per plugin in the order first seen, each sorted
+    KeyedBuckets<File*, const Form*> SerialBucket(const std::vector<const Form*>& forms) {
+        KeyedBuckets<File*, const Form*> buckets;
+        for (auto form : forms) {
+            if (!IsValid(form)) continue;
+
+            auto it = std::find_if(buckets.begin(), buckets.end(), [&](auto& b) { return b.first == FileOf(form); });
+            if (it == buckets.end()) it = buckets.emplace(buckets.end(), FileOf(form), std::vector<const Form*>{});
+            it->second.push_back(form);
+        }
+
+        for (auto& b : buckets) std::sort(b.second.begin(), b.second.end());
+        return buckets;
+    }
+
+    template <class F>
+    double Time(F&& f) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t nItems = argc > 1 ? std::max(1, std::atoi(argv[1])) : 90000;
+    int runs = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+    std::mt19937 rng(6);
+
+    // A load order's worth of plugins, most adding a few dozen items and a few adding thousands
+    std::vector<std::unique_ptr<File>> files;
+    for (int i = 0; i < 600; i++) files.push_back(std::make_unique<File>(File{i}));
+
+    std::vector<std::unique_ptr<Form>> store;
+    std::vector<const Form*> arrays[3];  // Armor, weapons, ammo
+    while (store.size() < nItems) {
+        auto file = files[rng() % files.size()].get();
+        auto n = rng() % 20 ? 1 + rng() % 60 : 500 + rng() % 3000;
+
+        for (std::size_t i = 0; i < n && store.size() < nItems; i++) {
+            auto& form = store.emplace_back(std::make_unique<Form>(Form{file, rng() % 10 != 0, rng() % 7 == 0}));
+            auto roll = rng() % 10;
+            arrays[roll < 6 ? 0 : roll < 9 ? 1 : 2].push_back(form.get());
+        }
+    }
+
+    // Plugins overriding each other's forms put some items of a plugin far from the rest
+    for (auto& array : arrays) {
+        for (std::size_t i = 0; i < array.size() / 50; i++) std::swap(array[rng() % array.size()], array[rng() % array.size()]);
+    }
+
+    std::vector<const Form*> forms;
+    for (auto& array : arrays) forms.insert(forms.end(), array.begin(), array.end());
+
+    KeyedBuckets<File*, const Form*> expected;
+    double serial = Time([&] { expected = SerialBucket(forms); });
+
+    std::size_t kept = 0;
+    for (auto& b : expected) kept += b.second.size();
+    std::printf("%zu forms, %zu kept in %zu plugins, serial %.2f ms\n", forms.size(), kept, expected.size(), serial);
+
+    int failures = 0;
+    for (std::size_t shardSize : {(std::size_t)1, (std::size_t)7, (std::size_t)256, (std::size_t)2048, (std::size_t)16384, forms.size() + 1}) {
+        double best = 0.0;
+        bool bSame = true;
+        for (int run = 0; run < runs; run++) {
+            KeyedBuckets<File*, const Form*> buckets;
+            auto t = Time([&] { buckets = ShardedBucketBy<File*>(forms, IsValid, FileOf, shardSize); });
+            best = run ? std::min(best, t) : t;
+
+            if (buckets != expected) {
+                if (bSame) {
+                    // Say which part differs first, order of plugins or the items in one
+                    std::size_t i = 0;
+                    while (i < buckets.size() && i < expected.size() && buckets[i].first == expected[i].first) i++;
+                    if (i < buckets.size() && i < expected.size())
+                        std::printf("  shard size %zu: bucket %zu is plugin %d, expected %d\n", shardSize, i, buckets[i].first->index, expected[i].first->index);
+                    else if (buckets.size() != expected.size())
+                        std::printf("  shard size %zu: %zu buckets, expected %zu\n", shardSize, buckets.size(), expected.size());
+                    else
+                        std::printf("  shard size %zu: same plugins, different items\n", shardSize);
+                }
+                bSame = false;
+            }
+        }
+
+        std::printf("shard size %6zu: best of %d %.2f ms, %s\n", shardSize, runs, best, bSame ? "same as serial" : "DIFFERS");
+        failures += !bSame;
+    }
+
+    std::printf(failures ? "FAILED\n" : "OK\n");
+    return failures ? 1 : 0;
+}